@@ -0,0 +1,183 @@
+// Mass churn: circles added and erased at random all over scenes of 10k, 100k
+// and 1M circles. Every erase goes through Scene::erase_shape, which moves
+// the last shape into the hole and keeps every handle pointing at its shape,
+// and is timed against the vector the way the scene used to keep it:
+// std::vector::erase shifting every later shape down, and an index per shape
+// held elsewhere shifted with it, like the grid and the stores each had to.
+// The vector side leaves the grid and the stores themselves out, so it is
+// less than what an erase used to cost. Then every handle still held has to
+// find the shape it was given, every erased one nothing, and a fan through
+// the churned scene has to hit the same as through one built from scratch,
+// or the run fails. Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/churn_bench.cpp core/*.cpp -o churn_bench
+//   ./churn_bench [ops]
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../core/scene.h"
+
+typedef std::chrono::duration<double, std::micro> Micros;
+
+const double SPACING = 16;  // one circle per cell this wide
+const int FAN_RAYS = 3600;
+
+// a circle somewhere inside every cell of a square grid, the light in the middle
+static void make_scene(Scene& scene, int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    int side = (int)std::ceil(std::sqrt((double)count));
+    Point2D light(side * SPACING / 2, side * SPACING / 2);
+    scene.shapes.push_back(Shape(SHAPE_CIRCLE, light, 8, 0, true));
+    for (int i = 0; (int)scene.shapes.size() <= count; i++) {
+        double r = 2 + 4 * unit(rng);
+        Point2D c((i % side + 0.5) * SPACING + (unit(rng) - 0.5) * (SPACING - 2 * r),
+                  (i / side + 0.5) * SPACING + (unit(rng) - 0.5) * (SPACING - 2 * r));
+        if (std::hypot(c.x - light.x, c.y - light.y) < r + 9) continue;
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, c, r));
+    }
+    scene.rebuild();
+}
+
+// a shape the churn added and the handle it got
+struct Held {
+    ShapeHandle handle;
+    Point2D center;
+    double radius;
+};
+
+struct Churn {
+    int erases = 0, adds = 0;
+    Micros erase_time{0}, add_time{0};
+};
+
+// half the ops erase a random circle, half add one wherever it fits
+static Churn churn_scene(Scene& scene, int ops, std::vector<Held>& held, std::vector<ShapeHandle>& erased,
+                         std::mt19937& rng) {
+    Churn c;
+    std::uniform_real_distribution<double> unit(0, 1);
+    double extent = 2 * scene.shapes[scene.lights()[0]].center.x;
+    for (int op = 0; op < ops; op++) {
+        if (rng() % 2 == 0 && !held.empty()) {
+            size_t k = rng() % held.size();
+            int index = scene.index_of(held[k].handle);
+            auto start = std::chrono::steady_clock::now();
+            scene.erase_shape(index);
+            c.erase_time += std::chrono::steady_clock::now() - start;
+            c.erases++;
+            erased.push_back(held[k].handle);
+            held[k] = held.back();
+            held.pop_back();
+        } else {
+            double r = 2 + 4 * unit(rng);
+            Point2D at(extent * unit(rng), extent * unit(rng));
+            if (scene.overlaps_any_shape(at, r)) continue;
+            auto start = std::chrono::steady_clock::now();
+            int index = scene.add_shape(Shape(SHAPE_CIRCLE, at, r));
+            c.add_time += std::chrono::steady_clock::now() - start;
+            c.adds++;
+            held.push_back(Held{scene.handle_of(index), at, r});
+        }
+        if (scene.edits.size() > 64) scene.clear_edits();
+    }
+    return c;
+}
+
+// The same churn on a plain vector, erasing in place, with `owner` the
+// index of every shape as something else would keep it.
+static Churn churn_vector(std::vector<Shape>& shapes, int ops, std::mt19937& rng) {
+    Churn c;
+    std::vector<int> owner(shapes.size());
+    for (size_t i = 0; i < owner.size(); i++) owner[i] = (int)i;
+    std::uniform_real_distribution<double> unit(0, 1);
+    double extent = 2 * shapes[0].center.x;
+    for (int op = 0; op < ops; op++) {
+        if (rng() % 2 == 0 && shapes.size() > 1) {
+            int index = 1 + (int)(rng() % (shapes.size() - 1));
+            auto start = std::chrono::steady_clock::now();
+            shapes.erase(shapes.begin() + index);
+            owner.pop_back();
+            for (int& o : owner) {
+                if (o > index) o--;
+            }
+            c.erase_time += std::chrono::steady_clock::now() - start;
+            c.erases++;
+        } else {
+            double r = 2 + 4 * unit(rng);
+            Point2D at(extent * unit(rng), extent * unit(rng));
+            auto start = std::chrono::steady_clock::now();
+            shapes.push_back(Shape(SHAPE_CIRCLE, at, r));
+            owner.push_back((int)shapes.size() - 1);
+            c.add_time += std::chrono::steady_clock::now() - start;
+            c.adds++;
+        }
+    }
+    return c;
+}
+
+// what's wrong with the churned scene, 0 when nothing
+static int check(Scene& scene, const std::vector<Held>& held, const std::vector<ShapeHandle>& erased) {
+    int wrong = 0;
+    for (const Held& h : held) {
+        int i = scene.index_of(h.handle);
+        wrong += i < 0 || scene.shapes[i].center.x != h.center.x || scene.shapes[i].center.y != h.center.y ||
+                 scene.shapes[i].size1 != h.radius;
+    }
+    for (ShapeHandle h : erased) wrong += scene.index_of(h) >= 0;
+    
+    // the grid and the stores against ones built from the same shapes
+    Scene fresh;
+    fresh.shapes = scene.shapes;
+    fresh.rebuild();
+    wrong += fresh.lights() != scene.lights();
+    Point2D light = scene.shapes[scene.lights()[0]].center;
+    std::vector<RayHit> a, b;
+    scene.tracer.cast_fan(light, FAN_RAYS, a);
+    fresh.tracer.cast_fan(light, FAN_RAYS, b);
+    for (int i = 0; i < FAN_RAYS; i++) wrong += a[i].shape != b[i].shape || a[i].t != b[i].t;
+    return wrong;
+}
+
+int main(int argc, char** argv) {
+    int ops = argc > 1 ? std::max(100, std::atoi(argv[1])) : 20000;
+    bool failed = false;
+    std::printf("%10s %8s %12s %12s %8s %14s %14s %8s\n", "circles", "ops", "erase us", "add us", "vec ops",
+                "vec erase us", "vec add us", "wrong");
+    for (int count : {10000, 100000, 1000000}) {
+        Scene scene;
+        make_scene(scene, count, 11);
+        
+        // the plain vector gets fewer ops on big scenes, every erase moves half of it
+        std::vector<Shape> shapes = scene.shapes;
+        std::mt19937 vector_rng(5);
+        int vector_ops = std::min(ops, 200000000 / count);
+        Churn old = churn_vector(shapes, vector_ops, vector_rng);
+        
+        // the scene starts out holding a handle to every circle
+        std::vector<Held> held;
+        std::vector<ShapeHandle> erased;
+        for (int i = 0; i < (int)scene.shapes.size(); i++) {
+            if (!scene.shapes[i].is_light) {
+                held.push_back(Held{scene.handle_of(i), scene.shapes[i].center, scene.shapes[i].size1});
+            }
+        }
+        std::mt19937 rng(5);
+        Churn c = churn_scene(scene, ops, held, erased, rng);
+        int wrong = check(scene, held, erased);
+        std::printf("%10d %8d %12.3f %12.3f %8d %14.3f %14.3f %8d\n", count, c.erases + c.adds,
+                    c.erase_time.count() / std::max(c.erases, 1), c.add_time.count() / std::max(c.adds, 1),
+                    old.erases + old.adds, old.erase_time.count() / std::max(old.erases, 1),
+                    old.add_time.count() / std::max(old.adds, 1), wrong);
+        failed = failed || wrong != 0;
+    }
+    if (failed) {
+        std::printf("FAILED: a handle lost its shape, or the churned scene differs from a rebuilt one\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+// Checks the batch ray-circle kernels against Shape::intersects_ray and then
+// times each one. Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 bench/circle_kernel_bench.cpp core/circle_store.cpp core/spatial_grid.cpp -o circle_kernel_bench
+//
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../core/circle_store.h"
+#include "../core/geometry.h"
+#include "../core/spatial_grid.h"
+
+static std::vector<Shape> make_scene(int count, double side, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> pos(0, side);
+    std::uniform_real_distribution<double> radius(5, 60);
+    std::vector<Shape> shapes;
+    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(side / 2, side / 2), 30, 0, true));
+    for (int i = 0; i < count; i++) {
+        shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(pos(rng), pos(rng)), radius(rng)));
+    }
+    return shapes;
+}
+
+// the reference: the loop Render() used, one circle at a time
+static bool scalar_reference(const std::vector<Shape>& shapes, Point2D from, Point2D dir,
+                             double max_t, double& t, int& hit_index) {
+    double min_t = max_t;
+    bool hit = false;
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (shapes[i].is_light) continue;
+        double ht;
+        if (shapes[i].intersects_ray(from, dir, ht) && ht < min_t) {
+            min_t = ht;
+            hit_index = i;
+            hit = true;
+        }
+    }
+    if (hit) t = min_t;
+    return hit;
+}
+
+static bool check_level(SimdLevel level) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> angle(0, 2 * 3.14159265359);
+    std::uniform_real_distribution<double> pos(0, 800);
+    int checked = 0, failed = 0;
+    
+    for (int scene = 0; scene < 40; scene++) {
+        // odd sizes so every kernel also runs its scalar tail
+        std::vector<Shape> shapes = make_scene(1 + scene * 7, 800, 100 + scene);
+        CircleStore store(shapes);
+        store.rebuild();
+        
+        // a few erases so the store is no longer in shape order
+        for (int e = 0; e < 3 && shapes.size() > 3; e++) {
+            int i = 1 + (scene + e * 13) % ((int)shapes.size() - 1);
+            shapes[i] = shapes.back();
+            shapes.pop_back();
+            store.erase(i);
+        }
+        
+        for (int k = 0; k < 500; k++) {
+            // origins anywhere, including inside circles
+            Point2D from(pos(rng), pos(rng));
+            double a = angle(rng);
+            Point2D dir(std::cos(a), std::sin(a));
+            double rt = 0, kt = 0;
+            int ri = -1, ki = -1;
+            bool rh = scalar_reference(shapes, from, dir, 10000, rt, ri);
+            bool kh = store.nearest_hit(level, from, dir, 10000, kt, ki);
+            checked++;
+            if (rh != kh || (rh && (std::fabs(rt - kt) > 1e-6 * std::max(1.0, rt) || ri != ki))) {
+                if (failed++ < 5) {
+                    std::printf("  mismatch: ref hit=%d t=%.9f i=%d, %s hit=%d t=%.9f i=%d\n",
+                                rh, rt, ri, simd_level_name(level), kh, kt, ki);
+                }
+            }
+        }
+    }
+    std::printf("check %-6s %d rays, %d mismatches\n", simd_level_name(level), checked, failed);
+    return failed == 0;
+}
+
+int main() {
+    SimdLevel best = detect_simd_level();
+    std::printf("detected: %s\n", simd_level_name(best));
+    
+    std::vector<SimdLevel> levels;
+    for (int l = SIMD_SCALAR; l <= best; l++) levels.push_back((SimdLevel)l);
+    
+    bool ok = true;
+    for (SimdLevel level : levels) ok = check_level(level) && ok;
+    if (!ok) return 1;
+    
+    std::printf("\n%8s", "circles");
+    for (SimdLevel level : levels) std::printf(" %12s", simd_level_name(level));
+    std::printf(" %12s %12s   (Mrays/s)\n", "reference", "grid");
+    
+    const int counts[] = {16, 64, 256, 1024, 16384};
+    for (int count : counts) {
+        std::vector<Shape> shapes = make_scene(count, 800, 7);
+        CircleStore store(shapes);
+        store.rebuild();
+        SpatialGrid grid(shapes);
+        grid.rebuild();
+        Point2D light = shapes[0].center;
+        
+        std::vector<Point2D> dirs;
+        for (int i = 0; i < 360; i++) {
+            double a = i * 3.14159265359 / 180.0;
+            dirs.push_back(Point2D(std::cos(a), std::sin(a)));
+        }
+        int frames = std::max(4, 2000000 / (count * 360));
+        volatile double sink = 0;
+        
+        auto rate = [&](auto&& cast) {
+            auto start = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; f++) {
+                for (auto& dir : dirs) {
+                    double t = 0; int idx;
+                    if (cast(dir, t, idx)) sink = sink + t;
+                }
+            }
+            std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+            return frames * dirs.size() / took.count() / 1e6;
+        };
+        
+        std::printf("%8d", count);
+        for (SimdLevel level : levels) {
+            std::printf(" %12.2f", rate([&](Point2D dir, double& t, int& idx) {
+                return store.nearest_hit(level, light, dir, 10000, t, idx);
+            }));
+        }
+        std::printf(" %12.2f", rate([&](Point2D dir, double& t, int& idx) {
+            return scalar_reference(shapes, light, dir, 10000, t, idx);
+        }));
+        std::printf(" %12.2f\n", rate([&](Point2D dir, double& t, int& idx) {
+            return grid.first_hit(light, dir, 10000, t, idx);
+        }));
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+// Replays a recorded mouse drag over 100k circles, the same shape drag,
+// resize and light drag the editor does on WM_MOUSEMOVE, once through the
+// grid-backed Scene calls and once with the old full scans. Reports the
+// per-event latency of both and checks they end up moving the same way.
+// Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/drag_bench.cpp core/*.cpp -o drag_bench
+//   ./drag_bench [circles]
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../core/scene.h"
+
+typedef std::chrono::duration<double, std::micro> Micros;
+
+// one circle per cell of a jittered grid, so nothing overlaps at the start
+static void make_scene(Scene& scene, int count, unsigned seed) {
+    int columns = (int)std::ceil(std::sqrt((double)count));
+    double cell = 60;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    Point2D light(columns * cell / 2 + cell / 2, columns * cell / 2);
+    scene.shapes.push_back(Shape(SHAPE_CIRCLE, light, 30, 0, true));
+    for (int i = 0; (int)scene.shapes.size() <= count; i++) {
+        double r = 8 + 14 * unit(rng);
+        Point2D c((i % columns + 0.5) * cell + (unit(rng) - 0.5) * (cell - 2 * r),
+                  (i / columns + 0.5) * cell + (unit(rng) - 0.5) * (cell - 2 * r));
+        double dx = c.x - light.x, dy = c.y - light.y;
+        if (dx * dx + dy * dy < (r + 40) * (r + 40)) continue;
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, c, r));
+    }
+    scene.rebuild();
+}
+
+// the WM_MOUSEMOVE loops as they were, a sqrt per shape on every event
+static bool old_try_resize(std::vector<Shape>& shapes, int selected, double new_size) {
+    Shape& shape = shapes[selected];
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (i == selected) continue;
+        double dx = shape.center.x - shapes[i].center.x, dy = shape.center.y - shapes[i].center.y;
+        if (std::sqrt(dx * dx + dy * dy) < new_size + shapes[i].size1) return false;
+    }
+    shape.size1 = new_size;
+    return true;
+}
+
+static bool old_try_move(std::vector<Shape>& shapes, int selected, Point2D new_pos) {
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (i == selected) continue;
+        double dx = new_pos.x - shapes[i].center.x, dy = new_pos.y - shapes[i].center.y;
+        double size_current = shapes[selected].bounding_radius();
+        double size_other = shapes[i].is_light ? shapes[i].size1 : shapes[i].bounding_radius();
+        if (std::sqrt(dx * dx + dy * dy) < size_current + size_other) return false;
+    }
+    shapes[selected].center = new_pos;
+    return true;
+}
+
+static void old_move_light(std::vector<Shape>& shapes, Point2D new_pos) {
+    double lr = 30;
+    for (auto& s : shapes) if (s.is_light) { lr = s.size1; break; }
+    for (auto& s : shapes) {
+        if (s.is_light) continue;
+        double dx = new_pos.x - s.center.x, dy = new_pos.y - s.center.y;
+        double min_dist = lr + s.bounding_radius();
+        if (std::sqrt(dx * dx + dy * dy) < min_dist) {
+            double angle = std::atan2(dy, dx);
+            new_pos.x = s.center.x + std::cos(angle) * min_dist;
+            new_pos.y = s.center.y + std::sin(angle) * min_dist;
+        }
+    }
+    for (auto& s : shapes) if (s.is_light) { s.center = new_pos; break; }
+}
+
+enum DragKind { DRAG_SHAPE, RESIZE_SHAPE, DRAG_LIGHT };
+
+struct MouseEvent {
+    DragKind kind;
+    Point2D pos;
+};
+
+struct Latency {
+    std::vector<double> us;
+    
+    void report(const char* label) {
+        std::sort(us.begin(), us.end());
+        double sum = 0;
+        for (double v : us) sum += v;
+        std::printf("  %-6s avg %9.3f us   p99 %9.3f us   max %9.3f us\n", label, sum / us.size(),
+                    us[(size_t)(us.size() * 0.99)], us.back());
+    }
+};
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    if (count < 10) count = 10;
+    
+    Scene scene;
+    make_scene(scene, count, 21);
+    std::vector<Shape> reference = scene.shapes;
+    
+    // the circle closest to the light gets dragged and resized around it
+    Point2D light = scene.shapes[0].center;
+    int selected = 1;
+    for (int i = 1; i < (int)scene.shapes.size(); i++) {
+        double a = std::hypot(scene.shapes[i].center.x - light.x, scene.shapes[i].center.y - light.y);
+        double b = std::hypot(scene.shapes[selected].center.x - light.x, scene.shapes[selected].center.y - light.y);
+        if (a < b) selected = i;
+    }
+    
+    // the recording: a wobbly loop for the drag, in and out for the resize, a spiral for the light
+    std::vector<MouseEvent> events;
+    Point2D start = scene.shapes[selected].center;
+    for (int i = 0; i < 5000; i++) {
+        double a = i * 0.01;
+        events.push_back({DRAG_SHAPE, Point2D(start.x + 150 * std::sin(a) + 3 * std::sin(a * 17),
+                                              start.y + 150 * (1 - std::cos(a)))});
+    }
+    for (int i = 0; i < 2000; i++) {
+        events.push_back({RESIZE_SHAPE, Point2D(20 + 60 * (0.5 - 0.5 * std::cos(i * 0.02)), 0)});
+    }
+    for (int i = 0; i < 5000; i++) {
+        double a = i * 0.02, r = 5 + i * 0.08;
+        events.push_back({DRAG_LIGHT, Point2D(light.x + r * std::cos(a), light.y + r * std::sin(a))});
+    }
+    
+    const char* names[] = {"shape drag", "resize", "light drag"};
+    bool ok = true;
+    std::printf("%d circles, %d recorded mouse events\n", count, (int)events.size());
+    for (int kind = DRAG_SHAPE; kind <= DRAG_LIGHT; kind++) {
+        Latency grid_latency, scan_latency;
+        int accepted = 0, mismatches = 0;
+        for (auto& e : events) {
+            if (e.kind != kind) continue;
+            
+            auto t0 = std::chrono::steady_clock::now();
+            bool moved = true;
+            if (kind == DRAG_SHAPE) moved = scene.try_move_shape(selected, e.pos);
+            else if (kind == RESIZE_SHAPE) moved = scene.try_resize_shape(selected, e.pos.x);
+            else scene.move_light(0, e.pos);
+            auto t1 = std::chrono::steady_clock::now();
+            bool old_moved = true;
+            if (kind == DRAG_SHAPE) old_moved = old_try_move(reference, selected, e.pos);
+            else if (kind == RESIZE_SHAPE) old_moved = old_try_resize(reference, selected, e.pos.x);
+            else old_move_light(reference, e.pos);
+            auto t2 = std::chrono::steady_clock::now();
+            
+            grid_latency.us.push_back(Micros(t1 - t0).count());
+            scan_latency.us.push_back(Micros(t2 - t1).count());
+            accepted += moved;
+            const Shape& a = scene.shapes[kind == DRAG_LIGHT ? 0 : selected];
+            const Shape& b = reference[kind == DRAG_LIGHT ? 0 : selected];
+            if (moved != old_moved || std::fabs(a.center.x - b.center.x) > 1e-9 ||
+                std::fabs(a.center.y - b.center.y) > 1e-9 || a.size1 != b.size1) {
+                mismatches++;
+                // carry on from the same state so one borderline event doesn't cascade
+                scene.shapes[kind == DRAG_LIGHT ? 0 : selected] = b;
+                if (kind != DRAG_LIGHT) scene.shape_changed(selected);
+            }
+        }
+        std::printf("\n%s: %d events, %d moved, %d mismatches\n", names[kind], (int)grid_latency.us.size(),
+                    accepted, mismatches);
+        grid_latency.report("grid");
+        scan_latency.report("scan");
+        ok = ok && mismatches == 0;
+    }
+    return ok ? 0 : 1;
+}
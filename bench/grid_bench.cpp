@@ -0,0 +1,129 @@
+// Headless comparison of the uniform grid against the brute-force ray loop
+// from Render(). Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 bench/grid_bench.cpp core/spatial_grid.cpp -o grid_bench
+//
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../core/geometry.h"
+#include "../core/spatial_grid.h"
+
+// random circles around a light in the middle, density similar to the editor
+static std::vector<Shape> make_scene(int count, Point2D& light, unsigned seed) {
+    std::mt19937 rng(seed);
+    double side = std::sqrt((double)count) * 60 + 200;
+    std::uniform_real_distribution<double> pos(0, side);
+    std::uniform_real_distribution<double> radius(5, 20);
+    
+    light = Point2D(side / 2, side / 2);
+    std::vector<Shape> shapes;
+    shapes.push_back(Shape(SHAPE_CIRCLE, light, 30, 0, true));
+    while ((int)shapes.size() < count + 1) {
+        Shape s(SHAPE_CIRCLE, Point2D(pos(rng), pos(rng)), radius(rng));
+        double dx = s.center.x - light.x, dy = s.center.y - light.y;
+        if (dx * dx + dy * dy < (s.size1 + 30) * (s.size1 + 30)) continue;
+        shapes.push_back(s);
+    }
+    return shapes;
+}
+
+// the original loop from Render(): every ray against every shape
+static bool brute_first_hit(const std::vector<Shape>& shapes, Point2D from, Point2D dir,
+                            double max_t, double& t, int& hit_index) {
+    double min_t = max_t;
+    bool hit = false;
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (shapes[i].is_light) continue;
+        double ht;
+        if (shapes[i].intersects_ray(from, dir, ht) && ht < min_t) {
+            min_t = ht;
+            hit_index = i;
+            hit = true;
+        }
+    }
+    if (hit) t = min_t;
+    return hit;
+}
+
+template <typename F>
+static double time_frames(int frames, F&& frame) {
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) frame();
+    std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+    return took.count() / frames;
+}
+
+int main() {
+    const int counts[] = {10, 1000, 100000};
+    std::printf("%10s %14s %14s %10s %12s %s\n", "circles", "brute ms/frm", "grid ms/frm", "speedup", "update us", "match");
+    
+    for (int count : counts) {
+        Point2D light;
+        std::vector<Shape> shapes = make_scene(count, light, 1234);
+        SpatialGrid grid(shapes);
+        grid.rebuild();
+        
+        std::vector<Point2D> dirs;
+        for (int i = 0; i < 360; i++) {
+            double angle = i * 3.14159265359 / 180.0;
+            dirs.push_back(Point2D(std::cos(angle), std::sin(angle)));
+        }
+        
+        // both paths have to agree before the timings mean anything
+        auto agrees = [&] {
+            for (auto& dir : dirs) {
+                double bt = 0, gt = 0;
+                int bi = -1, gi = -1;
+                bool bh = brute_first_hit(shapes, light, dir, 10000, bt, bi);
+                bool gh = grid.first_hit(light, dir, 10000, gt, gi);
+                if (bh != gh || (bh && std::fabs(bt - gt) > 1e-9)) return false;
+            }
+            return true;
+        };
+        bool match = agrees();
+        
+        int frames = count >= 100000 ? 5 : 200;
+        volatile double sink = 0;
+        double brute_ms = time_frames(frames, [&] {
+            for (auto& dir : dirs) {
+                double t = 0; int idx;
+                if (brute_first_hit(shapes, light, dir, 10000, t, idx)) sink = sink + t;
+            }
+        });
+        double grid_ms = time_frames(frames, [&] {
+            for (auto& dir : dirs) {
+                double t = 0; int idx;
+                if (grid.first_hit(light, dir, 10000, t, idx)) sink = sink + t;
+            }
+        });
+        
+        // cost of keeping the grid in sync during a drag
+        int moves = 10000;
+        auto start = std::chrono::steady_clock::now();
+        for (int m = 0; m < moves; m++) {
+            int i = 1 + m % count;
+            shapes[i].center.x += (m & 1) ? 3 : -3;
+            grid.update(i);
+        }
+        std::chrono::duration<double, std::micro> update_took = std::chrono::steady_clock::now() - start;
+        
+        // the same edits the editor makes: erase a few, add a few, then check again
+        for (int e = 0; e < 5 && shapes.size() > 2; e++) {
+            int i = 1 + (e * 7919) % ((int)shapes.size() - 1);
+            shapes[i] = shapes.back();
+            shapes.pop_back();
+            grid.erase(i);
+            shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(light.x + 80 + e * 40, light.y), 15));
+            grid.insert((int)shapes.size() - 1);
+        }
+        match = match && agrees();
+        
+        std::printf("%10d %14.3f %14.3f %9.1fx %12.3f %s\n", count, brute_ms, grid_ms,
+                    brute_ms / grid_ms, update_took.count() / moves, match ? "yes" : "NO");
+        if (!match) return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,236 @@
+// Checks the float and 16.16 fixed-point circle kernels against the double
+// one on an 800x600 canvas and past the 16.16 range, then times every precision at every SIMD level.
+// Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/precision_bench.cpp core/*.cpp -o precision_bench
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../core/tracer.h"
+
+const double CANVAS_W = 800, CANVAS_H = 600;
+
+// a ray end point further than this from the double one fails the check
+const double MAX_DRIFT = 1;
+
+// ...unless the double ray passes this close to the edge of a circle either
+// one hit, where a rounding step decides between grazing it and missing it
+const double GRAZE = 0.01;
+
+static std::vector<Shape> make_scene(int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> x(0, CANVAS_W), y(0, CANVAS_H);
+    std::uniform_real_distribution<double> radius(5, count > 100 ? 15 : 70);
+    std::vector<Shape> shapes;
+    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(CANVAS_W / 2, CANVAS_H / 2), 30, 0, true));
+    for (int i = 0; i < count; i++) shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(x(rng), y(rng)), radius(rng)));
+    return shapes;
+}
+
+static bool grazes(const Shape& s, Point2D from, Point2D dir) {
+    double mx = from.x - s.center.x, my = from.y - s.center.y;
+    return std::fabs(std::fabs(mx * dir.y - my * dir.x) - s.size1) < GRAZE;
+}
+
+struct Drift {
+    double worst = 0, sum = 0;
+    long long rays = 0, grazing = 0, failed = 0;
+};
+
+// one ray through both stores, its end point a miss length out when nothing is hit
+template <typename Scalar>
+static void compare(const std::vector<Shape>& shapes, const CircleStore& reference,
+                    const BasicCircleStore<Scalar>& store, SimdLevel level, Point2D from, Point2D dir, Drift& drift) {
+    double rt = RAY_MISS_LENGTH, st = RAY_MISS_LENGTH;
+    int ri = -1, si = -1;
+    reference.nearest_hit(SIMD_SCALAR, from, dir, RAY_MAX_T, rt, ri);
+    store.nearest_hit(level, from, dir, RAY_MAX_T, st, si);
+    double d = std::fabs(rt - st);
+    drift.rays++;
+    if (d > MAX_DRIFT) {
+        if ((ri >= 0 && grazes(shapes[ri], from, dir)) || (si >= 0 && grazes(shapes[si], from, dir))) {
+            drift.grazing++;
+            return;
+        }
+        if (drift.failed++ < 5) {
+            std::printf("  drift %.4f: double t=%.6f i=%d, %s t=%.6f i=%d\n", d, rt, ri,
+                        ScalarTraits<Scalar>::name(), st, si);
+        }
+    }
+    drift.worst = std::max(drift.worst, d);
+    drift.sum += d;
+}
+
+template <typename Scalar>
+static bool check_precision(SimdLevel level) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> angle(0, 2 * 3.14159265359);
+    std::uniform_real_distribution<double> x(0, CANVAS_W), y(0, CANVAS_H);
+    Drift drift;
+    
+    for (int scene = 0; scene < 30; scene++) {
+        // odd sizes so the vector kernels also run their scalar tail
+        std::vector<Shape> shapes = make_scene(1 + scene * 13, 300 + scene);
+        CircleStore reference(shapes);
+        BasicCircleStore<Scalar> store(shapes);
+        reference.rebuild();
+        store.rebuild();
+        
+        // the editor's fan from the light, and rays from anywhere, inside circles too
+        for (int i = 0; i < 3600; i++) {
+            double a = i * 2 * 3.14159265359 / 3600;
+            compare(shapes, reference, store, level, shapes[0].center, Point2D(std::cos(a), std::sin(a)), drift);
+        }
+        for (int k = 0; k < 2000; k++) {
+            double a = angle(rng);
+            compare(shapes, reference, store, level, Point2D(x(rng), y(rng)), Point2D(std::cos(a), std::sin(a)), drift);
+        }
+    }
+    std::printf("%-8s %-6s %10lld %12.6f %12.6f %8lld %s\n", ScalarTraits<Scalar>::name(), simd_level_name(level),
+                drift.rays, drift.worst, drift.sum / drift.rays, drift.grazing, drift.failed ? "NO" : "yes");
+    return drift.failed == 0;
+}
+
+// the whole tracer on an editor-sized scene, every ray's end point against the double tracer
+template <typename Scalar>
+static bool check_tracer() {
+    std::vector<Shape> shapes = make_scene(GRID_MIN_SHAPES - 2, 77);
+    SpatialGrid grid(shapes);
+    CircleStore reference(shapes);
+    BasicCircleStore<Scalar> circles(shapes);
+    PrimitiveStore primitives(shapes);
+    grid.rebuild();
+    reference.rebuild();
+    circles.rebuild();
+    primitives.rebuild();
+    RayTracer exact(grid, reference, primitives);
+    BasicRayTracer<Scalar> tracer(grid, circles, primitives);
+    
+    std::vector<RayHit> want, got;
+    exact.cast_fan(shapes[0].center, 36000, want);
+    tracer.cast_fan(shapes[0].center, 36000, got);
+    double worst = 0;
+    long long grazing = 0, failed = 0;
+    for (size_t i = 0; i < want.size(); i++) {
+        double d = std::hypot(want[i].end.x - got[i].end.x, want[i].end.y - got[i].end.y);
+        if (d <= MAX_DRIFT) { worst = std::max(worst, d); continue; }
+        bool edge = (want[i].shape >= 0 && grazes(shapes[want[i].shape], shapes[0].center, want[i].dir)) ||
+                    (got[i].shape >= 0 && grazes(shapes[got[i].shape], shapes[0].center, got[i].dir));
+        if (edge) grazing++;
+        else failed++;
+    }
+    std::printf("%-8s %-6s %10zu %12.6f %12s %8lld %s\n", ScalarTraits<Scalar>::name(), "fan", want.size(), worst, "",
+                grazing, failed ? "NO" : "yes");
+    return failed == 0;
+}
+
+// a reach and circles past what the type holds: 16.16 used to wrap them, a
+// 40000 reach went negative and missed everything, a circle at x=65936 came
+// back at x=400. Now a ray has to agree with double or, where double's hit
+// is out of the type's range, miss.
+template <typename Scalar>
+static bool check_range() {
+    const double reach = 50000;
+    double range = ScalarTraits<Scalar>::range();
+    std::vector<Shape> shapes = make_scene(40, 91);
+    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(65536 + CANVAS_W / 2, CANVAS_H / 2), 50));
+    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(40000, CANVAS_H / 2), 2000));
+    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(CANVAS_W / 2, -range - 500), 400));
+    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(-range + 600, CANVAS_H / 2), 100));
+    CircleStore reference(shapes);
+    BasicCircleStore<Scalar> store(shapes);
+    reference.rebuild();
+    store.rebuild();
+    
+    auto outside = [&](Point2D p) { return !(std::fabs(p.x) <= range && std::fabs(p.y) <= range); };
+    const Point2D origins[] = {shapes[0].center, Point2D(-range - 100, CANVAS_H / 2), Point2D(20, 20)};
+    long long rays = 0, cut = 0, failed = 0;
+    for (const Point2D& from : origins) {
+        for (int i = 0; i < 3600; i++) {
+            double a = i * 2 * 3.14159265359 / 3600;
+            Point2D dir(std::cos(a), std::sin(a));
+            double rt = reach, st = reach;
+            int ri = -1, si = -1;
+            reference.nearest_hit(SIMD_SCALAR, from, dir, reach, rt, ri);
+            store.nearest_hit(SIMD_SCALAR, from, dir, reach, st, si);
+            rays++;
+            if (si == ri && std::fabs(rt - st) <= MAX_DRIFT) continue;
+            if ((ri >= 0 && grazes(shapes[ri], from, dir)) || (si >= 0 && grazes(shapes[si], from, dir))) continue;
+            // a hit further on is fine when the one it missed is out of range
+            const Shape* skipped = ri >= 0 ? &shapes[ri] : nullptr;
+            if (st >= rt && skipped && (outside(from) || outside(skipped->center) || skipped->size1 > range)) {
+                cut++;
+                continue;
+            }
+            if (failed++ < 5) {
+                std::printf("  out of range: double t=%.4f i=%d, %s t=%.4f i=%d\n", rt, ri,
+                            ScalarTraits<Scalar>::name(), st, si);
+            }
+        }
+    }
+    std::printf("%-8s %-6s %10lld %12s %12s %8s %s (%lld past the range)\n", ScalarTraits<Scalar>::name(), "range",
+                rays, "", "", "", failed ? "NO" : "yes", cut);
+    return failed == 0;
+}
+
+template <typename Scalar>
+static double rate(const std::vector<Shape>& shapes, SimdLevel level, const std::vector<Point2D>& dirs, int frames) {
+    BasicCircleStore<Scalar> store(shapes);
+    store.rebuild();
+    Point2D light = shapes[0].center;
+    volatile double sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; f < frames; f++) {
+        for (auto& dir : dirs) {
+            double t = 0; int idx;
+            if (store.nearest_hit(level, light, dir, RAY_MAX_T, t, idx)) sink = sink + t;
+        }
+    }
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    return frames * dirs.size() / took.count() / 1e6;
+}
+
+int main() {
+    SimdLevel best = detect_simd_level();
+    std::printf("detected: %s, end point drift in pixels against double\n\n", simd_level_name(best));
+    std::printf("%-8s %-6s %10s %12s %12s %8s %s\n", "scalar", "simd", "rays", "worst", "mean", "grazing", "ok");
+    
+    bool ok = true;
+    for (int l = SIMD_SCALAR; l <= best; l++) {
+        ok = check_precision<double>((SimdLevel)l) && ok;
+        ok = check_precision<float>((SimdLevel)l) && ok;
+    }
+    ok = check_precision<Fixed16>(SIMD_SCALAR) && ok;
+    ok = check_tracer<float>() && ok;
+    ok = check_tracer<Fixed16>() && ok;
+    ok = check_range<Fixed16>() && ok;
+    if (!ok) return 1;
+    
+    std::vector<Point2D> dirs;
+    for (int i = 0; i < 360; i++) {
+        double a = i * 3.14159265359 / 180.0;
+        dirs.push_back(Point2D(std::cos(a), std::sin(a)));
+    }
+    std::printf("\n%8s", "circles");
+    for (int l = SIMD_SCALAR; l <= best; l++) {
+        std::printf(" %9s-d %9s-f", simd_level_name((SimdLevel)l), simd_level_name((SimdLevel)l));
+    }
+    std::printf(" %11s   (Mrays/s)\n", "fixed16");
+    
+    const int counts[] = {16, 64, 256, 1024, 16384};
+    for (int count : counts) {
+        std::vector<Shape> shapes = make_scene(count, 7);
+        int frames = std::max(4, 2000000 / (count * 360));
+        std::printf("%8d", count);
+        for (int l = SIMD_SCALAR; l <= best; l++) {
+            std::printf(" %11.2f", rate<double>(shapes, (SimdLevel)l, dirs, frames));
+            std::printf(" %11.2f", rate<float>(shapes, (SimdLevel)l, dirs, frames));
+        }
+        std::printf(" %11.2f\n", rate<Fixed16>(shapes, SIMD_SCALAR, dirs, frames));
+    }
+    return 0;
+}
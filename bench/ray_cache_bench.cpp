@@ -0,0 +1,136 @@
+// Edits a scene the way the editor does, dragging, resizing, adding and
+// erasing circles and now and then moving the light, and keeps the ray fan
+// up to date through RayCache. Reports the fraction of rays each kind of
+// edit had to cast again and the time against casting the whole fan, and
+// checks every cached fan against a fresh one. Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/ray_cache_bench.cpp core/*.cpp -o ray_cache_bench
+//   ./ray_cache_bench [circles]
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../core/ray_cache.h"
+
+typedef std::chrono::duration<double, std::micro> Micros;
+
+// one circle per cell of a jittered grid, so nothing overlaps at the start
+static void make_scene(Scene& scene, int count, unsigned seed) {
+    int columns = (int)std::ceil(std::sqrt((double)count));
+    double cell = 60;
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    Point2D light(columns * cell / 2 + cell / 2, columns * cell / 2);
+    scene.shapes.push_back(Shape(SHAPE_CIRCLE, light, 30, 0, true));
+    for (int i = 0; (int)scene.shapes.size() <= count; i++) {
+        double r = 6 + 10 * unit(rng);
+        Point2D c((i % columns + 0.5) * cell + (unit(rng) - 0.5) * (cell - 2 * r),
+                  (i / columns + 0.5) * cell + (unit(rng) - 0.5) * (cell - 2 * r));
+        double dx = c.x - light.x, dy = c.y - light.y;
+        if (dx * dx + dy * dy < (r + 40) * (r + 40)) continue;
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, c, r));
+    }
+    scene.rebuild();
+}
+
+enum EditKind { EDIT_DRAG, EDIT_RESIZE, EDIT_ADD, EDIT_ERASE, EDIT_LIGHT, EDIT_KINDS };
+
+struct Stats {
+    int edits = 0, mismatches = 0;
+    double recast = 0;  // fraction of the fan, summed over the edits
+    Micros cached{0}, full{0};
+};
+
+// a circle the light can probably see, so the edit matters
+static int circle_near_light(const Scene& scene, std::mt19937& rng) {
+    Point2D light = scene.shapes[0].center;
+    int best = -1;
+    double best_d = 0;
+    for (int tries = 0; tries < 4000; tries++) {
+        int i = 1 + (int)(rng() % (scene.shapes.size() - 1));
+        double d = std::hypot(scene.shapes[i].center.x - light.x, scene.shapes[i].center.y - light.y);
+        if (best < 0 || d < best_d) {
+            best = i;
+            best_d = d;
+        }
+        if (d < 250) break;
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::max(10, std::atoi(argv[1])) : 10000;
+    const char* names[] = {"drag", "resize", "add", "erase", "light"};
+    const int ray_counts[] = {360, 3600};
+    bool ok = true;
+    
+    for (int rays : ray_counts) {
+        Scene scene;
+        make_scene(scene, count, 9);
+        RayCache cache;
+        std::vector<RayHit> fresh;
+        std::mt19937 rng(17);
+        std::uniform_real_distribution<double> nudge(-4, 4), unit(0, 1);
+        cache.update(scene, scene.shapes[0].center, rays);
+        scene.clear_edits();
+        
+        Stats stats[EDIT_KINDS];
+        for (int e = 0; e < 2000; e++) {
+            // mostly drags, like a user moving things around
+            int roll = (int)(rng() % 100);
+            EditKind kind = roll < 60 ? EDIT_DRAG : roll < 80 ? EDIT_RESIZE : roll < 88 ? EDIT_ADD
+                          : roll < 96 ? EDIT_ERASE : EDIT_LIGHT;
+            if (scene.shapes.size() < 6) kind = EDIT_ADD;  // small scenes can run out of circles
+            Point2D light = scene.shapes[0].center;
+            int i = scene.shapes.size() > 1 ? circle_near_light(scene, rng) : -1;
+            if (kind == EDIT_DRAG) {
+                scene.try_move_shape(i, Point2D(scene.shapes[i].center.x + nudge(rng), scene.shapes[i].center.y + nudge(rng)));
+            } else if (kind == EDIT_RESIZE) {
+                scene.try_resize_shape(i, std::max(4.0, scene.shapes[i].size1 + nudge(rng)));
+            } else if (kind == EDIT_ADD) {
+                Point2D at(light.x + (unit(rng) - 0.5) * 600, light.y + (unit(rng) - 0.5) * 600);
+                if (!scene.overlaps_any_shape(at, 8)) scene.add_shape(Shape(SHAPE_CIRCLE, at, 8));
+            } else if (kind == EDIT_ERASE) {
+                scene.erase_shape(i);
+            } else {
+                scene.move_light(0, Point2D(light.x + nudge(rng), light.y + nudge(rng)));
+            }
+            
+            auto t0 = std::chrono::steady_clock::now();
+            int cast = cache.update(scene, scene.shapes[0].center, rays);
+            auto t1 = std::chrono::steady_clock::now();
+            scene.clear_edits();
+            scene.tracer.cast_fan(scene.shapes[0].center, rays, fresh);
+            auto t2 = std::chrono::steady_clock::now();
+            
+            Stats& s = stats[kind];
+            s.edits++;
+            s.recast += (double)cast / rays;
+            s.cached += t1 - t0;
+            s.full += t2 - t1;
+            for (int r = 0; r < rays; r++) {
+                const RayHit& a = cache.rays()[r];
+                if (a.shape != fresh[r].shape || a.t != fresh[r].t) {
+                    s.mismatches++;
+                    break;
+                }
+            }
+        }
+        
+        std::printf("%d circles, %d rays\n", (int)scene.shapes.size() - 1, rays);
+        std::printf("  %-7s %7s %12s %12s %12s %s\n", "edit", "count", "rays recast", "cached us", "full us", "mismatches");
+        for (int k = 0; k < EDIT_KINDS; k++) {
+            const Stats& s = stats[k];
+            if (s.edits == 0) continue;
+            std::printf("  %-7s %7d %11.2f%% %12.2f %12.2f %d\n", names[k], s.edits, 100 * s.recast / s.edits,
+                        s.cached.count() / s.edits, s.full.count() / s.edits, s.mismatches);
+            ok = ok && s.mismatches == 0;
+        }
+        std::printf("\n");
+    }
+    return ok ? 0 : 1;
+}
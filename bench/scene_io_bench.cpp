@@ -0,0 +1,144 @@
+// Times saving and loading a 1M-circle scene in both file variants and
+// checks that every circle, and the segments, rectangles and polygons after
+// them, read back exactly, and that broken circles are refused. Builds on
+// Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/scene_io_bench.cpp core/*.cpp -o scene_io_bench
+//   ./scene_io_bench [circles]
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "../core/scene_io.h"
+
+typedef std::chrono::duration<double, std::milli> Millis;
+
+static bool same_shapes(const std::vector<Shape>& a, const std::vector<Shape>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].center.x != b[i].center.x || a[i].center.y != b[i].center.y ||
+            a[i].size1 != b[i].size1 || a[i].is_light != b[i].is_light || a[i].color.r != b[i].color.r ||
+            a[i].color.g != b[i].color.g || a[i].color.b != b[i].color.b || a[i].intensity != b[i].intensity ||
+            a[i].material.reflectance != b[i].material.reflectance || a[i].material.ior != b[i].material.ior ||
+            a[i].material.absorption != b[i].material.absorption || a[i].type != b[i].type ||
+            a[i].size2 != b[i].size2 || a[i].angle != b[i].angle || a[i].vertices.size() != b[i].vertices.size()) {
+            return false;
+        }
+        for (size_t k = 0; k < a[i].vertices.size(); k++) {
+            if (a[i].vertices[k].x != b[i].vertices[k].x || a[i].vertices[k].y != b[i].vertices[k].y) return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    if (count < 1) count = 1;
+    
+    // overlaps don't matter here, only the numbers going through the files
+    Scene scene;
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<double> pos(0, 100000), radius(1, 20);
+    for (int i = 0; i < 3; i++) {
+        Shape light(SHAPE_CIRCLE, Point2D(pos(rng), pos(rng)), 30, 0, true);
+        light.color = LightColor(0.25f * (i + 1), 1 - 0.25f * i, 0.5f);
+        light.intensity = 0.5f + i;
+        scene.shapes.push_back(light);
+    }
+    for (int i = 0; i < count; i++) {
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(pos(rng), pos(rng)), radius(rng)));
+        if (i % 7 == 0) scene.shapes.back().material = Material(0.25f, 1.33f, 0.125f);
+    }
+    // binary files keep the other shapes after the circles, so they go last to keep the order
+    for (int i = 0; i < std::max(count / 100, 4); i++) {
+        Point2D c(pos(rng), pos(rng));
+        double r = radius(rng), angle = pos(rng) * 1e-4;
+        switch (i % 4) {
+            case 0: scene.shapes.push_back(Shape(SHAPE_SEGMENT, c, r)); scene.shapes.back().angle = angle; break;
+            case 1: scene.shapes.push_back(Shape(SHAPE_RECT, c, r, r / 3)); break;
+            case 2: scene.shapes.push_back(Shape(SHAPE_RECT, c, r, r / 3)); scene.shapes.back().angle = angle; break;
+            default: scene.shapes.push_back(make_regular_polygon(c, r, 3 + i % 6, angle));
+        }
+        if (i % 3 == 0) scene.shapes.back().material = Material(0.5f, 1.5f, 0.25f);
+    }
+    
+    const char* paths[] = {"scene_io_bench.bin", "scene_io_bench.txt"};
+    const SceneFormat formats[] = {SCENE_BINARY, SCENE_TEXT};
+    bool ok = true;
+    
+    std::printf("%d circles\n%8s %10s %12s %12s %12s %s\n", count, "format", "MB", "save ms", "load ms",
+                "of it index", "identical");
+    for (int f = 0; f < 2; f++) {
+        auto start = std::chrono::steady_clock::now();
+        bool saved = save_scene(paths[f], scene, formats[f]);
+        Millis save_time = std::chrono::steady_clock::now() - start;
+        if (!saved) {
+            std::printf("could not write %s\n", paths[f]);
+            return 1;
+        }
+        
+        // load_scene includes building the grid and the circle store, timed separately here
+        Scene loaded;
+        std::string error;
+        start = std::chrono::steady_clock::now();
+        bool read = load_scene(paths[f], loaded, error);
+        Millis load_time = std::chrono::steady_clock::now() - start;
+        if (!read) {
+            std::printf("%s\n", error.c_str());
+            return 1;
+        }
+        start = std::chrono::steady_clock::now();
+        loaded.rebuild();
+        Millis index_time = std::chrono::steady_clock::now() - start;
+        
+        FILE* file = std::fopen(paths[f], "rb");
+        std::fseek(file, 0, SEEK_END);
+        double mb = std::ftell(file) / (1024.0 * 1024.0);
+        std::fclose(file);
+        
+        bool identical = same_shapes(scene.shapes, loaded.shapes);
+        ok = ok && identical;
+        std::printf("%8s %10.1f %12.1f %12.1f %12.1f %s\n", formats[f] == SCENE_BINARY ? "binary" : "text", mb,
+                    save_time.count(), load_time.count(), index_time.count(), identical ? "yes" : "NO");
+    }
+    
+    // just mapping the binary file and summing it, no Shape objects at all
+    SceneFile mapped;
+    std::string error;
+    auto start = std::chrono::steady_clock::now();
+    if (!mapped.open(paths[0], error)) {
+        std::printf("%s\n", error.c_str());
+        return 1;
+    }
+    double sum = 0;
+    for (size_t i = 0; i < mapped.circle_count(); i++) sum += mapped.x()[i] + mapped.y()[i] + mapped.radius()[i];
+    Millis map_time = std::chrono::steady_clock::now() - start;
+    std::printf("\nmapped in place: %.1f ms for %zu circles (checksum %.0f)\n", map_time.count(),
+                mapped.circle_count(), sum);
+    mapped.close();
+    
+    // a zero, negative or NaN radius or a center off at infinity is refused by both variants
+    const double bad[][3] = {{10, 10, 0}, {10, 10, -5}, {10, 10, NAN}, {INFINITY, 10, 5}, {10, 10, INFINITY}};
+    int accepted = 0;
+    for (auto& b : bad) {
+        for (int light = 0; light < 2; light++) {
+            for (int f = 0; f < 2; f++) {
+                Scene broken;
+                broken.shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(b[0], b[1]), b[2], 0, light != 0));
+                Scene loaded;
+                std::string why;
+                if (save_scene(paths[f], broken, formats[f]) && load_scene(paths[f], loaded, why)) accepted++;
+            }
+        }
+    }
+    std::printf("bad circles and lights accepted: %d of %d\n", accepted, (int)(sizeof(bad) / sizeof(bad[0])) * 4);
+    ok = ok && accepted == 0;
+    
+    for (const char* path : paths) std::remove(path);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,402 @@
+// The regression suite: seeded scenes of four kinds (sparse, dense,
+// clustered, huge radius variance) at 10 to 1M circles, each timed for rays
+// per second, collision queries per second and a full headless frame. The
+// results can be written as JSON and checked against a stored baseline,
+// failing when anything got slower than the threshold allows. Builds on
+// Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/suite_bench.cpp core/*.cpp -o suite_bench
+//   ./suite_bench [--json out.json] [--baseline bench/baseline.json] [--threshold 0.25]
+//                 [--max-circles N] [--threads N] [--runs N]
+//
+// The scenes and the work done on them are the same on every run, so the
+// checksums only change when the hits do. Every number is the median of a
+// few samples of a fixed amount of work, big enough to take milliseconds
+// even on the 10 circle scenes, and the samples of the four measurements
+// take turns so a busy moment hits all of them alike. A fixed calibration
+// loop is timed between them: the baseline is compared after scaling by it,
+// so a machine that's slower all over doesn't read as a regression. Half the
+// spread of a measurement's middle samples is its noise, and a number only
+// fails once it's slower than the threshold plus its own and the
+// calibration's noise. On a noisy machine --runs 3 takes three times the
+// samples, which is also how the stored baseline was made.
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "../core/scene.h"
+#include "../core/scene_renderer.h"
+#include "../core/soft_raster.h"
+
+const int VIEW_W = 800, VIEW_H = 600;    // the frame is the editor's window onto the scene's top left
+const Point2D LIGHT(VIEW_W / 2, VIEW_H / 2);
+const double LIGHT_RADIUS = 30;
+const int FAN_RAYS = 3600;
+const int QUERIES = 20000;
+
+// the work in one sample, about 20 ms of it at the fastest scene on the VM the baseline comes from
+const int FANS_PER_SAMPLE = 100;
+const int QUERY_PASSES_PER_SAMPLE = 10;
+const int FRAMES_PER_SAMPLE = 16;
+const int CALIBRATIONS_PER_SAMPLE = 40;
+const int SAMPLES = 7;                   // per --runs
+
+enum SceneKind { SPARSE, DENSE, CLUSTERED, VARIANCE };
+const char* KIND_NAMES[] = {"sparse", "dense", "clustered", "variance"};
+
+struct Result {
+    char scene[32];
+    int circles;
+    double rays_per_sec, queries_per_sec, frame_ms;
+    double calibration_us;
+    unsigned long long checksum;
+    
+    // the noise of this run's measurements, not in the JSON
+    double rays_noise, queries_noise, frame_noise, calibration_noise;
+};
+
+// One circle per picked cell of a grid over the scene, kept inside its cell
+// so none overlap. The cells are picked by a seeded score: uniform for the
+// sparse and dense kinds, higher near a few cluster centers for clustered,
+// and variance puts big circles over whole blocks of cells first.
+static void make_scene(Scene& scene, SceneKind kind, int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    double cell = kind == SPARSE ? 60 : 20;
+    double area = (double)count * cell * cell * (kind == CLUSTERED ? 4 : 1);
+    double width = std::max((double)VIEW_W, std::sqrt(area * 4 / 3)), height = std::max((double)VIEW_H, width * 3 / 4);
+    int columns = (int)(width / cell), rows = (int)(height / cell);
+    
+    scene.shapes.clear();
+    scene.shapes.push_back(Shape(SHAPE_CIRCLE, LIGHT, LIGHT_RADIUS, 0, true));
+    
+    // cells that can't take a circle: around the light, and under the big ones
+    std::vector<char> blocked((size_t)columns * rows, 0);
+    auto block = [&](Point2D c, double r) {
+        int x0 = std::max(0, (int)((c.x - r) / cell)), x1 = std::min(columns - 1, (int)((c.x + r) / cell));
+        int y0 = std::max(0, (int)((c.y - r) / cell)), y1 = std::min(rows - 1, (int)((c.y + r) / cell));
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) blocked[(size_t)y * columns + x] = 1;
+        }
+    };
+    block(LIGHT, LIGHT_RADIUS + 1);
+    int placed = 0;
+    if (kind == VARIANCE) {
+        // one big circle per 2000 small ones, each over a 16x16 block of cells
+        const int BLOCK = 16;
+        int big = std::max(1, count / 2000);
+        for (int i = 0; i < big && placed < count; i++) {
+            int bx = (int)(unit(rng) * (columns / BLOCK)), by = (int)(unit(rng) * (rows / BLOCK));
+            Point2D c((bx + 0.5) * BLOCK * cell, (by + 0.5) * BLOCK * cell);
+            double r = BLOCK * cell * (0.2 + 0.25 * unit(rng));
+            double dx = c.x - LIGHT.x, dy = c.y - LIGHT.y;
+            if (std::sqrt(dx * dx + dy * dy) < r + LIGHT_RADIUS + 1 || blocked[(size_t)(by * BLOCK) * columns + bx * BLOCK]) continue;
+            block(c, r);
+            scene.shapes.push_back(Shape(SHAPE_CIRCLE, c, r));
+            placed++;
+        }
+    }
+    
+    std::vector<Point2D> clusters;
+    for (int i = 0; kind == CLUSTERED && i < std::min(16, std::max(1, count / 5000)); i++) {
+        clusters.push_back(Point2D(unit(rng) * columns * cell, unit(rng) * rows * cell));
+    }
+    double sigma = columns * cell / (4 * std::sqrt((double)clusters.size() + 1));
+    
+    std::vector<std::pair<double, int>> cells;
+    for (int i = 0; i < columns * rows; i++) {
+        double score = unit(rng);
+        if (blocked[i]) continue;
+        if (kind == CLUSTERED) {
+            Point2D c((i % columns + 0.5) * cell, (i / columns + 0.5) * cell);
+            double weight = 0;
+            for (auto& k : clusters) {
+                double dx = c.x - k.x, dy = c.y - k.y;
+                weight = std::max(weight, std::exp(-(dx * dx + dy * dy) / (2 * sigma * sigma)));
+            }
+            score *= weight;
+        }
+        cells.push_back(std::make_pair(-score, i));
+    }
+    int wanted = std::min(count - placed, (int)cells.size());
+    std::nth_element(cells.begin(), cells.begin() + wanted, cells.end());
+    std::sort(cells.begin(), cells.begin() + wanted);
+    
+    for (int n = 0; n < wanted; n++) {
+        int i = cells[n].second;
+        double r;
+        switch (kind) {
+            case SPARSE: r = cell * (0.05 + 0.05 * unit(rng)); break;
+            case VARIANCE: r = std::max(0.5, cell * 0.45 * std::pow(unit(rng), 4)); break;
+            default: r = cell * (0.3 + 0.15 * unit(rng));
+        }
+        Point2D c((i % columns + 0.5) * cell + (unit(rng) - 0.5) * (cell - 2 * r),
+                  (i / columns + 0.5) * cell + (unit(rng) - 0.5) * (cell - 2 * r));
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, c, r));
+    }
+    scene.rebuild();
+}
+
+// seconds per call of `body` over `calls` calls in a row
+template <class Fn>
+static double time_calls(int calls, Fn&& body) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) body();
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+    return took.count() / calls;
+}
+
+// the median of the samples, and half the spread of the middle half of them relative to it
+struct Measure {
+    double median, noise;
+};
+
+static Measure measure(std::vector<double> samples) {
+    std::sort(samples.begin(), samples.end());
+    auto at = [&](double q) { return samples[(size_t)(q * (samples.size() - 1) + 0.5)]; };
+    Measure m;
+    m.median = at(0.5);
+    m.noise = m.median > 0 ? (at(0.75) - at(0.25)) / (2 * m.median) : 0;
+    return m;
+}
+
+// Plain ray-circle tests over a fixed set of circles, code nothing in core/
+// shares, so its time is only the machine's speed at the moment.
+static double calibration_pass() {
+    static std::vector<double> circles;
+    if (circles.empty()) {
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<double> unit(0, 1);
+        for (int i = 0; i < 256; i++) {
+            circles.push_back(unit(rng) * VIEW_W);
+            circles.push_back(unit(rng) * VIEW_H);
+            circles.push_back(5 + 30 * unit(rng));
+        }
+    }
+    double nearest = 0;
+    for (int a = 0; a < 360; a++) {
+        double dx = std::cos(a * 0.0174532925), dy = std::sin(a * 0.0174532925), best = 1e300;
+        for (size_t i = 0; i < circles.size(); i += 3) {
+            double mx = LIGHT.x - circles[i], my = LIGHT.y - circles[i + 1];
+            double b = mx * dx + my * dy, c = mx * mx + my * my - circles[i + 2] * circles[i + 2];
+            double d = b * b - c;
+            if (d >= 0 && -b - std::sqrt(d) > 0) best = std::min(best, -b - std::sqrt(d));
+        }
+        nearest += best < 1e300 ? best : 0;
+    }
+    return nearest;
+}
+
+static void mix(unsigned long long& hash, long long value) {
+    // FNV-1a over the value's bytes
+    for (int i = 0; i < 8; i++) {
+        hash ^= (unsigned long long)(value >> (i * 8)) & 0xff;
+        hash *= 1099511628211ULL;
+    }
+}
+
+static Result run(SceneKind kind, int count, int samples, ThreadPool* pool) {
+    Result result;
+    std::snprintf(result.scene, sizeof(result.scene), "%s", KIND_NAMES[kind]);
+    result.circles = count;
+    result.checksum = 14695981039346656037ULL;
+    Scene scene;
+    make_scene(scene, kind, count, 1000 + kind);
+    
+    // rays: the light's fan through the grid and the circle store
+    std::vector<RayHit> hits;
+    auto fan = [&] { scene.tracer.cast_fan(LIGHT, FAN_RAYS, hits, pool); };
+    
+    // collision queries: what placing, dragging and resizing ask, all over the scene
+    double width = 0, height = 0;
+    for (auto& s : scene.shapes) {
+        width = std::max(width, s.center.x);
+        height = std::max(height, s.center.y);
+    }
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> x(0, width), y(0, height), size(5, 40);
+    std::vector<Point2D> at(QUERIES);
+    std::vector<double> sizes(QUERIES);
+    for (int i = 0; i < QUERIES; i++) {
+        at[i] = Point2D(x(rng), y(rng));
+        sizes[i] = size(rng);
+    }
+    long long colliding = 0;
+    auto queries = [&] {
+        colliding = 0;
+        for (int i = 0; i < QUERIES; i++) colliding += scene.check_collision_with_shapes(at[i], sizes[i]);
+    };
+    
+    // a full frame the way the editor draws one: background, rays, every shape
+    SoftwareRaster raster;
+    raster.resize(VIEW_W, VIEW_H);
+    RaySettings settings;
+    VisibilityPolygon polygon;
+    std::vector<RayHit> frame_hits;
+    Rgb color = light_rgb(scene.shapes[0].color);
+    auto frame = [&] {
+        draw_canvas_background(raster, VIEW_W, VIEW_H);
+        scene.cast_light(0, settings, frame_hits, polygon, pool);
+        draw_rays(raster, LIGHT, frame_hits, color);
+        draw_shapes(raster, scene.shapes);
+    };
+    
+    volatile double sink = 0;
+    auto calibrate = [&] { sink = sink + calibration_pass(); };
+    
+    // once each untimed to warm the caches up, then the samples in turns
+    fan();
+    queries();
+    frame();
+    calibrate();
+    std::vector<double> fan_times, query_times, frame_times, calibration_times;
+    for (int i = 0; i < samples; i++) {
+        calibration_times.push_back(time_calls(CALIBRATIONS_PER_SAMPLE, calibrate));
+        fan_times.push_back(time_calls(FANS_PER_SAMPLE, fan));
+        query_times.push_back(time_calls(QUERY_PASSES_PER_SAMPLE, queries));
+        frame_times.push_back(time_calls(FRAMES_PER_SAMPLE, frame));
+    }
+    for (auto& hit : hits) mix(result.checksum, hit.shape);
+    mix(result.checksum, colliding);
+    
+    Measure m = measure(fan_times);
+    result.rays_per_sec = FAN_RAYS / m.median;
+    result.rays_noise = m.noise;
+    m = measure(query_times);
+    result.queries_per_sec = QUERIES / m.median;
+    result.queries_noise = m.noise;
+    m = measure(frame_times);
+    result.frame_ms = m.median * 1000;
+    result.frame_noise = m.noise;
+    m = measure(calibration_times);
+    result.calibration_us = m.median * 1e6;
+    result.calibration_noise = m.noise;
+    return result;
+}
+
+static bool write_json(const char* path, const std::vector<Result>& results, int threads) {
+    FILE* file = std::fopen(path, "w");
+    if (!file) return false;
+    // one result per line, which is all read_baseline() needs
+    std::fprintf(file, "{\n\"threads\": %d,\n\"results\": [\n", threads);
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::fprintf(file, "{\"scene\": \"%s\", \"circles\": %d, \"rays_per_sec\": %.1f, \"queries_per_sec\": %.1f, "
+                           "\"frame_ms\": %.4f, \"calibration_us\": %.3f, \"checksum\": %llu}%s\n",
+                     r.scene, r.circles, r.rays_per_sec, r.queries_per_sec, r.frame_ms, r.calibration_us, r.checksum,
+                     i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(file, "]\n}\n");
+    return std::fclose(file) == 0;
+}
+
+static bool read_baseline(const char* path, std::vector<Result>& out) {
+    FILE* file = std::fopen(path, "r");
+    if (!file) return false;
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        Result r;
+        if (std::sscanf(line, " {\"scene\": \"%31[^\"]\", \"circles\": %d, \"rays_per_sec\": %lf, \"queries_per_sec\": %lf, "
+                              "\"frame_ms\": %lf, \"calibration_us\": %lf, \"checksum\": %llu",
+                        r.scene, &r.circles, &r.rays_per_sec, &r.queries_per_sec, &r.frame_ms, &r.calibration_us,
+                        &r.checksum) == 7) {
+            out.push_back(r);
+        }
+    }
+    std::fclose(file);
+    return true;
+}
+
+static void usage() {
+    std::fprintf(stderr, "usage: suite_bench [--json out.json] [--baseline file.json] [--threshold 0.25] [--max-circles N]\n"
+                         "                   [--threads N] [--runs N]\n");
+}
+
+int main(int argc, char** argv) {
+    std::string json_path, baseline_path;
+    double threshold = 0.25;
+    int max_circles = 1000000, threads = 1, runs = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--json" && has_value) json_path = argv[++i];
+        else if (arg == "--baseline" && has_value) baseline_path = argv[++i];
+        else if (arg == "--threshold" && has_value) threshold = std::max(0.0, std::atof(argv[++i]));
+        else if (arg == "--max-circles" && has_value) max_circles = std::atoi(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--runs" && has_value) runs = std::max(1, std::atoi(argv[++i]));
+        else {
+            usage();
+            return 2;
+        }
+    }
+    
+    std::vector<Result> baseline;
+    if (!baseline_path.empty() && !read_baseline(baseline_path.c_str(), baseline)) {
+        std::fprintf(stderr, "could not read %s\n", baseline_path.c_str());
+        return 1;
+    }
+    
+    // one thread by default, so the numbers don't depend on what else the machine is doing
+    ThreadPool pool(threads);
+    ThreadPool* use_pool = threads > 1 ? &pool : nullptr;
+    
+    std::printf("%-10s %8s %14s %14s %10s %20s  %s\n", "scene", "circles", "rays/s", "queries/s", "frame ms",
+                "checksum", "vs baseline");
+    const int counts[] = {10, 1000, 100000, 1000000};
+    std::vector<Result> results;
+    int regressions = 0;
+    for (int count : counts) {
+        if (count > max_circles) break;
+        for (int kind = SPARSE; kind <= VARIANCE; kind++) {
+            Result r = run((SceneKind)kind, count, SAMPLES * runs, use_pool);
+            results.push_back(r);
+            std::printf("%-10s %8d %14.0f %14.0f %10.4f %20llu", r.scene, r.circles, r.rays_per_sec, r.queries_per_sec,
+                        r.frame_ms, r.checksum);
+            
+            // slower by more than the threshold and the noise on any of the three fails the run,
+            // each scaled by how much faster the calibration loop ran now than then
+            const Result* base = nullptr;
+            for (auto& b : baseline) {
+                if (b.circles == r.circles && std::strcmp(b.scene, r.scene) == 0) base = &b;
+            }
+            if (!base) {
+                std::printf("%s\n", baseline.empty() ? "" : "  (not in baseline)");
+                continue;
+            }
+            double speed = r.calibration_us / base->calibration_us;
+            double rays = r.rays_per_sec * speed / base->rays_per_sec - 1;
+            double queries = r.queries_per_sec * speed / base->queries_per_sec - 1;
+            double frame = base->frame_ms / (r.frame_ms / speed) - 1;
+            auto too_slow = [&](double change, double noise) {
+                return change < -(threshold + noise + r.calibration_noise);
+            };
+            bool slower = too_slow(rays, r.rays_noise) || too_slow(queries, r.queries_noise) ||
+                          too_slow(frame, r.frame_noise);
+            regressions += slower;
+            double noise = std::max(std::max(r.rays_noise, r.queries_noise), r.frame_noise) + r.calibration_noise;
+            std::printf("  %+5.0f%% %+5.0f%% %+5.0f%%  noise %3.0f%%%s%s\n", rays * 100, queries * 100, frame * 100,
+                        noise * 100, slower ? "  SLOWER" : "", base->checksum != r.checksum ? "  (different hits)" : "");
+        }
+    }
+    
+    if (!json_path.empty()) {
+        if (!write_json(json_path.c_str(), results, threads)) {
+            std::fprintf(stderr, "could not write %s\n", json_path.c_str());
+            return 1;
+        }
+        std::printf("\nwrote %s\n", json_path.c_str());
+    }
+    if (regressions) {
+        std::printf("\n%d of %zu scenes more than %.0f%% slower than %s\n", regressions, results.size(), threshold * 100,
+                    baseline_path.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,83 @@
+// Times the ray fan on 1..N pool threads and checks every thread count gives
+// exactly the serial hits. Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/thread_scaling_bench.cpp core/tracer.cpp core/thread_pool.cpp
+//       core/spatial_grid.cpp core/circle_store.cpp -o thread_scaling_bench
+//   ./thread_scaling_bench [max_threads]
+//
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+#include "../core/tracer.h"
+
+static std::vector<Shape> make_scene(int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    double side = std::sqrt((double)count) * 60 + 200;
+    std::uniform_real_distribution<double> pos(0, side);
+    std::uniform_real_distribution<double> radius(5, 20);
+    
+    Point2D light(side / 2, side / 2);
+    std::vector<Shape> shapes;
+    shapes.push_back(Shape(SHAPE_CIRCLE, light, 30, 0, true));
+    while ((int)shapes.size() < count + 1) {
+        Shape s(SHAPE_CIRCLE, Point2D(pos(rng), pos(rng)), radius(rng));
+        double dx = s.center.x - light.x, dy = s.center.y - light.y;
+        if (dx * dx + dy * dy < (s.size1 + 30) * (s.size1 + 30)) continue;
+        shapes.push_back(s);
+    }
+    return shapes;
+}
+
+static bool same_hits(const std::vector<RayHit>& a, const std::vector<RayHit>& b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].shape != b[i].shape || a[i].t != b[i].t) return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int max_threads = argc > 1 ? std::atoi(argv[1]) : (int)std::thread::hardware_concurrency();
+    if (max_threads < 1) max_threads = 1;
+    
+    std::vector<Shape> shapes = make_scene(100000, 99);
+    SpatialGrid grid(shapes);
+    CircleStore circles(shapes);
+    PrimitiveStore primitives(shapes);
+    grid.rebuild();
+    circles.rebuild();
+    primitives.rebuild();
+    RayTracer tracer(grid, circles, primitives);
+    Point2D light = shapes[0].center;
+    
+    const int ray_counts[] = {360, 36000};
+    bool ok = true;
+    for (int rays : ray_counts) {
+        std::vector<RayHit> serial;
+        tracer.cast_fan(light, rays, serial);
+        int frames = std::max(10, 2000000 / rays);
+        
+        std::printf("%d rays, 100000 circles\n%8s %12s %10s %s\n", rays, "threads", "ms/frame", "speedup", "identical");
+        double base_ms = 0;
+        for (int threads = 1; threads <= max_threads; threads++) {
+            ThreadPool pool(threads);
+            std::vector<RayHit> hits;
+            tracer.cast_fan(light, rays, hits, &pool);
+            bool identical = same_hits(serial, hits);
+            ok = ok && identical;
+            
+            auto start = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; f++) tracer.cast_fan(light, rays, hits, &pool);
+            std::chrono::duration<double, std::milli> took = std::chrono::steady_clock::now() - start;
+            double ms = took.count() / frames;
+            if (threads == 1) base_ms = ms;
+            std::printf("%8d %12.4f %9.2fx %s\n", threads, ms, base_ms / ms, identical ? "yes" : "NO");
+        }
+        std::printf("\n");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+// Checks the exact visibility polygon against dense brute-force ray sampling
+// and times it against the fixed 360-ray fan. Builds on Linux without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/visibility_bench.cpp core/*.cpp -o visibility_bench
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "../core/tracer.h"
+#include "../core/visibility.h"
+
+// non-overlapping circles like the editor makes, light in the middle
+static std::vector<Shape> make_scene(int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    double side = std::sqrt((double)count) * 70 + 300;
+    std::uniform_real_distribution<double> pos(0, side);
+    std::uniform_real_distribution<double> radius(5, 25);
+    
+    Point2D light(side / 2, side / 2);
+    std::vector<Shape> shapes;
+    shapes.push_back(Shape(SHAPE_CIRCLE, light, 30, 0, true));
+    // buckets as wide as the largest diameter, so only neighbours need checking
+    const double cell = 51;
+    int cols = (int)(side / cell) + 1;
+    std::vector<std::vector<int>> buckets((size_t)cols * cols);
+    int attempts = 0;
+    while ((int)shapes.size() < count + 1 && attempts++ < count * 50) {
+        Shape s(SHAPE_CIRCLE, Point2D(pos(rng), pos(rng)), radius(rng));
+        double lx = s.center.x - light.x, ly = s.center.y - light.y;
+        if (lx * lx + ly * ly < (s.size1 + 31) * (s.size1 + 31)) continue;
+        int cx = (int)(s.center.x / cell), cy = (int)(s.center.y / cell);
+        bool clear = true;
+        for (int y = std::max(cy - 1, 0); clear && y <= std::min(cy + 1, cols - 1); y++) {
+            for (int x = std::max(cx - 1, 0); clear && x <= std::min(cx + 1, cols - 1); x++) {
+                for (int o : buckets[(size_t)y * cols + x]) {
+                    double dx = s.center.x - shapes[o].center.x, dy = s.center.y - shapes[o].center.y;
+                    double min_dist = s.size1 + shapes[o].size1 + 1;
+                    if (dx * dx + dy * dy < min_dist * min_dist) { clear = false; break; }
+                }
+            }
+        }
+        if (!clear) continue;
+        buckets[(size_t)cy * cols + cx].push_back((int)shapes.size());
+        shapes.push_back(s);
+    }
+    return shapes;
+}
+
+static double segment_distance(Point2D p, Point2D a, Point2D b) {
+    double vx = b.x - a.x, vy = b.y - a.y;
+    double len = vx * vx + vy * vy;
+    double k = len > 0 ? ((p.x - a.x) * vx + (p.y - a.y) * vy) / len : 0;
+    k = std::max(0.0, std::min(1.0, k));
+    double dx = a.x + vx * k - p.x, dy = a.y + vy * k - p.y;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+// how far the brute-force end point at every sampled angle is from the polygon
+static double worst_error(Point2D light, const VisibilityPolygon& poly, const RayTracer& tracer, int samples) {
+    std::vector<double> angles;
+    for (const Point2D& p : poly.points) {
+        double a = std::atan2(p.y - light.y, p.x - light.x);
+        angles.push_back(a < 0 ? a + 2 * 3.14159265359 : a);
+    }
+    double worst = 0;
+    int n = (int)poly.points.size();
+    for (int i = 0; i < samples; i++) {
+        double angle = (i + 0.5) * 2 * 3.14159265359 / samples;
+        RayHit hit = tracer.cast(light, angle);
+        
+        // the polygon edge covering this angle, plus neighbours for the radial jumps
+        int k = (int)(std::upper_bound(angles.begin(), angles.end(), angle) - angles.begin()) - 1;
+        double best = 1e30;
+        for (int j = k - 3; j <= k + 3; j++) {
+            int a = ((j % n) + n) % n, b = (a + 1) % n;
+            best = std::min(best, segment_distance(hit.end, poly.points[a], poly.points[b]));
+        }
+        worst = std::max(worst, best);
+    }
+    return worst;
+}
+
+int main() {
+    const double max_error = 0.5;
+    const int counts[] = {10, 100, 1000, 10000};
+    std::printf("%8s %8s %8s %12s %12s %12s %s\n", "circles", "points", "rays", "poly ms", "360 fan ms", "worst err", "ok");
+    
+    bool ok = true;
+    for (int count : counts) {
+        std::vector<Shape> shapes = make_scene(count, 5 + count);
+        SpatialGrid grid(shapes);
+        CircleStore circles(shapes);
+        PrimitiveStore primitives(shapes);
+        grid.rebuild();
+        circles.rebuild();
+        primitives.rebuild();
+        RayTracer tracer(grid, circles, primitives);
+        Point2D light = shapes[0].center;
+        
+        VisibilityPolygon poly;
+        compute_visibility(light, shapes, poly, max_error);
+        double err = worst_error(light, poly, tracer, 200000);
+        
+        // a sample end point may sit a hair past a chord, never more than max_error
+        bool good = err <= max_error + 1e-6;
+        ok = ok && good;
+        
+        int frames = count >= 10000 ? 10 : 200;
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) compute_visibility(light, shapes, poly, max_error);
+        std::chrono::duration<double, std::milli> poly_took = std::chrono::steady_clock::now() - start;
+        
+        std::vector<RayHit> hits;
+        start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) tracer.cast_fan(light, 360, hits);
+        std::chrono::duration<double, std::milli> fan_took = std::chrono::steady_clock::now() - start;
+        
+        std::printf("%8d %8zu %8zu %12.3f %12.3f %12.6f %s\n", (int)shapes.size() - 1, poly.points.size(),
+                    poly.rays.size(), poly_took.count() / frames, fan_took.count() / frames, err, good ? "yes" : "NO");
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+// A world far bigger than any canvas: 10M circles on a jittered grid, looked
+// at through the camera from the editor's 800x600 window at several zooms.
+// Every view is timed on it and on a 100k-circle world of the same density,
+// for the shapes drawn through the grid, the exact light map and a ray fan
+// per light, so it shows what a frame costs follows the view and not the
+// world. At zoom 1 the culled drawing has to match drawing every shape
+// pixel for pixel, and on the small world the light map has to match one
+// made from every shape at every zoom, or the run fails. Builds on Linux
+// without windows.h:
+//
+//   g++ -O2 -std=c++17 -pthread bench/world_bench.cpp core/*.cpp -o world_bench
+//   ./world_bench [circles] [threads]
+//
+// The 10M world takes about 2.5 GB.
+//
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "../core/camera.h"
+#include "../core/light_map.h"
+#include "../core/scene.h"
+#include "../core/scene_renderer.h"
+#include "../core/soft_raster.h"
+
+typedef std::chrono::duration<double, std::milli> Millis;
+
+const int VIEW_W = 800, VIEW_H = 600;
+const double SPACING = 16;  // one circle per cell this wide
+const int FAN_RAYS = 3600;
+const float LIGHT_TOLERANCE = 1e-4f;  // float rounding, the lit pixels themselves have to be the same
+
+// where the lights sit, from the middle of the world
+const Point2D LIGHT_OFFSETS[] = {Point2D(-200, -100), Point2D(250, 40), Point2D(10, 230)};
+const int LIGHTS = 3;
+
+// A circle of radius 2 to 6 somewhere inside every cell of a square grid,
+// except the cells right around the lights.
+static void make_world(Scene& scene, int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    int side = (int)std::ceil(std::sqrt((double)count));
+    double middle = side * SPACING / 2;
+    scene.shapes.reserve(count + LIGHTS);
+    for (int l = 0; l < LIGHTS; l++) {
+        Point2D pos(middle + LIGHT_OFFSETS[l].x, middle + LIGHT_OFFSETS[l].y);
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, pos, 8, 0, true));
+    }
+    for (int i = 0; (int)scene.shapes.size() < count + LIGHTS && i < side * side; i++) {
+        double r = 2 + 4 * unit(rng);
+        Point2D c((i % side + 0.5) * SPACING + (unit(rng) - 0.5) * (SPACING - 2 * r),
+                  (i / side + 0.5) * SPACING + (unit(rng) - 0.5) * (SPACING - 2 * r));
+        bool clear = true;
+        for (int l = 0; l < LIGHTS && clear; l++) {
+            const Shape& light = scene.shapes[l];
+            clear = std::hypot(c.x - light.center.x, c.y - light.center.y) >= r + light.size1 + 1;
+        }
+        if (clear) scene.shapes.push_back(Shape(SHAPE_CIRCLE, c, r));
+    }
+    scene.rebuild();
+    scene.clear_edits();
+}
+
+// the window's view of the world's middle at `zoom`
+static Camera middle_camera(const Scene& scene, double zoom) {
+    const Point2D& light = scene.shapes[0].center;
+    Point2D middle(light.x - LIGHT_OFFSETS[0].x, light.y - LIGHT_OFFSETS[0].y);
+    Camera camera;
+    camera.zoom = zoom;
+    camera.origin = Point2D(middle.x - VIEW_W / 2 / zoom, middle.y - VIEW_H / 2 / zoom);
+    return camera;
+}
+
+struct Timing {
+    double draw_ms, light_ms, rays_ms;
+    int draw_calls, lights_cast;
+    float light_error;  // largest difference to the light map from every shape, -1 when not checked
+};
+
+// what the light map would hold with every shape looked at, out to the same reach
+static std::vector<float> full_light_map(const Scene& scene, const Camera& camera) {
+    std::vector<float> rgb((size_t)VIEW_W * VIEW_H * 3, 0.0f);
+    Box view = camera.view(VIEW_W, VIEW_H);
+    VisibilityPolygon polygon;
+    for (int light : scene.lights()) {
+        const Shape& s = scene.shapes[light];
+        double reach = ray_reach(s.center, view);
+        if (reach == 0) continue;
+        compute_visibility(s.center, scene.shapes, polygon, 0.5, reach);
+        float color[3] = {s.color.r * s.intensity, s.color.g * s.intensity, s.color.b * s.intensity};
+        add_lit_region(rgb, VIEW_W, VIEW_H, polygon.points, s.center, color, 0, VIEW_H, camera);
+    }
+    return rgb;
+}
+
+static Timing time_view(Scene& scene, const Camera& camera, ThreadPool& pool, bool check_light) {
+    Timing timing;
+    SoftwareRaster frame(VIEW_W, VIEW_H);
+    
+    // the frame a few times, the best one counts
+    timing.draw_ms = 1e300;
+    for (int run = 0; run < 3; run++) {
+        auto start = std::chrono::steady_clock::now();
+        frame.draw_calls = 0;
+        draw_canvas_background(frame, VIEW_W, VIEW_H);
+        draw_scene_view(frame, scene, camera, VIEW_W, VIEW_H);
+        timing.draw_ms = std::min(timing.draw_ms, Millis(std::chrono::steady_clock::now() - start).count());
+    }
+    timing.draw_calls = frame.draw_calls;
+    
+    // the exact light map from nothing
+    LightMap map;
+    map.resize(VIEW_W, VIEW_H);
+    map.set_camera(camera);
+    auto start = std::chrono::steady_clock::now();
+    map.update(scene, &pool);
+    timing.light_ms = Millis(std::chrono::steady_clock::now() - start).count();
+    timing.light_error = -1;
+    if (check_light) {
+        std::vector<float> full = full_light_map(scene, camera);
+        timing.light_error = 0;
+        for (size_t i = 0; i < full.size(); i++) {
+            timing.light_error = std::max(timing.light_error, std::fabs(full[i] - map.buffer()[i]));
+        }
+    }
+    
+    // and a fan around every light that can reach the view
+    Box view = camera.view(VIEW_W, VIEW_H);
+    std::vector<RayHit> hits;
+    timing.lights_cast = 0;
+    start = std::chrono::steady_clock::now();
+    for (int light : scene.lights()) {
+        double reach = ray_reach(scene.shapes[light].center, view);
+        if (reach == 0) continue;
+        scene.tracer.set_reach(reach);
+        scene.tracer.cast_fan(scene.shapes[light].center, FAN_RAYS, hits, &pool);
+        timing.lights_cast++;
+    }
+    timing.rays_ms = Millis(std::chrono::steady_clock::now() - start).count();
+    return timing;
+}
+
+// the culled view against every shape drawn through the same camera, how many pixels differ
+static long long compare_with_all(const Scene& scene, const Camera& camera) {
+    SoftwareRaster culled(VIEW_W, VIEW_H), all(VIEW_W, VIEW_H);
+    draw_canvas_background(culled, VIEW_W, VIEW_H);
+    draw_scene_view(culled, scene, camera, VIEW_W, VIEW_H, LIGHTS);
+    draw_canvas_background(all, VIEW_W, VIEW_H);
+    CameraBackend world(all, camera);
+    draw_shapes(world, scene.shapes, LIGHTS);
+    long long differ = 0;
+    for (int y = 0; y < VIEW_H; y++) {
+        for (int x = 0; x < VIEW_W; x++) {
+            Rgb a = culled.pixel(x, y), b = all.pixel(x, y);
+            differ += a.r != b.r || a.g != b.g || a.b != b.b;
+        }
+    }
+    return differ;
+}
+
+int main(int argc, char** argv) {
+    int big = argc > 1 ? std::max(1000, std::atoi(argv[1])) : 10000000;
+    int threads = argc > 2 ? std::atoi(argv[2]) : 1;
+    ThreadPool pool(threads);
+    
+    // the small world first, at the same density
+    int counts[2] = {std::min(100000, big), big};
+    bool failed = false;
+    std::printf("%-12s %10s %10s %8s %10s %10s %8s\n", "view", "circles", "draw ms", "shapes", "light ms", "rays ms",
+                "lights");
+    
+    struct View {
+        const char* name;
+        double zoom;
+        bool check;
+    };
+    const View views[] = {{"zoom 1", 1, true}, {"zoom 1/4", 0.25, false}, {"zoom 1/16", 1.0 / 16, false},
+                          {"zoom 1/64", 1.0 / 64, false}};
+    for (int w = 0; w < 2; w++) {
+        if (w == 1 && counts[1] == counts[0]) break;
+        auto start = std::chrono::steady_clock::now();
+        Scene scene;
+        make_world(scene, counts[w], 7);
+        std::printf("%d circles built in %.0f ms, grid %d x %d\n", (int)scene.shapes.size() - LIGHTS,
+                    Millis(std::chrono::steady_clock::now() - start).count(), scene.grid.column_count(),
+                    scene.grid.row_count());
+        
+        for (const View& v : views) {
+            Camera camera = middle_camera(scene, v.zoom);
+            Timing t = time_view(scene, camera, pool, w == 0);
+            std::printf("%-12s %10d %10.2f %8d %10.2f %10.2f %8d\n", v.name, counts[w], t.draw_ms, t.draw_calls,
+                        t.light_ms, t.rays_ms, t.lights_cast);
+            if (t.light_error >= 0) {
+                std::printf("%-12s %10s light map vs every shape: largest difference %g\n", "", "", t.light_error);
+                failed = failed || t.light_error > LIGHT_TOLERANCE;
+            }
+            if (!v.check) continue;
+            long long differ = compare_with_all(scene, camera);
+            std::printf("%-12s %10s culled drawing vs every shape: %lld pixels differ\n", "", "", differ);
+            failed = failed || differ != 0;
+        }
+        // the identity camera at the world's corner, the editor's view before there was a camera
+        long long differ = compare_with_all(scene, Camera());
+        std::printf("%-12s %10s corner at zoom 1 vs every shape: %lld pixels differ\n", "", "", differ);
+        failed = failed || differ != 0;
+    }
+    if (failed) {
+        std::printf("FAILED: the culled drawing or light map differs from looking at every shape\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,492 @@
+// Renders a scene with the software rasterizer and prints how long the ray
+// casting and the drawing took, so throughput can be measured without a
+// display. Built by CMake as raytrace_cli:
+//
+//   raytrace_cli [options] [scene files...]
+//
+//     --circles N --seed S    generate N random circles instead of loading a scene
+//     --lights N              with N lights in different colors, the first one in the middle
+//     --mixed                 a mix of circles, segments, rectangles (some turned) and polygons instead
+//     --materials             and the shapes a random mix of matte, mirror and glass
+//     --bounces N             follow reflected and refracted rays N generations deep
+//     --bounce-budget N       most secondary rays per frame
+//     --save FILE             write the scene, binary when FILE ends in .bin, then render it
+//     --batch LIST            also render every scene file named in LIST, one per line
+//     --out FILE              image for a single scene, .png or .ppm
+//     --out-dir DIR           images for scene files go here, named after the scene file
+//     --size WxH --rays N --adaptive --exact --depth N --budget N --threads N --frames N
+//     --soft                  soft shadows: exact mode with every light sampled across its disc,
+//                             the frames adding up one average
+//     --samples N             origins per light every frame adds (4)
+//     --max-samples N         most origins per light (256)
+//     --tolerance X           or stop once a sample moves the average less than X per pixel (0.00002)
+//     --trace FILE            print every stage's min/avg/p99 and write the frames as a Chrome trace
+//                             (not in release builds, the profiler is compiled out there)
+//     --moving SPEED          every shape and light drifts at up to SPEED pixels a second, each frame
+//                             running 1/60 s of the simulation
+//     --record FILE           write the frames to a replay log
+//     --replay FILE           render every frame of a replay log instead, and check each one ends
+//                             up where the recording did
+//
+// With no scene files and no --circles it renders the editor's starting scene.
+//
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include "../core/area_light.h"
+#include "../core/bounce.h"
+#include "../core/light_map.h"
+#include "../core/profiler.h"
+#include "../core/replay.h"
+#include "../core/scene.h"
+#include "../core/scene_io.h"
+#include "../core/scene_renderer.h"
+#include "../core/soft_raster.h"
+
+typedef std::chrono::duration<double, std::milli> Millis;
+
+// one shape per cell of a jittered grid over the canvas, so none overlap,
+// and the lights spread around leaving room for their glow; mixed scenes
+// take turns between circles, segments, rectangles, turned rectangles and
+// polygons, each inside the circle a circle would have had
+static void make_scene(Scene& scene, int count, int lights, bool mixed, bool materials, unsigned seed, int width,
+                       int height) {
+    scene.shapes.clear();
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (int i = 0; i < lights; i++) {
+        Point2D pos(width * 0.5, height * 0.5);
+        if (i > 0) pos = Point2D(width * (0.1 + 0.8 * unit(rng)), height * (0.1 + 0.8 * unit(rng)));
+        Shape light(SHAPE_CIRCLE, pos, 30, 0, true);
+        light.color = light_palette(i);
+        scene.shapes.push_back(light);
+    }
+    
+    double cell = std::sqrt((double)width * height / count);
+    int columns = std::max(1, (int)(width / cell)), rows = std::max(1, (int)std::ceil((double)count / columns));
+    double cell_w = (double)width / columns, cell_h = (double)height / rows;
+    double max_r = std::min(cell_w, cell_h) * 0.45;
+    
+    for (int i = 0; i < columns * rows && (int)scene.shapes.size() < count + lights; i++) {
+        double r = max_r * (0.3 + 0.7 * unit(rng));
+        double x = (i % columns + 0.5) * cell_w + (unit(rng) - 0.5) * (cell_w - 2 * r);
+        double y = (i / columns + 0.5) * cell_h + (unit(rng) - 0.5) * (cell_h - 2 * r);
+        bool clear = true;
+        for (int l = 0; l < lights && clear; l++) {
+            double dx = x - scene.shapes[l].center.x, dy = y - scene.shapes[l].center.y;
+            clear = dx * dx + dy * dy >= (r + 30) * (r + 30);
+        }
+        if (!clear) continue;
+        Point2D center(x, y);
+        double angle = unit(rng) * 3.14159265359;
+        switch (mixed ? i % 5 : 0) {
+            case 1: scene.shapes.push_back(Shape(SHAPE_SEGMENT, center, r)); scene.shapes.back().angle = angle; break;
+            case 2: scene.shapes.push_back(Shape(SHAPE_RECT, center, r * 0.8, r * 0.6)); break;
+            case 3: scene.shapes.push_back(Shape(SHAPE_RECT, center, r * 0.9, r * 0.4)); scene.shapes.back().angle = angle; break;
+            case 4: scene.shapes.push_back(make_regular_polygon(center, r, 3 + (int)(rng() % 6), angle)); break;
+            default: scene.shapes.push_back(Shape(SHAPE_CIRCLE, center, r));
+        }
+        if (materials) scene.shapes.back().material = material_preset((int)(rng() % MATERIAL_PRESETS));
+    }
+    scene.rebuild();
+}
+
+// a random direction and a speed up to `speed` for every shape, lights too
+static void give_velocities(Scene& scene, double speed, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> unit(0, 1);
+    for (Shape& s : scene.shapes) {
+        double a = unit(rng) * 2 * 3.14159265359, v = speed * unit(rng);
+        s.velocity = Point2D(std::cos(a) * v, std::sin(a) * v);
+    }
+}
+
+static int shape_count(const Scene& scene) {
+    return (int)(scene.shapes.size() - scene.lights().size());
+}
+
+static bool ends_with(const std::string& s, const char* suffix) {
+    size_t n = std::strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// "dir/name.bin" -> "<out_dir>/name.bin.png", the extension stays so name.txt and name.bin don't share an image
+static std::string image_path_for(const std::string& scene_path, const std::string& out_dir) {
+    size_t slash = scene_path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? scene_path : scene_path.substr(slash + 1);
+    return (out_dir.empty() ? std::string() : out_dir + "/") + name + ".png";
+}
+
+struct RenderJob {
+    RaySettings settings;
+    BounceSettings bounces;
+    bool soft = false;
+    AreaLightSettings area;
+    int width = 800, height = 600;
+    int frames = 1;
+    Camera camera;  // the identity unless a replay moved it
+};
+
+// Casts and draws `frames` times, prints the timings and writes the last
+// frame if `out_path` is set. In exact mode every frame starts from an empty
+// light map, so the timing is for all lights; a last update with nothing
+// changed shows what the editor pays on a frame where nothing moved. Soft
+// shadows instead keep adding to one average over all the frames, the way
+// the editor refines a still scene. With `advance` the scene can change
+// before every frame, the camera too, and the frames stop early once it
+// returns false.
+static bool render(Scene& scene, const RenderJob& job, ThreadPool& pool, SoftwareRaster& raster,
+                   const std::string& out_path, const std::function<bool()>& advance = nullptr) {
+    const std::vector<int>& lights = scene.lights();
+    std::vector<std::vector<RayHit>> hits;
+    std::vector<std::vector<RaySegment>> segments;
+    BounceStats bounce_stats;
+    VisibilityPolygon polygon;
+    LightMap light_map;
+    light_map.resize(job.width, job.height);
+    AreaLightMap area_map;
+    area_map.resize(job.width, job.height);
+    int converged_frame = 0;
+    Millis cast_time(0), draw_time(0), advance_time(0);
+    long long total_rays = 0;
+    raster.resize(job.width, job.height);
+    
+    int frames = 0;
+    for (; frames < job.frames; frames++) {
+        int f = frames;
+        if (advance) {
+            // outside the profiled frame, a replay only knows it's over once it tried
+            auto start = std::chrono::steady_clock::now();
+            if (!advance()) break;
+            advance_time += std::chrono::steady_clock::now() - start;
+        }
+        PROFILE_FRAME_BEGIN();
+        light_map.set_camera(job.camera);
+        area_map.set_camera(job.camera);
+        Box view = job.camera.view(job.width, job.height);
+        hits.resize(lights.size());
+        segments.resize(lights.size());
+        auto start = std::chrono::steady_clock::now();
+        if (job.soft) {
+            // no shadow-edge rays, the edges are what gets soft
+            PROFILE_SCOPE("area lights");
+            if (area_map.converged(job.area) && !converged_frame) converged_frame = f;
+            area_map.update(scene, job.area, &pool);
+            scene.clear_edits();
+            for (auto& h : hits) h.clear();
+        } else if (job.settings.exact) {
+            PROFILE_SCOPE("light map");
+            light_map.clear();
+            light_map.update(scene, &pool);
+            for (size_t k = 0; k < lights.size(); k++) {
+                hits[k] = light_map.lights()[k].polygon.rays;
+                total_rays += (long long)hits[k].size();
+            }
+        } else {
+            // the bounce budget is shared by all lights, first come first served
+            int budget = job.bounces.budget;
+            for (size_t k = 0; k < lights.size(); k++) {
+                // only as far as the view needs, like the editor
+                double reach = ray_reach(scene.shapes[lights[k]].center, view);
+                hits[k].clear();
+                segments[k].clear();
+                if (reach == 0) continue;
+                scene.tracer.set_reach(reach);
+                {
+                    PROFILE_SCOPE("rays");
+                    total_rays += scene.cast_light(lights[k], job.settings, hits[k], polygon, &pool);
+                }
+                PROFILE_SCOPE("bounces");
+                segments[k].clear();
+                total_rays += trace_bounces(scene, hits[k], job.bounces, budget, segments[k], &bounce_stats, &pool);
+            }
+        }
+        auto cast_done = std::chrono::steady_clock::now();
+        
+        raster.draw_calls = 0;
+        {
+            PROFILE_SCOPE("background");
+            draw_canvas_background(raster, job.width, job.height);
+            if (job.soft) area_map.tone_map(raster, &pool);
+            else if (job.settings.exact) light_map.tone_map(raster, &pool);
+        }
+        {
+            PROFILE_SCOPE("draw rays");
+            CameraBackend world(raster, job.camera);
+            for (size_t k = 0; k < lights.size(); k++) {
+                const Shape& light = scene.shapes[lights[k]];
+                draw_rays(world, light.center, hits[k], light_rgb(light.color));
+                draw_bounces(world, segments[k], light_rgb(light.color));
+            }
+        }
+        {
+            PROFILE_SCOPE("draw shapes");
+            draw_scene_view(raster, scene, job.camera, job.width, job.height);
+        }
+        cast_time += cast_done - start;
+        draw_time += std::chrono::steady_clock::now() - cast_done;
+        PROFILE_FRAME_END();
+    }
+    
+    const RaySettings& s = job.settings;
+    const char* mode = job.soft ? "soft" : s.exact ? "exact" : s.adaptive ? "adaptive" : "uniform";
+    frames = std::max(frames, 1);
+    std::printf("rays:    %s, %lld per frame from %d lights, %d threads\n", mode, total_rays / frames,
+                (int)lights.size(), pool.thread_count());
+    std::printf("cast:    %.4f ms/frame, %.2f Mrays/s\n", cast_time.count() / frames,
+                total_rays / (cast_time.count() * 1000.0));
+    std::printf("draw:    %.4f ms/frame, %d draw calls\n", draw_time.count() / frames, raster.draw_calls);
+    if (advance) std::printf("advance: %.4f ms/frame\n", advance_time.count() / frames);
+    for (size_t d = 0; d < bounce_stats.rays.size(); d++) {
+        std::printf("bounce %d: %lld rays/frame, %.2f Mrays/s\n", (int)d + 1, bounce_stats.rays[d] / frames,
+                    bounce_stats.rays[d] / (bounce_stats.seconds[d] * 1e6));
+    }
+    if (job.soft) {
+        std::printf("soft:    %d samples per light, a sample moves the average %.6f per pixel, ", area_map.samples(),
+                    area_map.last_change());
+        if (converged_frame) std::printf("converged after %d frames\n", converged_frame);
+        else if (area_map.converged(job.area)) std::printf("converged after %d frames\n", frames);
+        else std::printf("not converged\n");
+    } else if (s.exact) {
+        scene.clear_edits();
+        auto start = std::chrono::steady_clock::now();
+        int recomputed = light_map.update(scene, &pool);
+        Millis cached_time = std::chrono::steady_clock::now() - start;
+        std::printf("cached:  %.4f ms for a frame with nothing changed, %d lights recomputed\n", cached_time.count(),
+                    recomputed);
+    }
+    
+    if (out_path.empty()) return true;
+    bool written = ends_with(out_path, ".ppm") ? raster.write_ppm(out_path.c_str()) : raster.write_png(out_path.c_str());
+    if (!written) {
+        std::fprintf(stderr, "could not write %s\n", out_path.c_str());
+        return false;
+    }
+    std::printf("wrote:   %s\n", out_path.c_str());
+    return true;
+}
+
+static void usage() {
+    std::fprintf(stderr, "usage: raytrace_cli [--circles N] [--lights N] [--mixed] [--materials] [--seed S] [--save file] [--batch list]\n"
+                         "                    [--out file.png|file.ppm] [--out-dir dir] [--size WxH] [--rays N] [--adaptive]\n"
+                         "                    [--exact] [--depth N] [--budget N] [--bounces N] [--bounce-budget N] [--threads N]\n"
+                         "                    [--soft] [--samples N] [--max-samples N] [--tolerance X]\n"
+                         "                    [--frames N] [--trace file.json] [--moving speed] [--record file.rtlog]\n"
+                         "                    [--replay file.rtlog] [scene files...]\n");
+}
+
+int main(int argc, char** argv) {
+    int circles = 0, lights = 1, threads = 0;
+    bool mixed = false, materials = false;
+    unsigned seed = 1;
+    double moving = 0;
+    bool frames_given = false;
+    std::string out_path, out_dir, save_path, trace_path, record_path, replay_path;
+    std::vector<std::string> scene_paths;
+    RenderJob job;
+    
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--adaptive") job.settings.adaptive = true;
+        else if (arg == "--exact") job.settings.exact = true;
+        else if (arg == "--soft") job.soft = job.settings.exact = true;
+        else if (arg == "--materials") materials = true;
+        else if (arg == "--mixed") mixed = true;
+        else if (arg == "--bounces" && has_value) job.bounces.max_depth = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--bounce-budget" && has_value) job.bounces.budget = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--samples" && has_value) job.area.samples_per_frame = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--max-samples" && has_value) job.area.max_samples = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--tolerance" && has_value) job.area.tolerance = std::max(0.0, std::atof(argv[++i]));
+        else if (arg == "--circles" && has_value) circles = std::atoi(argv[++i]);
+        else if (arg == "--lights" && has_value) lights = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--seed" && has_value) seed = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--rays" && has_value) job.settings.ray_count = std::atoi(argv[++i]);
+        else if (arg == "--depth" && has_value) job.settings.max_depth = std::atoi(argv[++i]);
+        else if (arg == "--budget" && has_value) job.settings.budget = std::atoi(argv[++i]);
+        else if (arg == "--threads" && has_value) threads = std::atoi(argv[++i]);
+        else if (arg == "--frames" && has_value) {
+            job.frames = std::max(1, std::atoi(argv[++i]));
+            frames_given = true;
+        }
+        else if (arg == "--moving" && has_value) moving = std::max(0.0, std::atof(argv[++i]));
+        else if (arg == "--record" && has_value) record_path = argv[++i];
+        else if (arg == "--replay" && has_value) replay_path = argv[++i];
+        else if (arg == "--out" && has_value) out_path = argv[++i];
+        else if (arg == "--out-dir" && has_value) out_dir = argv[++i];
+        else if (arg == "--save" && has_value) save_path = argv[++i];
+        else if (arg == "--trace" && has_value) trace_path = argv[++i];
+        else if (arg == "--batch" && has_value) {
+            FILE* list = std::fopen(argv[++i], "r");
+            if (!list) {
+                std::fprintf(stderr, "could not read %s\n", argv[i]);
+                return 1;
+            }
+            char line[4096];
+            while (std::fgets(line, sizeof(line), list)) {
+                std::string path = line;
+                while (!path.empty() && (path.back() == '\n' || path.back() == '\r' || path.back() == ' ')) path.pop_back();
+                if (!path.empty() && path[0] != '#') scene_paths.push_back(path);
+            }
+            std::fclose(list);
+        } else if (arg == "--size" && has_value) {
+            if (std::sscanf(argv[++i], "%dx%d", &job.width, &job.height) != 2 || job.width <= 0 || job.height <= 0) {
+                usage();
+                return 2;
+            }
+        } else if (!arg.empty() && arg[0] != '-') {
+            scene_paths.push_back(arg);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    
+    if (!trace_path.empty() && !RAYTRACE_PROFILER) {
+        std::fprintf(stderr, "--trace needs a build with the profiler, this one has NDEBUG set\n");
+        return 2;
+    }
+    
+    // scene files from different directories can still have the same name, and one render would overwrite the other
+    if (scene_paths.size() > 1) {
+        std::map<std::string, std::string> images;
+        for (auto& path : scene_paths) {
+            auto added = images.emplace(image_path_for(path, out_dir), path);
+            if (!added.second) {
+                std::fprintf(stderr, "%s and %s would both be written to %s\n", added.first->second.c_str(),
+                             path.c_str(), added.first->first.c_str());
+                return 2;
+            }
+        }
+    }
+    
+    ThreadPool pool(threads);
+    SoftwareRaster raster;
+    
+    // a replay renders its own frames and nothing else
+    if (!replay_path.empty()) {
+        Scene scene;
+        Simulation simulation;
+        ReplayReader reader;
+        std::string error;
+        if (!reader.open(replay_path.c_str(), scene, job.camera, simulation, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        std::printf("replay:  %s, %d shapes to start with\n", replay_path.c_str(), shape_count(scene));
+        if (!frames_given) job.frames = 1 << 30;
+        int steps = 0, diverged = 0;
+        auto advance = [&]() {
+            if (!reader.next_frame(scene, job.camera, simulation)) return false;
+            steps += reader.last_steps();
+            if (!reader.last_matched()) diverged++;
+            return true;
+        };
+        bool ok = render(scene, job, pool, raster, out_path, advance);
+        std::printf("replay:  %d frames, %d simulation steps, %d ended up elsewhere than recorded\n", reader.frame(),
+                    steps, diverged);
+        if (!reader.at_end() && reader.frame() < job.frames) {
+            std::fprintf(stderr, "%s is cut short or names a shape that isn't there\n", replay_path.c_str());
+            return 1;
+        }
+        return ok && diverged == 0 ? 0 : 1;
+    }
+    
+    // a generated or built-in scene, unless only scene files were asked for
+    if (scene_paths.empty() || circles > 0) {
+        Scene scene;
+        auto start = std::chrono::steady_clock::now();
+        if (circles > 0) {
+            make_scene(scene, circles, lights, mixed, materials, seed, job.width, job.height);
+        } else {
+            // the editor's starting scene: a light and one circle
+            scene.shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(150, 400), 30, 0, true));
+            scene.shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(500, 200), 70));
+            scene.rebuild();
+        }
+        Millis build_time = std::chrono::steady_clock::now() - start;
+        std::printf("scene:   %d shapes, %dx%d, built in %.3f ms\n", shape_count(scene), job.width,
+                    job.height, build_time.count());
+        
+        if (!save_path.empty()) {
+            start = std::chrono::steady_clock::now();
+            if (!save_scene(save_path.c_str(), scene, scene_format_for(save_path.c_str()))) {
+                std::fprintf(stderr, "could not write %s\n", save_path.c_str());
+                return 1;
+            }
+            Millis save_time = std::chrono::steady_clock::now() - start;
+            std::printf("saved:   %s in %.3f ms\n", save_path.c_str(), save_time.count());
+        }
+        
+        // moving shapes and the recorder need a step before every frame, the rest renders the same scene each time
+        Simulation simulation;
+        simulation.bounds = Box{0, 0, (double)job.width, (double)job.height};
+        simulation.running = true;
+        ReplayRecorder recorder;
+        if (moving > 0) give_velocities(scene, moving, seed);
+        if (!record_path.empty() && !recorder.start(record_path.c_str(), scene, job.camera, simulation.bounds)) {
+            std::fprintf(stderr, "could not write %s\n", record_path.c_str());
+            return 1;
+        }
+        std::function<bool()> advance;
+        if (moving > 0 || recorder.recording()) {
+            advance = [&]() {
+                int steps = simulation.advance(scene, 1.0 / 60);
+                recorder.end_frame(steps, scene, job.camera, simulation.bounds);
+                return true;
+            };
+        }
+        if (!render(scene, job, pool, raster, scene_paths.empty() ? out_path : std::string(), advance)) return 1;
+        if (!record_path.empty()) {
+            if (!recorder.recording()) {
+                std::fprintf(stderr, "could not write %s\n", record_path.c_str());
+                return 1;
+            }
+            std::printf("record:  %s, %d frames\n", record_path.c_str(), recorder.frames());
+        }
+    }
+    
+    // batch mode: every scene file in turn, each to its own image
+    bool ok = true;
+    for (auto& path : scene_paths) {
+        Scene scene;
+        std::string error;
+        auto start = std::chrono::steady_clock::now();
+        if (!load_scene(path.c_str(), scene, error)) {
+            std::fprintf(stderr, "%s\n", error.c_str());
+            ok = false;
+            continue;
+        }
+        Millis load_time = std::chrono::steady_clock::now() - start;
+        std::printf("\nscene:   %s, %d shapes, loaded in %.3f ms\n", path.c_str(), shape_count(scene),
+                    load_time.count());
+        
+        std::string image = scene_paths.size() == 1 && !out_path.empty() ? out_path : image_path_for(path, out_dir);
+        ok = render(scene, job, pool, raster, image) && ok;
+    }
+
+#if RAYTRACE_PROFILER
+    // the profiler keeps the last frames of every scene together
+    if (!trace_path.empty()) {
+        std::vector<StageSummary> stages;
+        frame_profiler().summary(stages);
+        std::printf("\n%-12s %8s %10s %10s %10s\n", "stage", "frames", "min ms", "avg ms", "p99 ms");
+        for (auto& s : stages) {
+            std::printf("%-12s %8d %10.4f %10.4f %10.4f\n", s.name, s.frames, s.min_ms, s.avg_ms, s.p99_ms);
+        }
+        if (!frame_profiler().write_chrome_trace(trace_path.c_str())) {
+            std::fprintf(stderr, "could not write %s\n", trace_path.c_str());
+            return 1;
+        }
+        std::printf("trace:   %s, last %d frames\n", trace_path.c_str(), frame_profiler().frames());
+    }
+#endif
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,142 @@
+#include "area_light.h"
+
+#include <algorithm>
+#include <cmath>
+
+// rows per parallel_for chunk, as in the light map
+static const int BAND_ROWS = 16;
+
+// origins stay this far inside the light's edge, so compute_visibility() still ignores the light itself
+static const double EDGE_INSET = 0.95;
+
+static double fract(double x) {
+    return x - std::floor(x);
+}
+
+Point2D area_light_sample(int k, int offset) {
+    // the R2 sequence from the plastic number, then Shirley's concentric map,
+    // which keeps the strata of the square as rings and wedges of the disc
+    const double g = 1.32471795724474602596;
+    double u = fract(0.5 + k / g + offset * 0.7548776662466927);
+    double v = fract(0.5 + k / (g * g) + offset * 0.5698402909980532);
+    double a = 2 * u - 1, b = 2 * v - 1;
+    if (a == 0 && b == 0) return Point2D(0, 0);
+    const double quarter = 3.14159265358979 / 4;
+    double r, phi;
+    if (std::fabs(a) > std::fabs(b)) {
+        r = a;
+        phi = quarter * (b / a);
+    } else {
+        r = b;
+        phi = 2 * quarter - quarter * (a / b);
+    }
+    return Point2D(r * std::cos(phi), r * std::sin(phi));
+}
+
+void AreaLightMap::resize(int width, int height) {
+    if (width == w && height == h) return;
+    w = std::max(width, 0);
+    h = std::max(height, 0);
+    clear();
+}
+
+void AreaLightMap::clear() {
+    sum.assign((size_t)w * h * 3, 0.0f);
+    pass.assign((size_t)w * h * 3, 0.0f);
+    lights.clear();
+    sample_count = 0;
+    change = 0;
+}
+
+void AreaLightMap::set_camera(const Camera& to) {
+    if (to == view_camera) return;
+    view_camera = to;
+    clear();
+}
+
+bool AreaLightMap::converged(const AreaLightSettings& settings) const {
+    if (sample_count >= settings.max_samples) return true;
+    return sample_count > 0 && change < settings.tolerance;
+}
+
+int AreaLightMap::update(const Scene& scene, const AreaLightSettings& settings, ThreadPool* pool) {
+    const std::vector<int>& ids = scene.lights();
+    bool same = scene.edits.empty() && ids.size() == lights.size();
+    for (size_t k = 0; same && k < ids.size(); k++) {
+        const Shape& s = scene.shapes[ids[k]];
+        const Light& light = lights[k];
+        same = light.pos.x == s.center.x && light.pos.y == s.center.y && light.radius == s.size1 &&
+               light.color.r == s.color.r && light.color.g == s.color.g && light.color.b == s.color.b &&
+               light.intensity == s.intensity;
+    }
+    if (!same) {
+        clear();
+        for (int id : ids) {
+            const Shape& s = scene.shapes[id];
+            lights.push_back(Light{s.center, s.size1, s.color, s.intensity});
+        }
+    }
+    if (converged(settings) || w == 0 || h == 0) return 0;
+    
+    // every new origin's polygon on its own thread, as far as the view needs it
+    int count = std::max(1, std::min(settings.samples_per_frame, settings.max_samples - sample_count));
+    struct Sample {
+        Point2D origin;
+        float color[3];
+        VisibilityPolygon polygon;
+    };
+    Box view = view_camera.view(w, h);
+    std::vector<Sample> samples(lights.size() * count);
+    for (size_t k = 0; k < lights.size(); k++) {
+        const Light& light = lights[k];
+        for (int i = 0; i < count; i++) {
+            Sample& sample = samples[k * count + i];
+            Point2D p = area_light_sample(sample_count + i, (int)k);
+            double r = light.radius * EDGE_INSET;
+            sample.origin = Point2D(light.pos.x + p.x * r, light.pos.y + p.y * r);
+            sample.color[0] = light.color.r * light.intensity;
+            sample.color[1] = light.color.g * light.intensity;
+            sample.color[2] = light.color.b * light.intensity;
+        }
+    }
+    auto visibility = [&](int begin, int end) {
+        for (int i = begin; i < end; i++) scene.visibility_toward(samples[i].origin, view, samples[i].polygon);
+    };
+    if (pool && samples.size() > 1) pool->parallel_for((int)samples.size(), 1, visibility);
+    else visibility(0, (int)samples.size());
+    
+    // Bands of rows add the new samples up, then fold them into the sum and
+    // measure how far that moved the average, so a pass reads every pixel once.
+    int bands = (h + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<double> band_change(bands, 0.0);
+    float old_scale = sample_count ? 1.0f / sample_count : 0.0f, new_scale = 1.0f / (sample_count + count);
+    auto band = [&](int begin, int end) {
+        int row_begin = begin * BAND_ROWS, row_end = std::min(end * BAND_ROWS, h);
+        size_t first = (size_t)row_begin * w * 3, last = (size_t)row_end * w * 3;
+        std::fill(pass.begin() + first, pass.begin() + last, 0.0f);
+        for (auto& sample : samples) {
+            add_lit_region(pass, w, h, sample.polygon.points, sample.origin, sample.color, row_begin, row_end,
+                           view_camera);
+        }
+        double moved = 0;
+        for (size_t i = first; i < last; i++) {
+            float before = sum[i] * old_scale;
+            sum[i] += pass[i];
+            moved += std::fabs(sum[i] * new_scale - before);
+        }
+        band_change[begin] = moved;
+    };
+    if (pool) pool->parallel_for(bands, 1, band);
+    else band(0, bands);
+    
+    double moved = 0;
+    for (double m : band_change) moved += m;
+    change = moved / ((double)w * h * 3 * count);
+    sample_count += count;
+    return count * (int)lights.size();
+}
+
+void AreaLightMap::tone_map(SoftwareRaster& out, ThreadPool* pool) const {
+    if (sample_count == 0) return;
+    tone_map_buffer(sum, 1.0f / sample_count, w, h, out, pool);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include "light_map.h"
+
+// how the area lights are sampled, and when the average counts as done
+struct AreaLightSettings {
+    int samples_per_frame = 4;  // origins per light added on every update
+    int max_samples = 256;      // per light, no more are added past this
+    double tolerance = 0.00002; // or once a sample moves the average less than this per pixel, 0 never
+};
+
+// Soft shadows from lights with a size. Every light is a disc of its radius
+// instead of a point, and the light map is the average over origins spread
+// across that disc, each one's visibility polygon and falloff added in like
+// LightMap does for the center.
+//
+// The average builds up over updates: each adds samples_per_frame more
+// origins per light, so a frame costs the same from the first update to the
+// last and the penumbras smooth out while nothing moves. Any edit to the
+// scene, or a light that moved, changed or came and went, starts it over.
+// The origins follow the R2 low-discrepancy sequence mapped onto the disc,
+// so any number of them covers it evenly, like stratified samples do, and
+// without the clumps of random ones; every light has its own offset into it.
+// Like LightMap it covers what its camera shows and culls to that view.
+class AreaLightMap {
+public:
+    void resize(int width, int height);
+    int width() const { return w; }
+    int height() const { return h; }
+    
+    // drops the average, the next update starts from nothing
+    void clear();
+    
+    // the part of the world the map covers, a different one starts the average over
+    void set_camera(const Camera& to);
+    
+    // adds the next samples per light, returns how many were added over all lights
+    int update(const Scene& scene, const AreaLightSettings& settings, ThreadPool* pool = nullptr);
+    
+    // the average so far, like LightMap::tone_map()
+    void tone_map(SoftwareRaster& out, ThreadPool* pool = nullptr) const;
+    
+    // origins per light in the average
+    int samples() const { return sample_count; }
+    
+    // mean change per pixel and channel each of the last update's samples made to the average, in linear light
+    double last_change() const { return change; }
+    
+    // whether update() would add nothing until the scene changes
+    bool converged(const AreaLightSettings& settings) const;
+
+private:
+    struct Light {
+        Point2D pos;
+        double radius;
+        LightColor color;
+        float intensity;
+    };
+    
+    int w = 0, h = 0;
+    Camera view_camera;
+    std::vector<float> sum, pass;  // linear RGB over all samples so far, and the ones this update adds
+    std::vector<Light> lights;     // as they were when the average started
+    int sample_count = 0;
+    double change = 0;
+};
+
+// where the k-th sample of a light with this `offset` (any value, a light's
+// index say) lands on a unit disc
+Point2D area_light_sample(int k, int offset);
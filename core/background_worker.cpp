@@ -0,0 +1,56 @@
+#include "background_worker.h"
+
+BackgroundWorker::BackgroundWorker() : thread(&BackgroundWorker::loop, this) {}
+
+BackgroundWorker::~BackgroundWorker() {
+    wait();
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+}
+
+bool BackgroundWorker::start(std::function<void()> next, std::function<void()> on_done) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (running.load(std::memory_order_relaxed)) return false;
+        job = std::move(next);
+        done = std::move(on_done);
+        running.store(true, std::memory_order_relaxed);
+    }
+    wake.notify_one();
+    return true;
+}
+
+void BackgroundWorker::wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this] { return !running.load(std::memory_order_relaxed); });
+}
+
+void BackgroundWorker::loop() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+        wake.wait(guard, [this] { return stopping || job; });
+        if (!job) return;
+        
+        std::function<void()> current, notify;
+        current.swap(job);
+        notify.swap(done);
+        guard.unlock();
+        current();
+        guard.lock();
+        
+        // the release pairs with busy(), the job's writes are seen before it reads false
+        running.store(false, std::memory_order_release);
+        finished.notify_all();
+        
+        // after running is cleared, so whoever it wakes can start the next job right away
+        if (notify) {
+            guard.unlock();
+            notify();
+            guard.lock();
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+// One thread that runs one job at a time next to its owner, like casting the
+// next frame's rays while the editor keeps up with the mouse. The owner hands
+// a job over only when the last one is done and reads what it wrote only once
+// busy() says so, so the job's data needs no locking of its own.
+class BackgroundWorker {
+public:
+    BackgroundWorker();
+    ~BackgroundWorker();
+    
+    BackgroundWorker(const BackgroundWorker&) = delete;
+    BackgroundWorker& operator=(const BackgroundWorker&) = delete;
+    
+    // Runs `job` on the worker thread, then `done` there too (to wake the
+    // owner up, say). Returns false without running anything while the last
+    // job is still going.
+    bool start(std::function<void()> job, std::function<void()> done = nullptr);
+    
+    // whether a job is running; false means everything it wrote is visible
+    bool busy() const { return running.load(std::memory_order_acquire); }
+    
+    // blocks until the current job, if any, is done
+    void wait();
+
+private:
+    void loop();
+    
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable wake, finished;
+    std::function<void()> job, done;
+    std::atomic<bool> running{false};
+    bool stopping = false;
+};
@@ -0,0 +1,127 @@
+#include "bounce.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+void BounceStats::clear() {
+    rays.clear();
+    seconds.clear();
+}
+
+void BounceStats::add(int depth, long long count, double time) {
+    if ((int)rays.size() < depth) {
+        rays.resize(depth, 0);
+        seconds.resize(depth, 0);
+    }
+    rays[depth - 1] += count;
+    seconds[depth - 1] += time;
+}
+
+Material material_preset(int index) {
+    switch (index % MATERIAL_PRESETS) {
+        case 1: return Material(0.9f, 1, 1);       // mirror
+        case 2: return Material(0.05f, 1.5f, 0.1f);  // glass
+        default: return Material();
+    }
+}
+
+const char* material_name(int index) {
+    const char* names[] = {"matte", "mirror", "glass"};
+    return names[index % MATERIAL_PRESETS];
+}
+
+// a ray waiting in a generation's queue
+struct QueuedRay {
+    Point2D from, dir;
+    float energy;
+};
+
+struct QueuedHit {
+    double t;
+    int shape;
+};
+
+// the rays a hit sends on, into the next generation's queue
+static void scatter(const Shape& shape, Point2D at, Point2D dir, float energy, float min_energy,
+                    std::vector<QueuedRay>& next) {
+    const Material& m = shape.material;
+    Point2D n = shape.normal_at(at);
+    double cos_in = -(dir.x * n.x + dir.y * n.y);
+    // a segment is a thin sheet, with no inside to bend into
+    bool thin = shape.type == SHAPE_SEGMENT;
+    bool inside = cos_in < 0 && !thin;  // on its way out of the shape
+    if (cos_in < 0) {
+        n = Point2D(-n.x, -n.y);
+        cos_in = -cos_in;
+    }
+    
+    float reflected = m.reflectance;
+    float refracted = (1 - m.reflectance) * (inside ? 1 : 1 - m.absorption);
+    if (refracted > 0) {
+        double eta = thin ? 1 : inside ? m.ior : 1 / m.ior;
+        double k = 1 - eta * eta * (1 - cos_in * cos_in);
+        if (k < 0) {
+            // total internal reflection, nothing gets out
+            reflected += refracted;
+        } else if (energy * refracted >= min_energy) {
+            double bend = eta * cos_in - std::sqrt(k);
+            next.push_back(QueuedRay{at, Point2D(eta * dir.x + bend * n.x, eta * dir.y + bend * n.y), energy * refracted});
+        }
+    }
+    if (energy * reflected >= min_energy) {
+        Point2D mirrored(dir.x + 2 * cos_in * n.x, dir.y + 2 * cos_in * n.y);
+        next.push_back(QueuedRay{at, mirrored, energy * reflected});
+    }
+}
+
+int trace_bounces(const Scene& scene, const std::vector<RayHit>& primary, const BounceSettings& settings, int& budget,
+                  std::vector<RaySegment>& out, BounceStats* stats, ThreadPool* pool) {
+    std::vector<QueuedRay> queue, next;
+    for (auto& hit : primary) {
+        if (hit.shape < 0 || !scene.shapes[hit.shape].material.scatters()) continue;
+        scatter(scene.shapes[hit.shape], hit.end, hit.dir, 1, settings.min_energy, queue);
+    }
+    
+    int cast = 0;
+    std::vector<QueuedHit> hits;
+    for (int depth = 1; depth <= settings.max_depth && !queue.empty() && budget > 0; depth++) {
+        // over budget, the strongest rays go first
+        if ((int)queue.size() > budget) {
+            std::stable_sort(queue.begin(), queue.end(),
+                             [](const QueuedRay& a, const QueuedRay& b) { return a.energy > b.energy; });
+            queue.resize(budget);
+        }
+        int count = (int)queue.size();
+        
+        auto start = std::chrono::steady_clock::now();
+        hits.resize(count);
+        auto cast_range = [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                hits[i].shape = -1;
+                if (!scene.tracer.nearest_hit(queue[i].from, queue[i].dir, hits[i].t, hits[i].shape)) {
+                    hits[i].t = scene.tracer.reach();
+                }
+            }
+        };
+        if (pool) pool->parallel_for(count, std::max(8, count / (pool->thread_count() * 4)), cast_range);
+        else cast_range(0, count);
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+        if (stats) stats->add(depth, count, took.count());
+        cast += count;
+        budget -= count;
+        
+        // every ray becomes a segment, and the ones that hit something scattering go on
+        next.clear();
+        for (int i = 0; i < count; i++) {
+            const QueuedRay& ray = queue[i];
+            Point2D end(ray.from.x + ray.dir.x * hits[i].t, ray.from.y + ray.dir.y * hits[i].t);
+            out.push_back(RaySegment{ray.from, end, ray.energy, depth});
+            if (depth == settings.max_depth || hits[i].shape < 0) continue;
+            const Shape& shape = scene.shapes[hits[i].shape];
+            if (shape.material.scatters()) scatter(shape, end, ray.dir, ray.energy, settings.min_energy, next);
+        }
+        queue.swap(next);
+    }
+    return cast;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include "scene.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+// How far rays are followed past their first hit. The editor changes these at runtime.
+struct BounceSettings {
+    int max_depth = 0;          // bounce generations after the first hit, 0 stops there
+    int budget = 20000;         // most secondary rays one frame may cast, over all lights
+    float min_energy = 0.02f;   // weaker rays aren't followed
+};
+
+// one straight piece of a reflected or refracted ray
+struct RaySegment {
+    Point2D from, to;
+    float energy;  // share of the light's color still in it
+    int depth;     // bounce generation, 1 for the rays leaving a first hit
+};
+
+// rays cast and time spent per bounce generation, index 0 for depth 1
+struct BounceStats {
+    std::vector<long long> rays;
+    std::vector<double> seconds;
+    
+    void clear();
+    void add(int depth, long long count, double time);
+};
+
+// the materials the editor and the CLI hand out, by number
+const int MATERIAL_PRESETS = 3;
+Material material_preset(int index);
+const char* material_name(int index);
+
+// Follows a light's primary hits through reflection and refraction without
+// recursion: every bounce generation is a queue of rays, cast as one batch
+// (split over the pool when there is one), and its hits fill the queue of
+// the next generation. Reflected rays keep the material's reflectance of
+// the energy, refracted ones what isn't reflected or absorbed, bent by Snell's
+// law or reflected too when it can't get out. Generations stop at
+// settings.max_depth, rays below settings.min_energy are dropped, and when a
+// generation doesn't fit in what's left of `budget` only its strongest rays
+// are cast. Appends the segments and returns how many rays were cast.
+int trace_bounces(const Scene& scene, const std::vector<RayHit>& primary, const BounceSettings& settings, int& budget,
+                  std::vector<RaySegment>& out, BounceStats* stats = nullptr, ThreadPool* pool = nullptr);
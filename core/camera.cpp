@@ -0,0 +1,42 @@
+#include "camera.h"
+#include "tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void Camera::zoom_at(Point2D at, double factor) {
+    Point2D anchor = to_world(at);
+    zoom = std::min(std::max(zoom * factor, MIN_ZOOM), MAX_ZOOM);
+    origin = Point2D(anchor.x - at.x / zoom, anchor.y - at.y / zoom);
+}
+
+double ray_reach(Point2D from, const Box& view) {
+    // the nearest point of the view first, then its farthest corner
+    double nx = std::max(view.left - from.x, std::max(0.0, from.x - view.right));
+    double ny = std::max(view.top - from.y, std::max(0.0, from.y - view.bottom));
+    if (nx * nx + ny * ny > RAY_MAX_T * RAY_MAX_T) return 0;
+    double fx = std::max(std::fabs(view.left - from.x), std::fabs(view.right - from.x));
+    double fy = std::max(std::fabs(view.top - from.y), std::fabs(view.bottom - from.y));
+    double farthest = std::sqrt(fx * fx + fy * fy);
+    double reach = RAY_MISS_LENGTH;
+    while (reach < farthest && reach < RAY_MAX_T) reach *= 2;
+    return std::min(reach, RAY_MAX_T);
+}
+
+void CameraBackend::line(Point2D from, Point2D to, Rgb color) {
+    out.line(camera.to_screen(from), camera.to_screen(to), color);
+}
+
+void CameraBackend::fill_circle(Point2D center, double radius, Rgb fill, Rgb outline, int outline_width) {
+    out.fill_circle(camera.to_screen(center), radius * camera.zoom, fill, outline, outline_width);
+}
+
+void CameraBackend::dotted_circle(Point2D center, double radius, Rgb color, int width) {
+    out.dotted_circle(camera.to_screen(center), radius * camera.zoom, color, width);
+}
+
+void CameraBackend::fill_polygon(const std::vector<Point2D>& points, Rgb color) {
+    screen.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) screen[i] = camera.to_screen(points[i]);
+    out.fill_polygon(screen, color);
+}
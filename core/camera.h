@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+#include "geometry.h"
+#include "render_backend.h"
+
+// Where the canvas looks into the world. Shapes, lights and rays all live in
+// world units; a world point p shows up at (p - origin) * zoom on the canvas.
+// The default camera is the identity, world units are canvas pixels.
+struct Camera {
+    Point2D origin;   // the world point at the canvas's top left corner
+    double zoom = 1;  // canvas pixels per world unit
+    
+    Point2D to_screen(Point2D p) const { return Point2D((p.x - origin.x) * zoom, (p.y - origin.y) * zoom); }
+    Point2D to_world(Point2D p) const { return Point2D(origin.x + p.x / zoom, origin.y + p.y / zoom); }
+    Box to_screen(const Box& b) const {
+        return Box{(b.left - origin.x) * zoom, (b.top - origin.y) * zoom, (b.right - origin.x) * zoom,
+                   (b.bottom - origin.y) * zoom};
+    }
+    
+    // the part of the world a width x height canvas shows
+    Box view(int width, int height) const {
+        return Box{origin.x, origin.y, origin.x + width / zoom, origin.y + height / zoom};
+    }
+    
+    // zooms by `factor`, keeping the world point under the canvas point `at` where it is
+    void zoom_at(Point2D at, double factor);
+    
+    // moves the view by a canvas offset, a drag to the right shows more of the left
+    void pan(double dx, double dy) {
+        origin.x -= dx / zoom;
+        origin.y -= dy / zoom;
+    }
+    
+    bool operator==(const Camera& o) const { return origin.x == o.origin.x && origin.y == o.origin.y && zoom == o.zoom; }
+    bool operator!=(const Camera& o) const { return !(*this == o); }
+};
+
+// how far out the camera lets you zoom, and in
+const double MIN_ZOOM = 1.0 / 256;
+const double MAX_ZOOM = 16;
+
+// How far the rays from `from` have to go to cover all of `view`:
+// RAY_MISS_LENGTH, doubled until it gets to the farthest corner, but never
+// past RAY_MAX_T, how far rays look for a hit anyway. 0 when even that
+// doesn't get to the view, nothing cast from there can show up in it.
+double ray_reach(Point2D from, const Box& view);
+
+// Draws in world units into a backend that draws in canvas pixels. Radii
+// scale with the zoom, outline widths stay in pixels. What gets drawn is
+// counted in `out`'s draw_calls.
+class CameraBackend : public RenderBackend {
+public:
+    CameraBackend(RenderBackend& out, const Camera& camera) : out(out), camera(camera) {}
+    
+    bool visible(const Box& box) const override { return out.visible(camera.to_screen(box)); }
+    void fill_rect(const Box& box, Rgb color) override { out.fill_rect(camera.to_screen(box), color); }
+    void line(Point2D from, Point2D to, Rgb color) override;
+    void fill_circle(Point2D center, double radius, Rgb fill, Rgb outline, int outline_width) override;
+    void dotted_circle(Point2D center, double radius, Rgb color, int width) override;
+    void fill_polygon(const std::vector<Point2D>& points, Rgb color) override;
+
+private:
+    RenderBackend& out;
+    Camera camera;
+    std::vector<Point2D> screen;  // reused by fill_polygon
+};
@@ -0,0 +1,378 @@
+#include "circle_store.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CIRCLE_STORE_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+SimdLevel detect_simd_level() {
+#if defined(CIRCLE_STORE_X86)
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    if (max_leaf >= 7) {
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        bool avx = (info[2] & (1 << 28)) != 0;
+        // the OS has to save the ymm registers too, not just the CPU support them
+        if (osxsave && avx && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5)) return SIMD_AVX2;
+        }
+    }
+    return SIMD_SSE2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+    if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+#endif
+    return SIMD_SCALAR;
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+// Every kernel below writes the nearest t < best and its entry for the range
+// [begin, end). The direction is unit length, so the quadratic's `a` is 1 and
+// the half-b form drops the factors of 2 and 4.
+
+static void hit_scalar(const double* cx, const double* cy, const double* r, int begin, int end,
+                       Point2D from, Point2D dir, double& best, int& best_entry) {
+    for (int i = begin; i < end; i++) {
+        double dx = from.x - cx[i], dy = from.y - cy[i];
+        double b = dx * dir.x + dy * dir.y;
+        double c = dx * dx + dy * dy - r[i] * r[i];
+        double disc = b * b - c;
+        if (disc < 0) continue;
+        double sq = std::sqrt(disc);
+        double t = -b - sq;
+        if (t <= HIT_EPSILON) t = -b + sq;
+        if (t > HIT_EPSILON && t < best) {
+            best = t;
+            best_entry = i;
+        }
+    }
+}
+
+// the float and fixed-point loop, in the form that keeps 16.16 in range
+template <typename Scalar>
+static void hit_scalar(const Scalar* cx, const Scalar* cy, const Scalar* r, int begin, int end,
+                       Point2D from, Point2D dir, Scalar& best, int& best_entry) {
+    typedef ScalarTraits<Scalar> Traits;
+    // an origin the type can't place sees no circles rather than the wrong ones
+    if (!(std::fabs(from.x) <= Traits::range() && std::fabs(from.y) <= Traits::range())) return;
+    BasicPoint2D<Scalar> o(Traits::from_double(from.x), Traits::from_double(from.y));
+    BasicPoint2D<Scalar> d(Traits::from_double(dir.x), Traits::from_double(dir.y));
+    Scalar eps = Traits::from_double(HIT_EPSILON);
+    for (int i = begin; i < end; i++) {
+        Scalar t;
+        if (ray_circle(o, d, BasicPoint2D<Scalar>(cx[i], cy[i]), r[i], eps, t) && t < best) {
+            best = t;
+            best_entry = i;
+        }
+    }
+}
+
+// picking the nearest of the lane results, lower entry wins a tie like the scalar loop
+template <typename Scalar>
+static void reduce_lanes(const Scalar* lane_t, const Scalar* lane_entry, int lanes,
+                         Scalar& best, int& best_entry) {
+    for (int l = 0; l < lanes; l++) {
+        if (lane_entry[l] < 0) continue;
+        int entry = (int)lane_entry[l];
+        if (lane_t[l] < best || (lane_t[l] == best && entry < best_entry)) {
+            best = lane_t[l];
+            best_entry = entry;
+        }
+    }
+}
+
+#if defined(CIRCLE_STORE_X86)
+
+TARGET_SSE2 static __m128d select_sse2(__m128d mask, __m128d yes, __m128d no) {
+    return _mm_or_pd(_mm_and_pd(mask, yes), _mm_andnot_pd(mask, no));
+}
+
+TARGET_SSE2 static int hit_sse2(const double* cx, const double* cy, const double* r, int count,
+                                Point2D from, Point2D dir, double& best, int& best_entry) {
+    __m128d ox = _mm_set1_pd(from.x), oy = _mm_set1_pd(from.y);
+    __m128d dir_x = _mm_set1_pd(dir.x), dir_y = _mm_set1_pd(dir.y);
+    __m128d eps = _mm_set1_pd(HIT_EPSILON), zero = _mm_setzero_pd();
+    __m128d lane_best = _mm_set1_pd(best), lane_entry = _mm_set1_pd(-1);
+    __m128d entry = _mm_set_pd(1, 0), step = _mm_set1_pd(2);
+    
+    int i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128d dx = _mm_sub_pd(ox, _mm_loadu_pd(cx + i));
+        __m128d dy = _mm_sub_pd(oy, _mm_loadu_pd(cy + i));
+        __m128d rr = _mm_loadu_pd(r + i);
+        __m128d b = _mm_add_pd(_mm_mul_pd(dx, dir_x), _mm_mul_pd(dy, dir_y));
+        __m128d c = _mm_sub_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(rr, rr));
+        __m128d disc = _mm_sub_pd(_mm_mul_pd(b, b), c);
+        __m128d ok = _mm_cmpge_pd(disc, zero);
+        __m128d sq = _mm_sqrt_pd(_mm_max_pd(disc, zero));
+        __m128d near_t = _mm_sub_pd(_mm_sub_pd(zero, b), sq);
+        __m128d far_t = _mm_add_pd(_mm_sub_pd(zero, b), sq);
+        __m128d t = select_sse2(_mm_cmpgt_pd(near_t, eps), near_t, far_t);
+        ok = _mm_and_pd(ok, _mm_and_pd(_mm_cmpgt_pd(t, eps), _mm_cmplt_pd(t, lane_best)));
+        lane_best = select_sse2(ok, t, lane_best);
+        lane_entry = select_sse2(ok, entry, lane_entry);
+        entry = _mm_add_pd(entry, step);
+    }
+    
+    double lane_t[2], lane_i[2];
+    _mm_storeu_pd(lane_t, lane_best);
+    _mm_storeu_pd(lane_i, lane_entry);
+    reduce_lanes(lane_t, lane_i, 2, best, best_entry);
+    return i;
+}
+
+TARGET_AVX2 static int hit_avx2(const double* cx, const double* cy, const double* r, int count,
+                                Point2D from, Point2D dir, double& best, int& best_entry) {
+    __m256d ox = _mm256_set1_pd(from.x), oy = _mm256_set1_pd(from.y);
+    __m256d dir_x = _mm256_set1_pd(dir.x), dir_y = _mm256_set1_pd(dir.y);
+    __m256d eps = _mm256_set1_pd(HIT_EPSILON), zero = _mm256_setzero_pd();
+    __m256d lane_best = _mm256_set1_pd(best), lane_entry = _mm256_set1_pd(-1);
+    __m256d entry = _mm256_set_pd(3, 2, 1, 0), step = _mm256_set1_pd(4);
+    
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d dx = _mm256_sub_pd(ox, _mm256_loadu_pd(cx + i));
+        __m256d dy = _mm256_sub_pd(oy, _mm256_loadu_pd(cy + i));
+        __m256d rr = _mm256_loadu_pd(r + i);
+        __m256d b = _mm256_add_pd(_mm256_mul_pd(dx, dir_x), _mm256_mul_pd(dy, dir_y));
+        __m256d c = _mm256_sub_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)), _mm256_mul_pd(rr, rr));
+        __m256d disc = _mm256_sub_pd(_mm256_mul_pd(b, b), c);
+        __m256d ok = _mm256_cmp_pd(disc, zero, _CMP_GE_OQ);
+        __m256d sq = _mm256_sqrt_pd(_mm256_max_pd(disc, zero));
+        __m256d near_t = _mm256_sub_pd(_mm256_sub_pd(zero, b), sq);
+        __m256d far_t = _mm256_add_pd(_mm256_sub_pd(zero, b), sq);
+        __m256d t = _mm256_blendv_pd(far_t, near_t, _mm256_cmp_pd(near_t, eps, _CMP_GT_OQ));
+        ok = _mm256_and_pd(ok, _mm256_and_pd(_mm256_cmp_pd(t, eps, _CMP_GT_OQ), _mm256_cmp_pd(t, lane_best, _CMP_LT_OQ)));
+        lane_best = _mm256_blendv_pd(lane_best, t, ok);
+        lane_entry = _mm256_blendv_pd(lane_entry, entry, ok);
+        entry = _mm256_add_pd(entry, step);
+    }
+    
+    double lane_t[4], lane_i[4];
+    _mm256_storeu_pd(lane_t, lane_best);
+    _mm256_storeu_pd(lane_i, lane_entry);
+    reduce_lanes(lane_t, lane_i, 4, best, best_entry);
+    return i;
+}
+
+// The float kernels use the same distance form as hit_scalar() above, 4 and
+// 8 circles at a time. Entries ride along as floats, exact below 2^24.
+
+TARGET_SSE2 static int hit_sse2(const float* cx, const float* cy, const float* r, int count,
+                                Point2D from, Point2D dir, float& best, int& best_entry) {
+    __m128 ox = _mm_set1_ps((float)from.x), oy = _mm_set1_ps((float)from.y);
+    __m128 dir_x = _mm_set1_ps((float)dir.x), dir_y = _mm_set1_ps((float)dir.y);
+    __m128 eps = _mm_set1_ps((float)HIT_EPSILON), zero = _mm_setzero_ps();
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 lane_best = _mm_set1_ps(best), lane_entry = _mm_set1_ps(-1);
+    __m128 entry = _mm_set_ps(3, 2, 1, 0), step = _mm_set1_ps(4);
+    
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 mx = _mm_sub_ps(ox, _mm_loadu_ps(cx + i));
+        __m128 my = _mm_sub_ps(oy, _mm_loadu_ps(cy + i));
+        __m128 rr = _mm_loadu_ps(r + i);
+        __m128 h = _mm_sub_ps(_mm_mul_ps(mx, dir_y), _mm_mul_ps(my, dir_x));
+        __m128 ok = _mm_cmple_ps(_mm_andnot_ps(sign, h), rr);
+        __m128 b = _mm_add_ps(_mm_mul_ps(mx, dir_x), _mm_mul_ps(my, dir_y));
+        __m128 s = _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(rr, h), _mm_add_ps(rr, h)), zero));
+        __m128 near_t = _mm_sub_ps(_mm_sub_ps(zero, b), s);
+        __m128 far_t = _mm_sub_ps(s, b);
+        __m128 near_ok = _mm_cmpgt_ps(near_t, eps);
+        __m128 t = _mm_or_ps(_mm_and_ps(near_ok, near_t), _mm_andnot_ps(near_ok, far_t));
+        ok = _mm_and_ps(ok, _mm_and_ps(_mm_cmpgt_ps(t, eps), _mm_cmplt_ps(t, lane_best)));
+        lane_best = _mm_or_ps(_mm_and_ps(ok, t), _mm_andnot_ps(ok, lane_best));
+        lane_entry = _mm_or_ps(_mm_and_ps(ok, entry), _mm_andnot_ps(ok, lane_entry));
+        entry = _mm_add_ps(entry, step);
+    }
+    
+    float lane_t[4], lane_i[4];
+    _mm_storeu_ps(lane_t, lane_best);
+    _mm_storeu_ps(lane_i, lane_entry);
+    reduce_lanes(lane_t, lane_i, 4, best, best_entry);
+    return i;
+}
+
+TARGET_AVX2 static int hit_avx2(const float* cx, const float* cy, const float* r, int count,
+                                Point2D from, Point2D dir, float& best, int& best_entry) {
+    __m256 ox = _mm256_set1_ps((float)from.x), oy = _mm256_set1_ps((float)from.y);
+    __m256 dir_x = _mm256_set1_ps((float)dir.x), dir_y = _mm256_set1_ps((float)dir.y);
+    __m256 eps = _mm256_set1_ps((float)HIT_EPSILON), zero = _mm256_setzero_ps();
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 lane_best = _mm256_set1_ps(best), lane_entry = _mm256_set1_ps(-1);
+    __m256 entry = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0), step = _mm256_set1_ps(8);
+    
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 mx = _mm256_sub_ps(ox, _mm256_loadu_ps(cx + i));
+        __m256 my = _mm256_sub_ps(oy, _mm256_loadu_ps(cy + i));
+        __m256 rr = _mm256_loadu_ps(r + i);
+        __m256 h = _mm256_sub_ps(_mm256_mul_ps(mx, dir_y), _mm256_mul_ps(my, dir_x));
+        __m256 ok = _mm256_cmp_ps(_mm256_andnot_ps(sign, h), rr, _CMP_LE_OQ);
+        __m256 b = _mm256_add_ps(_mm256_mul_ps(mx, dir_x), _mm256_mul_ps(my, dir_y));
+        __m256 s = _mm256_sqrt_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(rr, h), _mm256_add_ps(rr, h)), zero));
+        __m256 near_t = _mm256_sub_ps(_mm256_sub_ps(zero, b), s);
+        __m256 far_t = _mm256_sub_ps(s, b);
+        __m256 t = _mm256_blendv_ps(far_t, near_t, _mm256_cmp_ps(near_t, eps, _CMP_GT_OQ));
+        ok = _mm256_and_ps(ok, _mm256_and_ps(_mm256_cmp_ps(t, eps, _CMP_GT_OQ), _mm256_cmp_ps(t, lane_best, _CMP_LT_OQ)));
+        lane_best = _mm256_blendv_ps(lane_best, t, ok);
+        lane_entry = _mm256_blendv_ps(lane_entry, entry, ok);
+        entry = _mm256_add_ps(entry, step);
+    }
+    
+    float lane_t[8], lane_i[8];
+    _mm256_storeu_ps(lane_t, lane_best);
+    _mm256_storeu_ps(lane_i, lane_entry);
+    reduce_lanes(lane_t, lane_i, 8, best, best_entry);
+    return i;
+}
+
+#endif
+
+// the widest kernel the level allows, returns how many entries it covered
+static int hit_vector(SimdLevel level, const double* cx, const double* cy, const double* r, int count,
+                      Point2D from, Point2D dir, double& best, int& best_entry) {
+#if defined(CIRCLE_STORE_X86)
+    if (level == SIMD_AVX2) return hit_avx2(cx, cy, r, count, from, dir, best, best_entry);
+    if (level == SIMD_SSE2) return hit_sse2(cx, cy, r, count, from, dir, best, best_entry);
+#else
+    (void)level; (void)cx; (void)cy; (void)r; (void)count; (void)from; (void)dir; (void)best; (void)best_entry;
+#endif
+    return 0;
+}
+
+static int hit_vector(SimdLevel level, const float* cx, const float* cy, const float* r, int count,
+                      Point2D from, Point2D dir, float& best, int& best_entry) {
+#if defined(CIRCLE_STORE_X86)
+    if (count >= (1 << 24)) return 0;
+    if (level == SIMD_AVX2) return hit_avx2(cx, cy, r, count, from, dir, best, best_entry);
+    if (level == SIMD_SSE2) return hit_sse2(cx, cy, r, count, from, dir, best, best_entry);
+#else
+    (void)level; (void)cx; (void)cy; (void)r; (void)count; (void)from; (void)dir; (void)best; (void)best_entry;
+#endif
+    return 0;
+}
+
+// no vector kernel for 16.16, it runs the scalar loop
+static int hit_vector(SimdLevel, const Fixed16*, const Fixed16*, const Fixed16*, int, Point2D, Point2D,
+                      Fixed16&, int&) {
+    return 0;
+}
+
+template <typename Scalar>
+BasicCircleStore<Scalar>::BasicCircleStore(const std::vector<Shape>& shapes)
+    : shapes(shapes), simd(detect_simd_level()) {}
+
+template <typename Scalar>
+void BasicCircleStore<Scalar>::rebuild() {
+    cx.clear(); cy.clear(); r.clear(); owner.clear();
+    slot.assign(shapes.size(), -1);
+    for (int i = 0; i < (int)shapes.size(); i++) append(i);
+}
+
+template <typename Scalar>
+void BasicCircleStore<Scalar>::insert(int index) {
+    if (index != (int)slot.size()) { rebuild(); return; }
+    slot.push_back(-1);
+    append(index);
+}
+
+template <typename Scalar>
+void BasicCircleStore<Scalar>::update(int index) {
+    int e = slot[index];
+    if (e < 0) return;
+    store(e, shapes[index]);
+}
+
+template <typename Scalar>
+void BasicCircleStore<Scalar>::erase(int index) {
+    // filling the hole with the last entry so the arrays stay packed
+    int e = slot[index];
+    if (e >= 0) {
+        int last = (int)cx.size() - 1;
+        cx[e] = cx[last]; cy[e] = cy[last]; r[e] = r[last]; owner[e] = owner[last];
+        slot[owner[e]] = e;
+        cx.pop_back(); cy.pop_back(); r.pop_back(); owner.pop_back();
+    }
+    
+    // and the last shape's entry now belongs to the erased one's index
+    int last = (int)slot.size() - 1;
+    if (index != last) {
+        slot[index] = slot[last];
+        if (slot[index] >= 0) owner[slot[index]] = index;
+    }
+    slot.pop_back();
+}
+
+template <typename Scalar>
+bool BasicCircleStore<Scalar>::nearest_hit(Point2D from, Point2D dir, double max_t, double& t, int& hit_index) const {
+    return nearest_hit(simd, from, dir, max_t, t, hit_index);
+}
+
+template <typename Scalar>
+bool BasicCircleStore<Scalar>::nearest_hit(SimdLevel level, Point2D from, Point2D dir, double max_t,
+                                           double& t, int& hit_index) const {
+    int count = (int)cx.size();
+    Scalar best = ScalarTraits<Scalar>::from_double(max_t);
+    int best_entry = -1;
+    int done = hit_vector(level, cx.data(), cy.data(), r.data(), count, from, dir, best, best_entry);
+    // whatever didn't fill a whole vector
+    hit_scalar(cx.data(), cy.data(), r.data(), done, count, from, dir, best, best_entry);
+    
+    if (best_entry < 0) return false;
+    t = ScalarTraits<Scalar>::to_double(best);
+    hit_index = owner[best_entry];
+    return true;
+}
+
+template <typename Scalar>
+void BasicCircleStore<Scalar>::append(int index) {
+    const Shape& s = shapes[index];
+    if (s.is_light || s.type != SHAPE_CIRCLE) return;
+    slot[index] = (int)cx.size();
+    cx.emplace_back(); cy.emplace_back(); r.emplace_back();
+    owner.push_back(index);
+    store(slot[index], s);
+}
+
+template <typename Scalar>
+void BasicCircleStore<Scalar>::store(int entry, const Shape& s) {
+    typedef ScalarTraits<Scalar> Traits;
+    cx[entry] = Traits::from_double(s.center.x);
+    cy[entry] = Traits::from_double(s.center.y);
+    // a circle past the type's range goes in with radius -1, which ray_circle
+    // never hits, instead of turning up where the saturated center puts it
+    bool fits = std::fabs(s.center.x) <= Traits::range() && std::fabs(s.center.y) <= Traits::range() &&
+                s.size1 <= Traits::range();
+    r[entry] = Traits::from_double(fits ? s.size1 : -1);
+}
+
+template class BasicCircleStore<double>;
+template class BasicCircleStore<float>;
+template class BasicCircleStore<Fixed16>;
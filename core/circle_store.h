@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "geometry.h"
+
+// Which batch kernel nearest_hit() runs on this CPU.
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE2,   // 2 circles per instruction
+    SIMD_AVX2    // 4 circles per instruction
+};
+
+SimdLevel detect_simd_level();
+const char* simd_level_name(SimdLevel level);
+
+// Structure-of-arrays copy of the circles in the shape vector. Centers and
+// radii sit in their own arrays so the kernel can load several circles at
+// once. Like SpatialGrid it has to hear about every add, move and erase.
+//
+// Scalar is what the arrays hold and the kernel computes in: double, float
+// (twice the circles per instruction) or Fixed16 (scalar only, and the
+// scene has to fit in +-8192, see ScalarTraits::range(): circles and ray
+// origins past it are never hit). Rays still come in and go out as double.
+template <typename Scalar>
+class BasicCircleStore {
+public:
+    explicit BasicCircleStore(const std::vector<Shape>& shapes);
+    
+    void rebuild();
+    void insert(int index);   // shapes[index] was just added
+    void update(int index);   // shapes[index] moved or resized
+    void erase(int index);    // shapes[index] was erased, the last shape moved into its place
+    
+    // nearest circle hit with t < max_t, hit_index is the index in the shape vector
+    bool nearest_hit(Point2D from, Point2D dir, double max_t, double& t, int& hit_index) const;
+    bool nearest_hit(SimdLevel level, Point2D from, Point2D dir, double max_t, double& t, int& hit_index) const;
+    
+    int size() const { return (int)cx.size(); }
+    SimdLevel level() const { return simd; }
+
+private:
+    void append(int index);
+    void store(int entry, const Shape& s);
+    
+    const std::vector<Shape>& shapes;
+    std::vector<Scalar> cx, cy, r;
+    std::vector<int> owner;   // shape index of every entry
+    std::vector<int> slot;    // entry of every shape index, -1 when it isn't stored
+    SimdLevel simd;
+};
+
+using CircleStore = BasicCircleStore<double>;
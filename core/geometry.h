@@ -0,0 +1,304 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "scalar.h"
+
+// a point or direction in any of the scalar types in scalar.h, everything
+// outside the ray kernels uses the double one
+template <typename T>
+struct BasicPoint2D {
+    T x, y;
+    BasicPoint2D(T x = T(), T y = T()) : x(x), y(y) {}
+};
+
+using Point2D = BasicPoint2D<double>;
+
+// an axis-aligned area, right and bottom excluded; canvas pixels or world units, whichever side of the camera it's on
+struct Box {
+    double left, top, right, bottom;
+};
+
+enum ShapeType {
+    SHAPE_CIRCLE,   // size1 is the radius
+    SHAPE_SEGMENT,  // size1 is half the length, turned by angle
+    SHAPE_RECT,     // size1 and size2 are half the width and height, turned by angle
+    SHAPE_POLYGON   // convex, the corners are in vertices
+};
+
+// most corners a polygon may have, so the intersection kernels can use fixed-size records
+const int MAX_POLYGON_VERTICES = 8;
+
+// a segment has no area, clicks this close to it still pick it
+const double SEGMENT_PICK_DISTANCE = 4;
+
+// same self-hit epsilon everywhere a ray is tested against a shape
+const double HIT_EPSILON = 0.001;
+
+// what a light shines with, channels from 0 to 1; the default is the editor's warm yellow
+struct LightColor {
+    float r = 1, g = 240 / 255.0f, b = 100 / 255.0f;
+    LightColor() {}
+    LightColor(float r, float g, float b) : r(r), g(g), b(b) {}
+};
+
+// What a shape does with a ray that hits it. The default is opaque and
+// matte, the ray simply stops there.
+struct Material {
+    float reflectance = 0;  // share of the ray mirrored off the surface
+    float ior = 1;          // index of refraction for what goes through
+    float absorption = 1;   // share of the rest absorbed on the way in, 1 is opaque
+    Material() {}
+    Material(float reflectance, float ior, float absorption)
+        : reflectance(reflectance), ior(ior), absorption(absorption) {}
+    
+    // whether a hit can send anything further, otherwise the ray ends there
+    bool scatters() const { return reflectance > 0 || absorption < 1; }
+};
+
+struct Shape {
+    ShapeType type;
+    Point2D center;
+    double size1, size2;
+    bool is_light;
+    LightColor color;       // only used by lights
+    float intensity = 1;    // only used by lights
+    Material material;      // only used by occluders
+    double angle = 0;       // radians, only used by segments and rectangles
+    std::vector<Point2D> vertices;  // polygon corners relative to the center, in increasing angle
+    Point2D velocity;       // world units per second, what Simulation moves it by
+    
+    Shape(ShapeType t, Point2D c, double s1, double s2 = 0, bool light = false) 
+        : type(t), center(c), size1(s1), size2(s2), is_light(light) {}
+    
+    bool intersects_ray(Point2D from, Point2D direction, double& t) const;
+    bool contains_point(Point2D p) const;
+    
+    // radius of the circle that encloses the shape, what the collision code compares
+    double bounding_radius() const;
+    
+    // the corners in canvas coordinates, in increasing angle around the
+    // center; a segment's two ends, nothing for a circle
+    void outline(std::vector<Point2D>& out) const;
+    
+    // unit normal of the side `p` lies on, pointing out of the shape
+    Point2D normal_at(Point2D p) const;
+    
+    // bigger or smaller around the center until the bounding radius is `radius`
+    void resize(double radius);
+    void rotate(double by);
+};
+
+// a regular polygon with `sides` corners on a circle of `radius`, the first one at `angle`
+inline Shape make_regular_polygon(Point2D center, double radius, int sides, double angle = 0) {
+    Shape s(SHAPE_POLYGON, center, 0);
+    sides = std::min(std::max(sides, 3), MAX_POLYGON_VERTICES);
+    for (int i = 0; i < sides; i++) {
+        double a = angle + i * 2 * 3.14159265359 / sides;
+        s.vertices.push_back(Point2D(std::cos(a) * radius, std::sin(a) * radius));
+    }
+    return s;
+}
+
+// twice the signed area, positive when the corners go in increasing angle
+inline double polygon_area2(const std::vector<Point2D>& points) {
+    double sum = 0;
+    for (size_t i = 0; i < points.size(); i++) {
+        const Point2D& a = points[i];
+        const Point2D& b = points[(i + 1) % points.size()];
+        sum += a.x * b.y - b.x * a.y;
+    }
+    return sum;
+}
+
+// Where a ray enters a convex region given as half-planes n.p <= d, or
+// leaves it when it starts inside. The normals needn't be unit length.
+inline bool ray_convex(const double* nx, const double* ny, const double* d, int count, Point2D from, Point2D dir,
+                       double& t) {
+    double t_enter = -1e300, t_exit = 1e300;
+    for (int k = 0; k < count; k++) {
+        double num = d[k] - (nx[k] * from.x + ny[k] * from.y);
+        double den = nx[k] * dir.x + ny[k] * dir.y;
+        if (den == 0) {
+            if (num < 0) return false;
+        } else if (den > 0) {
+            t_exit = std::min(t_exit, num / den);
+        } else {
+            t_enter = std::max(t_enter, num / den);
+        }
+    }
+    if (t_enter > t_exit) return false;
+    if (t_enter > HIT_EPSILON) { t = t_enter; return true; }
+    if (t_exit > HIT_EPSILON && t_exit < 1e300) { t = t_exit; return true; }
+    return false;
+}
+
+// the segment from a to a + e, hit from either side
+inline bool ray_segment(Point2D a, Point2D e, Point2D from, Point2D dir, double& t) {
+    double den = dir.x * e.y - dir.y * e.x;
+    if (den == 0) return false;
+    double wx = a.x - from.x, wy = a.y - from.y;
+    double hit_t = (wx * e.y - wy * e.x) / den;
+    double along = (wx * dir.y - wy * dir.x) / den;
+    if (hit_t <= HIT_EPSILON || along < 0 || along > 1) return false;
+    t = hit_t;
+    return true;
+}
+
+// the box from -hw to hw and -hh to hh around the origin
+inline bool ray_box(double hw, double hh, Point2D from, Point2D dir, double& t) {
+    const double nx[4] = {1, -1, 0, 0}, ny[4] = {0, 0, 1, -1}, d[4] = {hw, hw, hh, hh};
+    return ray_convex(nx, ny, d, 4, from, dir, t);
+}
+
+// A circle in any scalar type, for the float and fixed-point kernels. It goes
+// through the ray's distance h from the center instead of the quadratic, so
+// every value stays a length on the canvas (16.16 can't hold a squared
+// coordinate) and nothing cancels for a far circle in float. dir is unit length.
+template <typename T>
+inline bool ray_circle(BasicPoint2D<T> from, BasicPoint2D<T> dir, BasicPoint2D<T> center, T radius, T epsilon, T& t) {
+    T mx = from.x - center.x, my = from.y - center.y;
+    T h = mx * dir.y - my * dir.x;
+    if (h > radius || -h > radius) return false;
+    T b = mx * dir.x + my * dir.y;
+    T s = ScalarTraits<T>::sqrt_product(radius - h, radius + h);
+    T near_t = -b - s;
+    t = near_t > epsilon ? near_t : s - b;
+    return t > epsilon;
+}
+
+inline double Shape::bounding_radius() const {
+    switch (type) {
+        case SHAPE_SEGMENT: return size1;
+        case SHAPE_RECT: return std::sqrt(size1 * size1 + size2 * size2);
+        case SHAPE_POLYGON: {
+            double r2 = 0;
+            for (const Point2D& v : vertices) r2 = std::max(r2, v.x * v.x + v.y * v.y);
+            return std::sqrt(r2);
+        }
+        default: return size1;
+    }
+}
+
+inline void Shape::outline(std::vector<Point2D>& out) const {
+    out.clear();
+    double c = std::cos(angle), s = std::sin(angle);
+    auto turned = [&](double x, double y) { return Point2D(center.x + x * c - y * s, center.y + x * s + y * c); };
+    if (type == SHAPE_SEGMENT) {
+        out.push_back(turned(-size1, 0));
+        out.push_back(turned(size1, 0));
+    } else if (type == SHAPE_RECT) {
+        out.push_back(turned(-size1, -size2));
+        out.push_back(turned(size1, -size2));
+        out.push_back(turned(size1, size2));
+        out.push_back(turned(-size1, size2));
+    } else if (type == SHAPE_POLYGON) {
+        for (const Point2D& v : vertices) out.push_back(Point2D(center.x + v.x, center.y + v.y));
+    }
+}
+
+inline Point2D Shape::normal_at(Point2D p) const {
+    double dx = p.x - center.x, dy = p.y - center.y;
+    if (type == SHAPE_CIRCLE) return Point2D(dx / size1, dy / size1);
+    double c = std::cos(angle), s = std::sin(angle);
+    if (type == SHAPE_SEGMENT) return Point2D(-s, c);
+    if (type == SHAPE_RECT) {
+        // the side whose line the point is closest to, in the rectangle's own frame
+        double lx = dx * c + dy * s, ly = -dx * s + dy * c;
+        if (std::fabs(lx) - size1 > std::fabs(ly) - size2) return lx > 0 ? Point2D(c, s) : Point2D(-c, -s);
+        return ly > 0 ? Point2D(-s, c) : Point2D(s, -c);
+    }
+    // the polygon edge the point is the least inside of
+    Point2D best(1, 0);
+    double best_distance = -1e300;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Point2D& a = vertices[i];
+        const Point2D& b = vertices[(i + 1) % vertices.size()];
+        double nx = b.y - a.y, ny = a.x - b.x, length = std::sqrt(nx * nx + ny * ny);
+        if (length == 0) continue;
+        double distance = (nx * (dx - a.x) + ny * (dy - a.y)) / length;
+        if (distance > best_distance) {
+            best_distance = distance;
+            best = Point2D(nx / length, ny / length);
+        }
+    }
+    return best;
+}
+
+inline void Shape::resize(double radius) {
+    // a circle's radius is set as is, so it reads back exactly
+    if (type == SHAPE_CIRCLE) { size1 = radius; return; }
+    double factor = radius / bounding_radius();
+    size1 *= factor;
+    size2 *= factor;
+    for (Point2D& v : vertices) v = Point2D(v.x * factor, v.y * factor);
+}
+
+inline void Shape::rotate(double by) {
+    angle += by;
+    double c = std::cos(by), s = std::sin(by);
+    for (Point2D& v : vertices) v = Point2D(v.x * c - v.y * s, v.x * s + v.y * c);
+}
+
+inline bool Shape::intersects_ray(Point2D from, Point2D direction, double& t) const {
+    if (type != SHAPE_CIRCLE) {
+        // the others in their own frame, or through their edges' half-planes
+        double c = std::cos(angle), s = std::sin(angle);
+        if (type == SHAPE_SEGMENT) {
+            Point2D a(center.x - size1 * c, center.y - size1 * s);
+            return ray_segment(a, Point2D(2 * size1 * c, 2 * size1 * s), from, direction, t);
+        }
+        if (type == SHAPE_RECT) {
+            double dx = from.x - center.x, dy = from.y - center.y;
+            Point2D local(dx * c + dy * s, -dx * s + dy * c);
+            Point2D local_dir(direction.x * c + direction.y * s, -direction.x * s + direction.y * c);
+            return ray_box(size1, size2, local, local_dir, t);
+        }
+        double nx[MAX_POLYGON_VERTICES], ny[MAX_POLYGON_VERTICES], d[MAX_POLYGON_VERTICES];
+        int count = std::min((int)vertices.size(), MAX_POLYGON_VERTICES);
+        for (int i = 0; i < count; i++) {
+            const Point2D& a = vertices[i];
+            const Point2D& b = vertices[(i + 1) % count];
+            nx[i] = b.y - a.y;
+            ny[i] = a.x - b.x;
+            d[i] = nx[i] * (center.x + a.x) + ny[i] * (center.y + a.y);
+        }
+        return ray_convex(nx, ny, d, count, from, direction, t);
+    }
+    
+    // checking if a ray hits our circle
+    double dx = from.x - center.x;
+    double dy = from.y - center.y;
+    double a = direction.x * direction.x + direction.y * direction.y;
+    double b = 2 * (dx * direction.x + dy * direction.y);
+    double c = dx * dx + dy * dy - size1 * size1;
+    double discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) return false;
+    double sqrt_d = std::sqrt(discriminant);
+    double t1 = (-b - sqrt_d) / (2 * a);
+    if (t1 > HIT_EPSILON) { t = t1; return true; }
+    double t2 = (-b + sqrt_d) / (2 * a);
+    if (t2 > HIT_EPSILON) { t = t2; return true; }
+    return false;
+}
+
+inline bool Shape::contains_point(Point2D p) const {
+    // is the point inside our circle?
+    double dx = p.x - center.x, dy = p.y - center.y;
+    if (type == SHAPE_CIRCLE) return (dx * dx + dy * dy) <= (size1 * size1);
+    
+    double c = std::cos(angle), s = std::sin(angle);
+    double lx = dx * c + dy * s, ly = -dx * s + dy * c;
+    if (type == SHAPE_SEGMENT) {
+        double along = std::max(-size1, std::min(size1, lx));
+        return (lx - along) * (lx - along) + ly * ly <= SEGMENT_PICK_DISTANCE * SEGMENT_PICK_DISTANCE;
+    }
+    if (type == SHAPE_RECT) return std::fabs(lx) <= size1 && std::fabs(ly) <= size2;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Point2D& a = vertices[i];
+        const Point2D& b = vertices[(i + 1) % vertices.size()];
+        if ((b.y - a.y) * (dx - a.x) + (a.x - b.x) * (dy - a.y) > 0) return false;
+    }
+    return !vertices.empty();
+}
@@ -0,0 +1,241 @@
+#include "light_map.h"
+
+#include <algorithm>
+#include <cmath>
+#include "scanline.h"
+
+// after this many lights were taken out of the sums, start them over from zero
+static const int MAX_SUBTRACTIONS = 256;
+
+// rows per parallel_for chunk when adding up or tone mapping
+static const int BAND_ROWS = 16;
+
+// how far the polygon's chords can sit from the true arcs, plus a pixel of slack
+static const double EDIT_SLACK = 1.5;
+
+static double distance_to_segment(Point2D p, Point2D a, Point2D b) {
+    double dx = b.x - a.x, dy = b.y - a.y;
+    double length = dx * dx + dy * dy;
+    double t = length > 0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / length : 0;
+    t = std::max(0.0, std::min(1.0, t));
+    return std::hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+static bool inside_polygon(Point2D p, const std::vector<Point2D>& points) {
+    bool inside = false;
+    for (size_t i = 0, j = points.size() - 1; i < points.size(); j = i++) {
+        const Point2D& a = points[i];
+        const Point2D& b = points[j];
+        if ((a.y > p.y) != (b.y > p.y) && p.x < (b.x - a.x) * (p.y - a.y) / (b.y - a.y) + a.x) inside = !inside;
+    }
+    return inside;
+}
+
+// Can the edited circle have changed this lit region? Only if it reaches into
+// it or touches its boundary, a circle entirely in shadow changes nothing.
+static bool edit_touches(const SceneEdit& edit, const VisibilityPolygon& polygon) {
+    if (std::isinf(edit.radius)) return true;
+    if (edit.radius <= 0) return false;
+    const std::vector<Point2D>& points = polygon.points;
+    if (points.size() < 3) return true;
+    double r = edit.radius + EDIT_SLACK;
+    
+    double left = points[0].x, right = left, top = points[0].y, bottom = top;
+    for (auto& p : points) {
+        left = std::min(left, p.x);
+        right = std::max(right, p.x);
+        top = std::min(top, p.y);
+        bottom = std::max(bottom, p.y);
+    }
+    if (edit.center.x + r < left || edit.center.x - r > right || edit.center.y + r < top || edit.center.y - r > bottom) {
+        return false;
+    }
+    
+    if (inside_polygon(edit.center, points)) return true;
+    for (size_t i = 0; i < points.size(); i++) {
+        if (distance_to_segment(edit.center, points[i], points[(i + 1) % points.size()]) < r) return true;
+    }
+    return false;
+}
+
+void LightMap::resize(int width, int height) {
+    if (width == w && height == h) return;
+    w = std::max(width, 0);
+    h = std::max(height, 0);
+    clear();
+}
+
+void LightMap::clear() {
+    rgb.assign((size_t)w * h * 3, 0.0f);
+    cached.clear();
+    subtractions = 0;
+}
+
+void LightMap::set_camera(const Camera& to) {
+    if (to == view_camera) return;
+    view_camera = to;
+    clear();
+}
+
+int LightMap::update(const Scene& scene, ThreadPool* pool) {
+    const std::vector<int>& lights = scene.lights();
+    
+    // pair every scene light with an unchanged cached one, if there is one
+    std::vector<int> match(lights.size(), -1);
+    std::vector<bool> kept(cached.size(), false);
+    for (size_t k = 0; k < lights.size(); k++) {
+        const Shape& s = scene.shapes[lights[k]];
+        for (size_t c = 0; c < cached.size(); c++) {
+            const Light& light = cached[c];
+            if (kept[c] || light.pos.x != s.center.x || light.pos.y != s.center.y || light.color.r != s.color.r ||
+                light.color.g != s.color.g || light.color.b != s.color.b || light.intensity != s.intensity) continue;
+            bool touched = false;
+            for (auto& edit : scene.edits) {
+                if (edit_touches(edit, light.polygon)) {
+                    touched = true;
+                    break;
+                }
+            }
+            if (touched) continue;
+            match[k] = (int)c;
+            kept[c] = true;
+            break;
+        }
+    }
+    
+    std::vector<Light> next(lights.size());
+    std::vector<int> changed;
+    for (size_t k = 0; k < lights.size(); k++) {
+        if (match[k] >= 0) {
+            next[k] = std::move(cached[match[k]]);
+            continue;
+        }
+        const Shape& s = scene.shapes[lights[k]];
+        next[k].pos = s.center;
+        next[k].color = s.color;
+        next[k].intensity = s.intensity;
+        changed.push_back((int)k);
+    }
+    
+    // the cached lights nobody claimed are what has to come out of the sums
+    std::vector<Light> removed;
+    for (size_t c = 0; c < cached.size(); c++) {
+        if (!kept[c]) removed.push_back(std::move(cached[c]));
+    }
+    
+    // each changed light's polygon on its own thread, nothing for the ones out of reach of the view
+    Box view = view_camera.view(w, h);
+    auto visibility = [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Light& light = next[changed[i]];
+            scene.visibility_toward(light.pos, view, light.polygon);
+        }
+    };
+    if (pool && changed.size() > 1) pool->parallel_for((int)changed.size(), 1, visibility);
+    else visibility(0, (int)changed.size());
+    
+    cached.swap(next);
+    
+    // when most lights changed anyway, or enough were subtracted, add everything up from zero
+    bool full = changed.size() * 2 >= cached.size() || subtractions + (int)removed.size() > MAX_SUBTRACTIONS;
+    std::vector<const Light*> todo;
+    std::vector<float> signs;
+    if (full) {
+        std::fill(rgb.begin(), rgb.end(), 0.0f);
+        subtractions = 0;
+        for (auto& light : cached) {
+            todo.push_back(&light);
+            signs.push_back(1);
+        }
+    } else {
+        subtractions += (int)removed.size();
+        for (auto& light : removed) {
+            todo.push_back(&light);
+            signs.push_back(-1);
+        }
+        for (int k : changed) {
+            todo.push_back(&cached[k]);
+            signs.push_back(1);
+        }
+    }
+    accumulate(todo, signs, pool);
+    return (int)changed.size();
+}
+
+void add_lit_region(std::vector<float>& rgb, int w, int h, const std::vector<Point2D>& points, Point2D pos,
+                    const float color[3], int row_begin, int row_end, const Camera& camera) {
+    // onto the canvas first, the identity camera keeps the points as they are
+    const std::vector<Point2D>* outline = &points;
+    std::vector<Point2D> moved;
+    if (camera != Camera()) {
+        moved.resize(points.size());
+        for (size_t i = 0; i < points.size(); i++) moved[i] = camera.to_screen(points[i]);
+        outline = &moved;
+        pos = camera.to_screen(pos);
+    }
+    double falloff = 1.0 / (LIGHT_FALLOFF * LIGHT_FALLOFF * camera.zoom * camera.zoom);
+    scan_polygon(*outline, std::max(row_begin, 0), std::min(row_end, h), [&](int y, int x0, int x1) {
+        x0 = std::max(x0, 0);
+        x1 = std::min(x1, w - 1);
+        double dy = y + 0.5 - pos.y;
+        float* p = &rgb[((size_t)y * w + x0) * 3];
+        for (int x = x0; x <= x1; x++, p += 3) {
+            double dx = x + 0.5 - pos.x;
+            float k = (float)(1.0 / (1.0 + (dx * dx + dy * dy) * falloff));
+            p[0] += color[0] * k;
+            p[1] += color[1] * k;
+            p[2] += color[2] * k;
+        }
+    });
+}
+
+void LightMap::accumulate(const std::vector<const Light*>& lights, const std::vector<float>& signs, ThreadPool* pool) {
+    if (lights.empty() || w == 0 || h == 0) return;
+    
+    // bands of rows, every band going through all the lights, so no two threads touch the same pixel
+    auto band = [&](int begin, int end) {
+        for (size_t i = 0; i < lights.size(); i++) {
+            const Light& light = *lights[i];
+            float scale = signs[i] * light.intensity;
+            float color[3] = {light.color.r * scale, light.color.g * scale, light.color.b * scale};
+            add_lit_region(rgb, w, h, light.polygon.points, light.pos, color, begin * BAND_ROWS, end * BAND_ROWS,
+                           view_camera);
+        }
+    };
+    int bands = (h + BAND_ROWS - 1) / BAND_ROWS;
+    if (pool) pool->parallel_for(bands, 1, band);
+    else band(0, bands);
+}
+
+void tone_map_buffer(const std::vector<float>& rgb, float scale, int w, int h, SoftwareRaster& out, ThreadPool* pool) {
+    if (out.width() != w || out.height() != h) return;
+    
+    // 1 - e^-L from a table, L past 8 is as good as white
+    const int STEPS = 1024;
+    const float SCALE = STEPS / 8.0f;
+    float curve[STEPS + 1];
+    for (int i = 0; i <= STEPS; i++) curve[i] = 255 * (1 - std::exp(-i / SCALE));
+    float to_step = scale * SCALE;
+    
+    std::vector<unsigned char>& pixels = out.pixels();
+    auto band = [&](int begin, int end) {
+        size_t first = (size_t)begin * BAND_ROWS * w, last = (size_t)std::min(end * BAND_ROWS, h) * w;
+        for (size_t i = first; i < last; i++) {
+            unsigned char* p = &pixels[i * 4];
+            const float* light = &rgb[i * 3];
+            for (int c = 0; c < 3; c++) {
+                // a subtracted light can leave a hair below zero
+                float l = std::max(light[c], 0.0f) * to_step;
+                int added = (int)(l < STEPS ? curve[(int)l] : curve[STEPS]);
+                p[c] = (unsigned char)std::min(p[c] + added, 255);
+            }
+        }
+    };
+    int bands = (h + BAND_ROWS - 1) / BAND_ROWS;
+    if (pool) pool->parallel_for(bands, 4, band);
+    else band(0, bands);
+}
+
+void LightMap::tone_map(SoftwareRaster& out, ThreadPool* pool) const {
+    tone_map_buffer(rgb, 1, w, h, out, pool);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include "camera.h"
+#include "scene.h"
+#include "soft_raster.h"
+#include "thread_pool.h"
+#include "visibility.h"
+
+// how far a light reaches before it has dropped to half, in pixels
+const double LIGHT_FALLOFF = 300;
+
+// Adds `color` times the falloff around `pos` to the pixels of rows
+// [row_begin, row_end) inside `points`, in a w x h buffer of float RGB.
+// The points and `pos` are in world units, the buffer is what `camera` shows.
+void add_lit_region(std::vector<float>& rgb, int w, int h, const std::vector<Point2D>& points, Point2D pos,
+                    const float color[3], int row_begin, int row_end, const Camera& camera);
+
+// adds 1 - e^-(scale * L) of every pixel's light onto what `out` already holds, which has to be w x h
+void tone_map_buffer(const std::vector<float>& rgb, float scale, int w, int h, SoftwareRaster& out,
+                     ThreadPool* pool = nullptr);
+
+// What all the lights together put on every pixel, kept as linear float RGB
+// and added up one light at a time, then tone mapped once per frame.
+//
+// Every light's visibility polygon is kept between updates. A light whose
+// position, color and intensity are unchanged, and whose polygon none of the
+// scene's logged edits touch, keeps its contribution as it is; the others
+// are recomputed in parallel, their old contribution subtracted and the new
+// one added. The scene's edit log is only read, its owner clears it.
+//
+// The map covers what its camera shows. A light too far off that view to
+// reach into it isn't computed at all, and the others only look at the
+// occluders that can matter for it, see Scene::visibility_toward().
+class LightMap {
+public:
+    struct Light {
+        Point2D pos;
+        LightColor color;
+        float intensity;
+        VisibilityPolygon polygon;
+    };
+    
+    void resize(int width, int height);
+    int width() const { return w; }
+    int height() const { return h; }
+    
+    // forgets every light, the next update adds them all up again
+    void clear();
+    
+    // the part of the world the map covers, a different one clears it
+    void set_camera(const Camera& to);
+    const Camera& camera() const { return view_camera; }
+    
+    // brings the map up to date with the scene's lights, returns how many were recomputed
+    int update(const Scene& scene, ThreadPool* pool = nullptr);
+    
+    // adds 1 - e^-L of every pixel's light onto what `out` already holds, which has to be the same size
+    void tone_map(SoftwareRaster& out, ThreadPool* pool = nullptr) const;
+    
+    // the cached lights, in the scene's light order after update()
+    const std::vector<Light>& lights() const { return cached; }
+    
+    // linear RGB, 3 floats per pixel, rows top to bottom
+    const std::vector<float>& buffer() const { return rgb; }
+
+private:
+    // adds (sign 1) or takes away (sign -1) each light's falloff inside its polygon
+    void accumulate(const std::vector<const Light*>& lights, const std::vector<float>& signs, ThreadPool* pool);
+    
+    int w = 0, h = 0;
+    Camera view_camera;
+    std::vector<float> rgb;
+    std::vector<Light> cached;
+    int subtractions = 0;  // since the last full rebuild, float error creeps in with each one
+};
@@ -0,0 +1,205 @@
+#include "primitive_store.h"
+
+#include <cmath>
+
+// Narrows [t0, t1] to where the ray is between lo and hi along one axis,
+// false once nothing is left.
+static inline bool slab(double origin, double dir, double lo, double hi, double& t0, double& t1) {
+    if (dir == 0) return origin >= lo && origin <= hi;
+    double inv = 1 / dir;
+    double a = (lo - origin) * inv, b = (hi - origin) * inv;
+    t0 = std::max(t0, std::min(a, b));
+    t1 = std::min(t1, std::max(a, b));
+    return t0 <= t1;
+}
+
+// the entry point, or the exit point when the ray starts inside
+static inline bool pick(double t0, double t1, double& t) {
+    if (t0 > HIT_EPSILON) { t = t0; return true; }
+    if (t1 > HIT_EPSILON) { t = t1; return true; }
+    return false;
+}
+
+bool PrimitiveStore::test(const SegmentRecord& r, Point2D from, Point2D dir, double& t) {
+    return ray_segment(Point2D(r.ax, r.ay), Point2D(r.ex, r.ey), from, dir, t);
+}
+
+bool PrimitiveStore::test(const BoxRecord& r, Point2D from, Point2D dir, double& t) {
+    double t0 = -1e300, t1 = 1e300;
+    if (!slab(from.x, dir.x, r.x0, r.x1, t0, t1) || !slab(from.y, dir.y, r.y0, r.y1, t0, t1)) return false;
+    return pick(t0, t1, t);
+}
+
+bool PrimitiveStore::test(const TurnedBoxRecord& r, Point2D from, Point2D dir, double& t) {
+    // into the box's own frame, where it's axis-aligned around the origin
+    double dx = from.x - r.cx, dy = from.y - r.cy;
+    double lx = dx * r.ux + dy * r.uy, ly = dy * r.ux - dx * r.uy;
+    double ldx = dir.x * r.ux + dir.y * r.uy, ldy = dir.y * r.ux - dir.x * r.uy;
+    double t0 = -1e300, t1 = 1e300;
+    if (!slab(lx, ldx, -r.hw, r.hw, t0, t1) || !slab(ly, ldy, -r.hh, r.hh, t0, t1)) return false;
+    return pick(t0, t1, t);
+}
+
+bool PrimitiveStore::test(const PolygonRecord& r, Point2D from, Point2D dir, double& t) {
+    return ray_convex(r.nx, r.ny, r.d, MAX_POLYGON_VERTICES, from, dir, t);
+}
+
+template <typename Record>
+void PrimitiveStore::nearest_in(const Bucket<Record>& bucket, Point2D from, Point2D dir, double& best, int& best_owner) {
+    const Record* records = bucket.records.data();
+    int count = (int)bucket.records.size();
+    for (int i = 0; i < count; i++) {
+        double t;
+        if (test(records[i], from, dir, t) && t < best) {
+            best = t;
+            best_owner = bucket.owner[i];
+        }
+    }
+}
+
+bool PrimitiveStore::nearest_hit(Point2D from, Point2D dir, double max_t, double& t, int& hit_index) const {
+    double best = max_t;
+    int best_owner = -1;
+    nearest_in(segments, from, dir, best, best_owner);
+    nearest_in(boxes, from, dir, best, best_owner);
+    nearest_in(turned_boxes, from, dir, best, best_owner);
+    nearest_in(polygons, from, dir, best, best_owner);
+    if (best_owner < 0) return false;
+    t = best;
+    hit_index = best_owner;
+    return true;
+}
+
+bool PrimitiveStore::hit(int index, Point2D from, Point2D dir, double& t) const {
+    int e = slot[index];
+    switch (kind[index]) {
+        case SEGMENTS: return test(segments.records[e], from, dir, t);
+        case BOXES: return test(boxes.records[e], from, dir, t);
+        case TURNED_BOXES: return test(turned_boxes.records[e], from, dir, t);
+        case POLYGONS: return test(polygons.records[e], from, dir, t);
+        default: return false;
+    }
+}
+
+int PrimitiveStore::size() const {
+    return (int)(segments.records.size() + boxes.records.size() + turned_boxes.records.size() +
+                 polygons.records.size());
+}
+
+void PrimitiveStore::rebuild() {
+    segments = Bucket<SegmentRecord>();
+    boxes = Bucket<BoxRecord>();
+    turned_boxes = Bucket<TurnedBoxRecord>();
+    polygons = Bucket<PolygonRecord>();
+    kind.assign(shapes.size(), NONE);
+    slot.assign(shapes.size(), -1);
+    for (int i = 0; i < (int)shapes.size(); i++) append(i);
+}
+
+void PrimitiveStore::insert(int index) {
+    if (index != (int)slot.size()) { rebuild(); return; }
+    kind.push_back(NONE);
+    slot.push_back(-1);
+    append(index);
+}
+
+void PrimitiveStore::update(int index) {
+    // a rectangle turned away from 0 changes buckets, so the record is always made again
+    remove(index);
+    append(index);
+}
+
+void PrimitiveStore::erase(int index) {
+    remove(index);
+    
+    // the last shape's record now belongs to the erased one's index
+    int last = (int)slot.size() - 1;
+    if (index != last) {
+        kind[index] = kind[last];
+        slot[index] = slot[last];
+        switch (kind[index]) {
+            case SEGMENTS: segments.owner[slot[index]] = index; break;
+            case BOXES: boxes.owner[slot[index]] = index; break;
+            case TURNED_BOXES: turned_boxes.owner[slot[index]] = index; break;
+            case POLYGONS: polygons.owner[slot[index]] = index; break;
+            default: break;
+        }
+    }
+    kind.pop_back();
+    slot.pop_back();
+}
+
+PrimitiveStore::Kind PrimitiveStore::kind_of(const Shape& shape) {
+    if (shape.is_light) return NONE;
+    switch (shape.type) {
+        case SHAPE_SEGMENT: return SEGMENTS;
+        case SHAPE_RECT: return shape.angle == 0 ? BOXES : TURNED_BOXES;
+        case SHAPE_POLYGON: return shape.vertices.size() >= 3 ? POLYGONS : NONE;
+        default: return NONE;
+    }
+}
+
+void PrimitiveStore::append(int index) {
+    const Shape& s = shapes[index];
+    Kind k = kind_of(s);
+    kind[index] = (signed char)k;
+    if (k == SEGMENTS) {
+        double c = std::cos(s.angle) * s.size1, sn = std::sin(s.angle) * s.size1;
+        slot[index] = (int)segments.records.size();
+        segments.records.push_back(SegmentRecord{s.center.x - c, s.center.y - sn, 2 * c, 2 * sn});
+        segments.owner.push_back(index);
+    } else if (k == BOXES) {
+        slot[index] = (int)boxes.records.size();
+        boxes.records.push_back(BoxRecord{s.center.x - s.size1, s.center.y - s.size2, s.center.x + s.size1,
+                                          s.center.y + s.size2});
+        boxes.owner.push_back(index);
+    } else if (k == TURNED_BOXES) {
+        slot[index] = (int)turned_boxes.records.size();
+        turned_boxes.records.push_back(TurnedBoxRecord{s.center.x, s.center.y, std::cos(s.angle), std::sin(s.angle),
+                                                       s.size1, s.size2});
+        turned_boxes.owner.push_back(index);
+    } else if (k == POLYGONS) {
+        PolygonRecord r;
+        int count = std::min((int)s.vertices.size(), MAX_POLYGON_VERTICES);
+        for (int i = 0; i < MAX_POLYGON_VERTICES; i++) {
+            if (i >= count) {
+                r.nx[i] = 0; r.ny[i] = 0; r.d[i] = 1;
+                continue;
+            }
+            const Point2D& a = s.vertices[i];
+            const Point2D& b = s.vertices[(i + 1) % count];
+            r.nx[i] = b.y - a.y;
+            r.ny[i] = a.x - b.x;
+            r.d[i] = r.nx[i] * (s.center.x + a.x) + r.ny[i] * (s.center.y + a.y);
+        }
+        slot[index] = (int)polygons.records.size();
+        polygons.records.push_back(r);
+        polygons.owner.push_back(index);
+    } else {
+        slot[index] = -1;
+    }
+}
+
+template <typename Record>
+void PrimitiveStore::drop(Bucket<Record>& bucket, int record) {
+    // filling the hole with the last record so the bucket stays packed
+    int last = (int)bucket.records.size() - 1;
+    bucket.records[record] = bucket.records[last];
+    bucket.owner[record] = bucket.owner[last];
+    slot[bucket.owner[record]] = record;
+    bucket.records.pop_back();
+    bucket.owner.pop_back();
+}
+
+void PrimitiveStore::remove(int index) {
+    int e = slot[index];
+    switch (kind[index]) {
+        case SEGMENTS: drop(segments, e); break;
+        case BOXES: drop(boxes, e); break;
+        case TURNED_BOXES: drop(turned_boxes, e); break;
+        case POLYGONS: drop(polygons, e); break;
+        default: break;
+    }
+    kind[index] = NONE;
+    slot[index] = -1;
+}
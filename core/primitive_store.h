@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+#include "geometry.h"
+
+// Copy of the shapes that aren't circles, bucketed by type into arrays of
+// small fixed-size records: segments, axis-aligned boxes, turned boxes and
+// polygons as half-planes. Each bucket has its own tight loop, so a ray goes
+// through a bucket at a time instead of a switch or virtual call per shape,
+// and nothing needs a sin or cos at ray time. Like CircleStore it has to
+// hear about every add, move and erase.
+class PrimitiveStore {
+public:
+    explicit PrimitiveStore(const std::vector<Shape>& shapes) : shapes(shapes) {}
+    
+    void rebuild();
+    void insert(int index);   // shapes[index] was just added
+    void update(int index);   // shapes[index] moved, turned or resized
+    void erase(int index);    // shapes[index] was erased, the last shape moved into its place
+    
+    // nearest hit with t < max_t over every bucket, hit_index is the index in the shape vector
+    bool nearest_hit(Point2D from, Point2D dir, double max_t, double& t, int& hit_index) const;
+    
+    // just the shape at `index`, for the grid's candidates; false when it misses or isn't stored
+    bool hit(int index, Point2D from, Point2D dir, double& t) const;
+    
+    int size() const;
+    int segment_count() const { return (int)segments.records.size(); }
+    int box_count() const { return (int)boxes.records.size() + (int)turned_boxes.records.size(); }
+    int polygon_count() const { return (int)polygons.records.size(); }
+
+private:
+    enum Kind { NONE = -1, SEGMENTS, BOXES, TURNED_BOXES, POLYGONS };
+    
+    struct SegmentRecord {
+        double ax, ay, ex, ey;  // from a to a + e
+    };
+    struct BoxRecord {
+        double x0, y0, x1, y1;
+    };
+    struct TurnedBoxRecord {
+        double cx, cy, ux, uy, hw, hh;  // u is the unit x axis of the box
+    };
+    struct PolygonRecord {
+        // n.p <= d for every edge, corners past the polygon's own count are
+        // padded with 0.p <= 1 so every record runs the same loop
+        double nx[MAX_POLYGON_VERTICES], ny[MAX_POLYGON_VERTICES], d[MAX_POLYGON_VERTICES];
+    };
+    
+    template <typename Record>
+    struct Bucket {
+        std::vector<Record> records;
+        std::vector<int> owner;  // shape index of every record
+    };
+    
+    // one record against one ray, inlined into each bucket's loop
+    static bool test(const SegmentRecord& r, Point2D from, Point2D dir, double& t);
+    static bool test(const BoxRecord& r, Point2D from, Point2D dir, double& t);
+    static bool test(const TurnedBoxRecord& r, Point2D from, Point2D dir, double& t);
+    static bool test(const PolygonRecord& r, Point2D from, Point2D dir, double& t);
+    template <typename Record>
+    static void nearest_in(const Bucket<Record>& bucket, Point2D from, Point2D dir, double& best, int& best_owner);
+    template <typename Record>
+    void drop(Bucket<Record>& bucket, int record);
+    
+    static Kind kind_of(const Shape& shape);
+    void append(int index);
+    void remove(int index);
+    
+    const std::vector<Shape>& shapes;
+    Bucket<SegmentRecord> segments;
+    Bucket<BoxRecord> boxes;
+    Bucket<TurnedBoxRecord> turned_boxes;
+    Bucket<PolygonRecord> polygons;
+    std::vector<signed char> kind;  // bucket of every shape index, NONE when it isn't stored
+    std::vector<int> slot;          // record of every shape index
+};
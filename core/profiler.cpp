@@ -0,0 +1,125 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+FrameProfiler::FrameProfiler() : ring(HISTORY), epoch(Clock::now()) {
+    names.push_back("frame");
+}
+
+FrameProfiler& frame_profiler() {
+    static FrameProfiler profiler;
+    return profiler;
+}
+
+int FrameProfiler::stage(const char* name) {
+    std::lock_guard<std::mutex> lock(names_mutex);
+    for (int i = 0; i < (int)names.size(); i++) {
+        if (std::strcmp(names[i], name) == 0) return i;
+    }
+    // past the limit everything shares the last stage rather than growing the frames
+    if ((int)names.size() == MAX_STAGES) return MAX_STAGES - 1;
+    names.push_back(name);
+    return (int)names.size() - 1;
+}
+
+double FrameProfiler::since_start(Clock::time_point t) const {
+    return std::chrono::duration<double, std::micro>(t - epoch).count();
+}
+
+void FrameProfiler::begin_frame() {
+    Frame& f = ring[frame_count % HISTORY];
+    std::fill(f.stage_ms, f.stage_ms + MAX_STAGES, 0.0);
+    std::fill(f.ran, f.ran + MAX_STAGES, false);
+    f.scope_count = 0;
+    f.start_us = since_start(Clock::now());
+    owner = std::this_thread::get_id();
+    in_frame = true;
+    for (const Scope& scope : waiting) add_scope(scope);
+    waiting.clear();
+}
+
+void FrameProfiler::end_frame() {
+    if (!in_frame) return;
+    Frame& f = ring[frame_count % HISTORY];
+    f.duration_us = since_start(Clock::now()) - f.start_us;
+    f.stage_ms[0] = f.duration_us / 1000;
+    f.ran[0] = true;
+    in_frame = false;
+    frame_count++;
+}
+
+void FrameProfiler::record(int stage, Clock::time_point start, Clock::time_point end) {
+    if (!in_frame || std::this_thread::get_id() != owner) return;
+    double start_us = since_start(start);
+    add_scope(Scope{stage, start_us, since_start(end) - start_us, false});
+}
+
+void FrameProfiler::record_worker(int stage, Clock::time_point start, Clock::time_point end) {
+    // before the first frame there's no owner yet, and nothing is kept
+    if (std::this_thread::get_id() != owner) return;
+    double start_us = since_start(start);
+    Scope scope = {stage, start_us, since_start(end) - start_us, true};
+    if (in_frame) add_scope(scope);
+    else if ((int)waiting.size() < MAX_SCOPES) waiting.push_back(scope);
+}
+
+void FrameProfiler::add_scope(const Scope& scope) {
+    Frame& f = ring[frame_count % HISTORY];
+    f.stage_ms[scope.stage] += scope.duration_us / 1000;
+    f.ran[scope.stage] = true;
+    if (f.scope_count < MAX_SCOPES) f.scopes[f.scope_count++] = scope;
+}
+
+void FrameProfiler::summary(std::vector<StageSummary>& out) const {
+    std::lock_guard<std::mutex> lock(names_mutex);
+    out.clear();
+    std::vector<double> times;
+    for (int s = 0; s < (int)names.size(); s++) {
+        times.clear();
+        for (int i = 0; i < frames(); i++) {
+            if (ring[i].ran[s]) times.push_back(ring[i].stage_ms[s]);
+        }
+        if (times.empty()) continue;
+        
+        StageSummary sum = {names[s], (int)times.size(), 1e300, 0, 0};
+        for (double t : times) {
+            sum.min_ms = std::min(sum.min_ms, t);
+            sum.avg_ms += t;
+        }
+        sum.avg_ms /= times.size();
+        // the frame 1% of frames are slower than, the slowest one below 100 frames
+        size_t k = std::min(times.size() - 1, (size_t)(times.size() * 0.99));
+        std::nth_element(times.begin(), times.begin() + k, times.end());
+        sum.p99_ms = times[k];
+        out.push_back(sum);
+    }
+}
+
+bool FrameProfiler::write_chrome_trace(const char* path) const {
+    FILE* file = std::fopen(path, "w");
+    if (!file) return false;
+    std::lock_guard<std::mutex> lock(names_mutex);
+    
+    // oldest frame first, every frame and scope a complete ("X") event, the
+    // frame loop on track 1 and what workers ran on track 2
+    std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"frames\"}},\n");
+    std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"workers\"}}");
+    auto event = [&](const char* name, int track, double start_us, double duration_us) {
+        std::fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", name,
+                     track, start_us, duration_us);
+    };
+    int kept = frames();
+    for (int n = 0; n < kept; n++) {
+        const Frame& f = ring[(frame_count - kept + n) % HISTORY];
+        event(names[0], 1, f.start_us, f.duration_us);
+        for (int i = 0; i < f.scope_count; i++) {
+            const Scope& scope = f.scopes[i];
+            event(names[scope.stage], scope.worker ? 2 : 1, scope.start_us, scope.duration_us);
+        }
+    }
+    std::fprintf(file, "\n]}\n");
+    return std::fclose(file) == 0;
+}
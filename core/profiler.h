@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Stage timers for the frame loop. A stage is timed by putting
+//
+//     PROFILE_SCOPE("rays");
+//
+// at the top of the block it covers, and a frame runs from PROFILE_FRAME_BEGIN()
+// to PROFILE_FRAME_END(). Work done on another thread is handed in by the
+// frame loop once it's through, with PROFILE_WORKER("rays", start, end).
+// Release builds (NDEBUG) compile them all away to nothing;
+// -DRAYTRACE_PROFILER=1 or =0 overrides that either way.
+#ifndef RAYTRACE_PROFILER
+#ifdef NDEBUG
+#define RAYTRACE_PROFILER 0
+#else
+#define RAYTRACE_PROFILER 1
+#endif
+#endif
+
+// min, average and 99th percentile of one stage over the frames it ran in
+struct StageSummary {
+    const char* name;
+    int frames;
+    double min_ms, avg_ms, p99_ms;
+};
+
+// The last HISTORY frames, each with the time every stage took and the
+// individual scopes for the trace file. Only the thread that began the frame
+// records, scopes on pool threads are ignored; stage() and record() are safe
+// to call from any thread, the rest only from that one.
+class FrameProfiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+    static const int MAX_STAGES = 32;
+    static const int HISTORY = 240;
+    static const int MAX_SCOPES = 128;  // per frame, the rest only count towards the stage times
+    
+    FrameProfiler();
+    
+    // the id of a stage, the same name always gets the same one
+    int stage(const char* name);
+    
+    void begin_frame();
+    void end_frame();
+    void record(int stage, Clock::time_point start, Clock::time_point end);
+    
+    // A stage another thread ran, like a job on the ray thread, reported by
+    // the frame loop when it picks up the result. It counts towards the frame
+    // in progress, or the next one when it comes in between frames, and gets
+    // its own track in the trace since it overlaps the frames.
+    void record_worker(int stage, Clock::time_point start, Clock::time_point end);
+    
+    // the whole frame first, then the stages in the order they were first seen
+    void summary(std::vector<StageSummary>& out) const;
+    int frames() const { return frame_count < HISTORY ? frame_count : HISTORY; }
+    
+    // the kept frames as a Chrome trace (chrome://tracing, Perfetto), false if it couldn't be written
+    bool write_chrome_trace(const char* path) const;
+
+private:
+    struct Scope {
+        int stage;
+        double start_us, duration_us;
+        bool worker;
+    };
+    struct Frame {
+        double start_us, duration_us;
+        double stage_ms[MAX_STAGES];
+        bool ran[MAX_STAGES];
+        int scope_count;
+        Scope scopes[MAX_SCOPES];
+    };
+    
+    double since_start(Clock::time_point t) const;
+    void add_scope(const Scope& scope);
+    
+    std::vector<const char*> names;  // under names_mutex, the static in PROFILE_SCOPE can run on any thread
+    mutable std::mutex names_mutex;
+    std::vector<Frame> ring;
+    std::vector<Scope> waiting;      // worker stages reported between frames
+    int frame_count = 0;  // frames ended so far, ring[frame_count % HISTORY] is the one in progress
+    std::atomic<bool> in_frame{false};  // read by every thread that ends a scope
+    Clock::time_point epoch;
+    std::atomic<std::thread::id> owner;
+};
+
+// the one the PROFILE_ macros use
+FrameProfiler& frame_profiler();
+
+class ScopedTimer {
+public:
+    explicit ScopedTimer(int stage) : stage(stage), start(FrameProfiler::Clock::now()) {}
+    ~ScopedTimer() { frame_profiler().record(stage, start, FrameProfiler::Clock::now()); }
+
+private:
+    int stage;
+    FrameProfiler::Clock::time_point start;
+};
+
+#if RAYTRACE_PROFILER
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_JOIN(profile_stage_, __LINE__) = frame_profiler().stage(name); \
+    ScopedTimer PROFILE_JOIN(profile_timer_, __LINE__)(PROFILE_JOIN(profile_stage_, __LINE__))
+#define PROFILE_FRAME_BEGIN() frame_profiler().begin_frame()
+#define PROFILE_FRAME_END() frame_profiler().end_frame()
+#define PROFILE_WORKER(name, start, end) \
+    do { \
+        static const int profile_stage = frame_profiler().stage(name); \
+        frame_profiler().record_worker(profile_stage, start, end); \
+    } while (0)
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_FRAME_BEGIN() ((void)0)
+#define PROFILE_FRAME_END() ((void)0)
+#define PROFILE_WORKER(name, start, end) ((void)0)
+#endif
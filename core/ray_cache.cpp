@@ -0,0 +1,71 @@
+#include "ray_cache.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double TWO_PI = 2 * 3.14159265359;
+
+// below this many rays to cast again the pool isn't worth waking up
+static const int PARALLEL_MIN_RAYS = 256;
+
+void RayCache::mark_span(Point2D center, double radius) {
+    int count = (int)hits.size();
+    double dx = center.x - origin.x, dy = center.y - origin.y;
+    double distance = std::sqrt(dx * dx + dy * dy);
+    
+    // a little wider than the tangents, so a ray grazing the circle is cast again too
+    double r = radius * (1 + 1e-9) + 1e-9;
+    if (distance <= r) {
+        std::fill(stale.begin(), stale.end(), 1);
+        return;
+    }
+    double mid = std::atan2(dy, dx);
+    if (mid < 0) mid += TWO_PI;
+    double half = std::asin(r / distance);
+    double step = TWO_PI / count;
+    
+    long long first = (long long)std::ceil((mid - half) / step);
+    long long last = (long long)std::floor((mid + half) / step);
+    for (long long i = first; i <= last; i++) {
+        stale[(size_t)(((i % count) + count) % count)] = 1;
+    }
+}
+
+int RayCache::update(const Scene& scene, Point2D origin, int count, ThreadPool* pool) {
+    bool everything = (int)hits.size() != count || origin.x != this->origin.x || origin.y != this->origin.y ||
+                      scene.tracer.reach() != reach;
+    for (auto& edit : scene.edits) {
+        if (std::isinf(edit.radius)) everything = true;
+    }
+    if (everything) {
+        this->origin = origin;
+        reach = scene.tracer.reach();
+        scene.tracer.cast_fan(origin, count, hits, pool);
+        return count;
+    }
+    if (count == 0) return 0;
+    
+    // the rays either side of every edited circle, and the shape erasing moved
+    stale.assign(count, 0);
+    for (auto& edit : scene.edits) {
+        if (edit.radius > 0) mark_span(edit.center, edit.radius);
+        if (edit.moved < 0) continue;
+        for (int i = 0; i < count; i++) {
+            if (hits[i].shape == edit.moved) hits[i].shape = edit.erased;
+        }
+    }
+    
+    todo.clear();
+    for (int i = 0; i < count; i++) {
+        if (stale[i]) todo.push_back(i);
+    }
+    auto cast_range = [&](int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            hits[todo[k]] = scene.tracer.cast(origin, todo[k] * TWO_PI / count);
+        }
+    };
+    int n = (int)todo.size();
+    if (pool && n >= PARALLEL_MIN_RAYS) pool->parallel_for(n, std::max(8, n / (pool->thread_count() * 4)), cast_range);
+    else cast_range(0, n);
+    return n;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include "scene.h"
+#include "thread_pool.h"
+#include "tracer.h"
+
+// The uniform fan around one light, kept between frames with every ray's
+// nearest shape and t. A circle that moved, resized, appeared or went away
+// can only change the rays inside its old and new angular spans as seen
+// from the light, so after an edit only those are cast again. The whole fan
+// is cast again when the light moves, the ray count or the tracer's reach
+// changes, or the scene was rebuilt.
+//
+// update() reads the scene's edit log and leaves clearing it to its owner.
+class RayCache {
+public:
+    // brings the fan up to date for `count` rays around `origin`, returns how many were cast
+    int update(const Scene& scene, Point2D origin, int count, ThreadPool* pool = nullptr);
+    
+    // forgets the fan, the next update casts all of it
+    void clear() { hits.clear(); }
+    
+    const std::vector<RayHit>& rays() const { return hits; }
+
+private:
+    void mark_span(Point2D center, double radius);
+    
+    Point2D origin;
+    double reach = 0;           // the tracer's when the fan was cast
+    std::vector<RayHit> hits;   // ray i at angle 2*pi*i/count, like RayTracer::cast_fan()
+    std::vector<char> stale;    // rays an edit reached
+    std::vector<int> todo;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include "geometry.h"
+
+struct Rgb {
+    unsigned char r, g, b;
+    Rgb(int r = 0, int g = 0, int b = 0) : r((unsigned char)r), g((unsigned char)g), b((unsigned char)b) {}
+};
+
+// What the scene drawing code in scene_renderer.h draws through. The editor
+// implements it on top of GDI, the headless tools with SoftwareRaster.
+class RenderBackend {
+public:
+    int draw_calls = 0;  // primitives drawn since the caller last reset it
+    
+    virtual ~RenderBackend() {}
+    
+    // false when nothing inside `box` can show up, so it's not worth drawing
+    virtual bool visible(const Box& /*box*/) const { return true; }
+    
+    virtual void fill_rect(const Box& box, Rgb color) = 0;
+    virtual void line(Point2D from, Point2D to, Rgb color) = 0;
+    
+    // a filled disc, with an outline `outline_width` pixels wide (none at 0)
+    virtual void fill_circle(Point2D center, double radius, Rgb fill, Rgb outline, int outline_width) = 0;
+    
+    // just the dotted outline, for the selection
+    virtual void dotted_circle(Point2D center, double radius, Rgb color, int width) = 0;
+    
+    virtual void fill_polygon(const std::vector<Point2D>& points, Rgb color) = 0;
+};
@@ -0,0 +1,288 @@
+#include "replay.h"
+#include "scene_io.h"
+
+#include <algorithm>
+#include <cstring>
+
+template <typename T>
+void ReplayRecorder::put(const T& value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void ReplayRecorder::put_shape(const Shape& s) {
+    ReplayShape r;
+    std::memset(&r, 0, sizeof(r));
+    r.type = (uint8_t)s.type;
+    r.is_light = s.is_light;
+    r.vertex_count = (uint8_t)std::min((int)s.vertices.size(), MAX_POLYGON_VERTICES);
+    r.red = s.color.r; r.green = s.color.g; r.blue = s.color.b;
+    r.intensity = s.intensity;
+    r.reflectance = s.material.reflectance; r.ior = s.material.ior; r.absorption = s.material.absorption;
+    r.x = s.center.x; r.y = s.center.y;
+    r.size1 = s.size1; r.size2 = s.size2; r.angle = s.angle;
+    r.vx = s.velocity.x; r.vy = s.velocity.y;
+    put(r);
+    for (int i = 0; i < r.vertex_count; i++) {
+        put(s.vertices[i].x);
+        put(s.vertices[i].y);
+    }
+}
+
+void ReplayRecorder::put_index(ReplayOp op, int index) {
+    put(op);
+    put((int32_t)index);
+    edited = true;
+}
+
+bool ReplayRecorder::start(const char* path, const Scene& scene, const Camera& camera, const Box& bounds) {
+    stop();
+    file = std::fopen(path, "wb");
+    if (!file) return false;
+    ReplayHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.version = REPLAY_VERSION;
+    header.byte_order = SCENE_BYTE_ORDER;
+    header.shape_count = scene.shapes.size();
+    buffer.clear();
+    put(header);
+    for (const Shape& s : scene.shapes) put_shape(s);
+    put(camera.origin.x);
+    put(camera.origin.y);
+    put(camera.zoom);
+    put(bounds);
+    this->camera = camera;
+    this->bounds = bounds;
+    edited = false;
+    frame_count = 0;
+    if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) stop();
+    buffer.clear();
+    return file != nullptr;
+}
+
+void ReplayRecorder::stop() {
+    if (file) std::fclose(file);
+    file = nullptr;
+    buffer.clear();
+}
+
+void ReplayRecorder::add(const Shape& shape) {
+    if (!file) return;
+    put(REPLAY_ADD);
+    put_shape(shape);
+    edited = true;
+}
+
+void ReplayRecorder::erase(int index) {
+    if (file) put_index(REPLAY_ERASE, index);
+}
+
+void ReplayRecorder::move(int index, Point2D to) {
+    if (!file) return;
+    put_index(REPLAY_MOVE, index);
+    put(to.x);
+    put(to.y);
+}
+
+void ReplayRecorder::resize(int index, double size) {
+    if (!file) return;
+    put_index(REPLAY_RESIZE, index);
+    put(size);
+}
+
+void ReplayRecorder::rotate(int index, double by) {
+    if (!file) return;
+    put_index(REPLAY_ROTATE, index);
+    put(by);
+}
+
+void ReplayRecorder::move_light(int index, Point2D to) {
+    if (!file) return;
+    put_index(REPLAY_MOVE_LIGHT, index);
+    put(to.x);
+    put(to.y);
+}
+
+void ReplayRecorder::set_material(int index, const Material& material) {
+    if (!file) return;
+    put_index(REPLAY_MATERIAL, index);
+    put(material.reflectance);
+    put(material.ior);
+    put(material.absorption);
+}
+
+void ReplayRecorder::set_velocity(int index, Point2D velocity) {
+    if (!file) return;
+    put_index(REPLAY_VELOCITY, index);
+    put(velocity.x);
+    put(velocity.y);
+}
+
+void ReplayRecorder::end_frame(int steps, const Scene& scene, const Camera& camera, const Box& bounds) {
+    if (!file) return;
+    if (camera != this->camera) {
+        put(REPLAY_CAMERA);
+        put(camera.origin.x);
+        put(camera.origin.y);
+        put(camera.zoom);
+        this->camera = camera;
+        edited = true;
+    }
+    if (bounds.left != this->bounds.left || bounds.top != this->bounds.top || bounds.right != this->bounds.right ||
+        bounds.bottom != this->bounds.bottom) {
+        put(REPLAY_BOUNDS);
+        put(bounds);
+        this->bounds = bounds;
+        edited = true;
+    }
+    if (!edited && steps == 0) return;
+    put(REPLAY_FRAME);
+    put((uint16_t)steps);
+    put(scene_checksum(scene));
+    edited = false;
+    frame_count++;
+    if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) stop();
+    buffer.clear();
+}
+
+template <typename T>
+bool ReplayReader::get(T& value) {
+    if (data.size() - at < sizeof(T)) return false;
+    std::memcpy(&value, data.data() + at, sizeof(T));
+    at += sizeof(T);
+    return true;
+}
+
+bool ReplayReader::get_shape(Shape& s) {
+    ReplayShape r;
+    if (!get(r) || r.type > SHAPE_POLYGON || r.vertex_count > MAX_POLYGON_VERTICES) return false;
+    s = Shape((ShapeType)r.type, Point2D(r.x, r.y), r.size1, r.size2, r.is_light != 0);
+    s.color = LightColor(r.red, r.green, r.blue);
+    s.intensity = r.intensity;
+    s.material = Material(r.reflectance, r.ior, r.absorption);
+    s.angle = r.angle;
+    s.velocity = Point2D(r.vx, r.vy);
+    for (int i = 0; i < r.vertex_count; i++) {
+        Point2D p;
+        if (!get(p.x) || !get(p.y)) return false;
+        s.vertices.push_back(p);
+    }
+    return true;
+}
+
+bool ReplayReader::open(const char* path, Scene& scene, Camera& camera, Simulation& simulation, std::string& error) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        error = std::string("could not read ") + path;
+        return false;
+    }
+    data.clear();
+    unsigned char chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) data.insert(data.end(), chunk, chunk + n);
+    std::fclose(file);
+    at = 0;
+    frames = steps = 0;
+    matched = true;
+    
+    ReplayHeader header;
+    if (!get(header) || std::memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0) {
+        error = std::string(path) + " is not a replay";
+        return false;
+    }
+    if (header.version != REPLAY_VERSION || header.byte_order != SCENE_BYTE_ORDER) {
+        error = std::string(path) + " was written by another version or on a machine with another byte order";
+        return false;
+    }
+    std::vector<Shape> shapes;
+    Camera start;
+    Box bounds;
+    for (uint64_t i = 0; i < header.shape_count; i++) {
+        Shape s(SHAPE_CIRCLE, Point2D(), 0);
+        if (!get_shape(s)) break;
+        shapes.push_back(s);
+    }
+    if (shapes.size() != header.shape_count || !get(start.origin.x) || !get(start.origin.y) || !get(start.zoom) ||
+        !get(bounds)) {
+        error = std::string(path) + " is cut short";
+        return false;
+    }
+    scene.shapes.swap(shapes);
+    scene.rebuild();
+    camera = start;
+    simulation.bounds = bounds;
+    return true;
+}
+
+bool ReplayReader::next_frame(Scene& scene, Camera& camera, Simulation& simulation) {
+    auto valid = [&](int32_t index) { return index >= 0 && index < (int32_t)scene.shapes.size(); };
+    for (;;) {
+        ReplayOp op;
+        int32_t index = 0;
+        Point2D p;
+        if (!get(op)) return false;
+        switch (op) {
+            case REPLAY_FRAME: {
+                uint16_t count;
+                uint64_t checksum;
+                if (!get(count) || !get(checksum)) return false;
+                for (int i = 0; i < count; i++) simulation.step(scene);
+                steps = count;
+                matched = scene_checksum(scene) == checksum;
+                frames++;
+                return true;
+            }
+            case REPLAY_ADD: {
+                Shape s(SHAPE_CIRCLE, Point2D(), 0);
+                if (!get_shape(s)) return false;
+                scene.add_shape(s);
+                break;
+            }
+            case REPLAY_ERASE:
+                if (!get(index) || !valid(index)) return false;
+                scene.erase_shape(index);
+                break;
+            case REPLAY_MOVE:
+                if (!get(index) || !get(p.x) || !get(p.y) || !valid(index)) return false;
+                scene.try_move_shape(index, p);
+                break;
+            case REPLAY_RESIZE: {
+                double size;
+                if (!get(index) || !get(size) || !valid(index)) return false;
+                scene.try_resize_shape(index, size);
+                break;
+            }
+            case REPLAY_ROTATE: {
+                double by;
+                if (!get(index) || !get(by) || !valid(index)) return false;
+                scene.rotate_shape(index, by);
+                break;
+            }
+            case REPLAY_MOVE_LIGHT:
+                if (!get(index) || !get(p.x) || !get(p.y) || !valid(index)) return false;
+                scene.move_light(index, p);
+                break;
+            case REPLAY_MATERIAL: {
+                Material m;
+                if (!get(index) || !get(m.reflectance) || !get(m.ior) || !get(m.absorption) || !valid(index)) {
+                    return false;
+                }
+                scene.shapes[index].material = m;
+                break;
+            }
+            case REPLAY_VELOCITY:
+                if (!get(index) || !get(p.x) || !get(p.y) || !valid(index)) return false;
+                scene.shapes[index].velocity = p;
+                break;
+            case REPLAY_CAMERA:
+                if (!get(camera.origin.x) || !get(camera.origin.y) || !get(camera.zoom)) return false;
+                break;
+            case REPLAY_BOUNDS:
+                if (!get(simulation.bounds)) return false;
+                break;
+            default:
+                return false;
+        }
+    }
+}
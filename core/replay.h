@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "camera.h"
+#include "simulation.h"
+
+// A recorded session: the scene as it was when the recording started, then
+// frame after frame every edit made during it and how many simulation steps
+// ran at its end. Making the same edits and running the same steps from the
+// same scene ends up in the same place down to the last bit, which the
+// checksum stored with every frame confirms, so a replay renders exactly the
+// frames the session showed, as fast as it can, for profiling.
+//
+// The file is a ReplayHeader, a ReplayShape per shape (each followed by its
+// polygon corners as vertex_count x, y pairs of doubles), the camera's
+// origin and zoom and the simulation's bounds as doubles, then records of
+// a one-byte ReplayOp and its fields, in the writer's byte order like the
+// binary scenes. Edits name shapes by index, where they are at that point.
+// A frame where nothing happened isn't written.
+const char REPLAY_MAGIC[8] = {'R', 'T', 'R', 'E', 'P', 'L', 'A', 'Y'};
+const uint32_t REPLAY_VERSION = 1;
+
+struct ReplayHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;  // SCENE_BYTE_ORDER as the writer had it
+    uint64_t shape_count;
+};
+
+enum ReplayOp : uint8_t {
+    REPLAY_FRAME,       // uint16 steps, uint64 scene_checksum() after them: the frame ends
+    REPLAY_ADD,         // a ReplayShape and its corners
+    REPLAY_ERASE,       // int32 index
+    REPLAY_MOVE,        // int32 index, double x, y, through try_move_shape
+    REPLAY_RESIZE,      // int32 index, double size, through try_resize_shape
+    REPLAY_ROTATE,      // int32 index, double radians
+    REPLAY_MOVE_LIGHT,  // int32 index, double x, y, through move_light
+    REPLAY_MATERIAL,    // int32 index, float reflectance, ior, absorption
+    REPLAY_VELOCITY,    // int32 index, double x, y
+    REPLAY_CAMERA,      // double origin x, y, zoom
+    REPLAY_BOUNDS       // double left, top, right, bottom
+};
+
+// every field of a Shape but the polygon corners
+struct ReplayShape {
+    uint8_t type, is_light, vertex_count, unused;
+    float red, green, blue, intensity;
+    float reflectance, ior, absorption;
+    double x, y, size1, size2, angle;
+    double vx, vy;
+};
+static_assert(sizeof(ReplayShape) == 32 + 7 * sizeof(double), "no padding, the records are copied as they are");
+
+// Writes a session as it happens. Every edit is passed on right after the
+// scene made it; end_frame() closes the frame and writes it out.
+class ReplayRecorder {
+public:
+    ReplayRecorder() {}
+    ~ReplayRecorder() { stop(); }
+    ReplayRecorder(const ReplayRecorder&) = delete;
+    ReplayRecorder& operator=(const ReplayRecorder&) = delete;
+    
+    // starts a new log at `path` from the scene as it is now, false if it can't be written
+    bool start(const char* path, const Scene& scene, const Camera& camera, const Box& bounds);
+    void stop();
+    bool recording() const { return file != nullptr; }
+    int frames() const { return frame_count; }
+    
+    // the edits, all of them no-ops while not recording
+    void add(const Shape& shape);
+    void erase(int index);
+    void move(int index, Point2D to);
+    void resize(int index, double size);
+    void rotate(int index, double by);
+    void move_light(int index, Point2D to);
+    void set_material(int index, const Material& material);
+    void set_velocity(int index, Point2D velocity);
+    
+    // after the frame's `steps`, with the camera and bounds it was shown with; stops if the write fails
+    void end_frame(int steps, const Scene& scene, const Camera& camera, const Box& bounds);
+
+private:
+    template <typename T>
+    void put(const T& value);
+    void put_shape(const Shape& shape);
+    void put_index(ReplayOp op, int index);
+    
+    FILE* file = nullptr;
+    std::vector<unsigned char> buffer;  // the frame so far
+    bool edited = false;
+    Camera camera;
+    Box bounds = {0, 0, 0, 0};
+    int frame_count = 0;
+};
+
+// Plays a log back into a scene, a frame at a time.
+class ReplayReader {
+public:
+    // Reads the whole log and replaces the scene, camera and simulation
+    // bounds with the ones it starts from. On failure nothing is changed
+    // and `error` says what was wrong.
+    bool open(const char* path, Scene& scene, Camera& camera, Simulation& simulation, std::string& error);
+    
+    // Makes the next frame's edits and runs its steps. False when there's
+    // no frame left, or the log is cut short or names a shape that isn't there.
+    bool next_frame(Scene& scene, Camera& camera, Simulation& simulation);
+    
+    int frame() const { return frames; }           // frames played so far
+    int last_steps() const { return steps; }       // steps the last frame ran
+    bool last_matched() const { return matched; }  // whether it ended up where the recording did
+    bool at_end() const { return at == data.size(); }
+
+private:
+    template <typename T>
+    bool get(T& value);
+    bool get_shape(Shape& shape);
+    
+    std::vector<unsigned char> data;
+    size_t at = 0;
+    int frames = 0, steps = 0;
+    bool matched = true;
+};
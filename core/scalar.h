@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+// The number types the ray kernels can be built for. double is what the
+// rest of the code uses; float halves the memory and doubles the SIMD width,
+// and 16.16 fixed point runs on integer units. On an 800x600 canvas either
+// keeps a ray's end point well under a pixel from the double one.
+
+// 16.16 fixed point, so +-32768 with steps of 1/65536. Canvas coordinates
+// and ray lengths fit; their squares don't, which is why the kernels that
+// use it never square a coordinate. Doubles past the range saturate instead
+// of wrapping round to the other side, and NaN comes out as 0.
+struct Fixed16 {
+    int32_t raw = 0;
+    
+    Fixed16() {}
+    explicit Fixed16(int value) : raw(value * 65536) {}
+    static Fixed16 from_raw(int32_t raw) { Fixed16 f; f.raw = raw; return f; }
+    static Fixed16 from_double(double value) {
+        double raw = std::round(value * 65536);
+        if (std::isnan(raw)) return Fixed16();
+        if (raw >= 2147483647.0) return from_raw(INT32_MAX);
+        if (raw <= -2147483648.0) return from_raw(INT32_MIN);
+        return from_raw((int32_t)raw);
+    }
+    double to_double() const { return raw / 65536.0; }
+    
+    Fixed16 operator-() const { return from_raw(-raw); }
+    Fixed16 operator+(Fixed16 o) const { return from_raw(raw + o.raw); }
+    Fixed16 operator-(Fixed16 o) const { return from_raw(raw - o.raw); }
+    Fixed16 operator*(Fixed16 o) const { return from_raw((int32_t)(((int64_t)raw * o.raw) >> 16)); }
+    bool operator<(Fixed16 o) const { return raw < o.raw; }
+    bool operator>(Fixed16 o) const { return raw > o.raw; }
+    bool operator<=(Fixed16 o) const { return raw <= o.raw; }
+    bool operator>=(Fixed16 o) const { return raw >= o.raw; }
+    bool operator==(Fixed16 o) const { return raw == o.raw; }
+};
+
+// What the kernels need from a scalar type beyond + - * and compares.
+template <typename T>
+struct ScalarTraits;
+
+template <>
+struct ScalarTraits<double> {
+    static const char* name() { return "double"; }
+    static double from_double(double v) { return v; }
+    static double to_double(double v) { return v; }
+    static double range() { return HUGE_VAL; }
+    static double sqrt_product(double a, double b) { return std::sqrt(a * b); }
+};
+
+template <>
+struct ScalarTraits<float> {
+    static const char* name() { return "float"; }
+    static float from_double(double v) { return (float)v; }
+    static double to_double(float v) { return v; }
+    static double range() { return HUGE_VAL; }
+    static float sqrt_product(float a, float b) { return std::sqrt(a * b); }
+};
+
+template <>
+struct ScalarTraits<Fixed16> {
+    static const char* name() { return "fixed16"; }
+    static Fixed16 from_double(double v) { return Fixed16::from_double(v); }
+    static double to_double(Fixed16 v) { return v.to_double(); }
+    
+    // how far from 0 a circle's center, its radius and a ray's origin can be
+    // for ray_circle to stay in range: the offset between origin and center
+    // is up to twice this, and radius + h up to about 3.83 times it
+    static double range() { return 8192; }
+    
+    // sqrt(a * b) without rounding the product back to 16.16 first, where it
+    // would overflow: the 32.32 product's integer root is already 16.16
+    static Fixed16 sqrt_product(Fixed16 a, Fixed16 b) {
+        int64_t p = (int64_t)a.raw * b.raw;
+        if (p <= 0) return Fixed16();
+        uint64_t root = (uint64_t)std::sqrt((double)p);
+        // the double root can be one off either way past 2^53
+        while (root * root > (uint64_t)p) root--;
+        while ((root + 1) * (root + 1) <= (uint64_t)p) root++;
+        return Fixed16::from_raw((int32_t)root);
+    }
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "geometry.h"
+
+// Even-odd scan conversion shared by the raster and the light map: calls
+// span(y, x0, x1) for the pixels of rows [row_begin, row_end) whose centers
+// lie inside the polygon, x0 to x1 both included and not clipped to any
+// width. Bands of rows can be scanned on different threads.
+template <class SpanFn>
+void scan_polygon(const std::vector<Point2D>& points, int row_begin, int row_end, SpanFn&& span) {
+    if (points.size() < 3 || row_begin >= row_end) return;
+    
+    // where every edge crosses the center line of every row it spans
+    std::vector<std::vector<double>> crossings(row_end - row_begin);
+    for (size_t i = 0; i < points.size(); i++) {
+        Point2D a = points[i], b = points[(i + 1) % points.size()];
+        if (a.y == b.y) continue;
+        if (a.y > b.y) std::swap(a, b);
+        int y0 = std::max((int)std::ceil(a.y - 0.5), row_begin);
+        int y1 = std::min((int)std::ceil(b.y - 0.5), row_end);
+        double slope = (b.x - a.x) / (b.y - a.y);
+        for (int y = y0; y < y1; y++) {
+            crossings[y - row_begin].push_back(a.x + (y + 0.5 - a.y) * slope);
+        }
+    }
+    
+    // and the even-odd rule between them
+    for (int y = row_begin; y < row_end; y++) {
+        auto& xs = crossings[y - row_begin];
+        std::sort(xs.begin(), xs.end());
+        for (size_t i = 0; i + 1 < xs.size(); i += 2) {
+            span(y, (int)std::ceil(xs[i] - 0.5), (int)std::ceil(xs[i + 1] - 0.5) - 1);
+        }
+    }
+}
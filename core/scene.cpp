@@ -0,0 +1,339 @@
+#include "scene.h"
+#include "camera.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// past this many edits a cache is better off starting over than checking them one by one
+static const size_t MAX_EDITS = 4096;
+
+// the square visibility_toward() looks in first, half as wide, and how finely it tracks the open directions
+static const double VISIBILITY_FIRST_RING = 256;
+static const int VISIBILITY_BINS = 4096;
+static const double PI = 3.14159265359;
+
+static SceneEdit everything() {
+    return SceneEdit{Point2D(), std::numeric_limits<double>::infinity(), -1};
+}
+
+void Scene::rebuild() {
+    grid.rebuild();
+    circles.rebuild();
+    primitives.rebuild();
+    handles.reset((int)shapes.size());
+    find_lights();
+    edits.assign(1, everything());
+    reshaped_since_clear = true;
+}
+
+void Scene::assign(std::vector<Shape>& new_shapes, const std::vector<SceneEdit>& new_edits) {
+    shapes.swap(new_shapes);
+    grid.rebuild();
+    circles.rebuild();
+    primitives.rebuild();
+    handles.reset((int)shapes.size());
+    find_lights();
+    reshaped_since_clear = true;
+    log_edits(new_edits);
+}
+
+void Scene::follow(const std::vector<int>& indices, const std::vector<Shape>& new_shapes,
+                   const std::vector<SceneEdit>& new_edits) {
+    for (size_t k = 0; k < indices.size(); k++) {
+        shapes[indices[k]] = new_shapes[k];
+        shape_changed(indices[k]);
+    }
+    log_edits(new_edits);
+}
+
+void Scene::log_edits(const std::vector<SceneEdit>& new_edits) {
+    for (const SceneEdit& edit : new_edits) {
+        if (std::isinf(edit.radius) || edits.size() >= MAX_EDITS) {
+            edits.assign(1, everything());
+            return;
+        }
+        if (!edits.empty() && std::isinf(edits[0].radius)) return;
+        edits.push_back(edit);
+    }
+}
+
+void Scene::clear_changes() {
+    for (int index : changed) changed_flag[index] = 0;
+    changed.clear();
+    reshaped_since_clear = false;
+}
+
+void Scene::note_change(int index) {
+    // with the indices moved, the list would be no use until the next clear anyway
+    if (reshaped_since_clear) return;
+    if (index >= (int)changed_flag.size()) changed_flag.resize(shapes.size(), 0);
+    if (changed_flag[index]) return;
+    changed_flag[index] = 1;
+    changed.push_back(index);
+}
+
+void Scene::shape_added(int index) {
+    grid.insert(index);
+    circles.insert(index);
+    primitives.insert(index);
+    reshaped_since_clear = true;
+    if (index != (int)shapes.size() - 1 || index != handles.size()) {
+        // anything but an append moved shapes, every handle starts over
+        handles.reset((int)shapes.size());
+        find_lights();
+        return;
+    }
+    handles.add();
+    if (shapes[index].is_light) light_indices.push_back(index);
+}
+
+void Scene::shape_changed(int index) {
+    grid.update(index);
+    circles.update(index);
+    primitives.update(index);
+    note_change(index);
+}
+
+void Scene::shape_erased(int index) {
+    grid.erase(index);
+    circles.erase(index);
+    primitives.erase(index);
+    handles.erase(index);
+    reshaped_since_clear = true;
+    
+    // drop it if it was a light, and follow the last shape if that was one
+    int last = (int)shapes.size();
+    size_t kept = 0;
+    for (int light : light_indices) {
+        if (light != index) light_indices[kept++] = light == last ? index : light;
+    }
+    light_indices.resize(kept);
+    std::sort(light_indices.begin(), light_indices.end());
+}
+
+void Scene::find_lights() {
+    light_indices.clear();
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (shapes[i].is_light) light_indices.push_back(i);
+    }
+}
+
+void Scene::log_edit(const Shape& shape, int erased, int moved) {
+    // lights don't cast shadows, so only erasing one, which moves indices, is worth a note
+    if (shape.is_light && erased < 0) return;
+    if (edits.size() >= MAX_EDITS) edits.assign(1, everything());
+    if (!edits.empty() && std::isinf(edits[0].radius)) return;
+    edits.push_back(SceneEdit{shape.center, shape.is_light ? 0 : shape.bounding_radius(), erased, moved});
+}
+
+int Scene::add_shape(const Shape& shape) {
+    shapes.push_back(shape);
+    int index = (int)shapes.size() - 1;
+    shape_added(index);
+    log_edit(shape);
+    return index;
+}
+
+void Scene::erase_shape(int index) {
+    // the last shape fills the hole, so nothing else has to move
+    int last = (int)shapes.size() - 1;
+    log_edit(shapes[index], index, index != last ? last : -1);
+    if (index != last) shapes[index] = std::move(shapes[last]);
+    shapes.pop_back();
+    shape_erased(index);
+}
+
+bool Scene::check_collision_with_shapes(Point2D pos, double size, int exclude_index) const {
+    return grid.any_overlap(pos, size, exclude_index);
+}
+
+bool Scene::overlaps_any_shape(Point2D pos, double size, int exclude_index) const {
+    if (grid.any_overlap(pos, size, exclude_index)) return true;
+    for (int light : light_indices) {
+        if (light == exclude_index) continue;
+        double dx = pos.x - shapes[light].center.x, dy = pos.y - shapes[light].center.y;
+        double reach = size + shapes[light].size1;
+        if (dx * dx + dy * dy < reach * reach) return true;
+    }
+    return false;
+}
+
+// The bounding boxes of the wedges out to `r` from `from` that the runs of
+// open bins make, one box for all of them when they cover half the circle.
+static void open_boxes(Point2D from, double r, const std::vector<char>& open, std::vector<Box>& out) {
+    out.clear();
+    int first_closed = -1, open_count = 0;
+    for (int b = 0; b < VISIBILITY_BINS; b++) {
+        if (open[b]) open_count++;
+        else if (first_closed < 0) first_closed = b;
+    }
+    if (open_count * 2 >= VISIBILITY_BINS) {
+        out.push_back(Box{from.x - r, from.y - r, from.x + r, from.y + r});
+        return;
+    }
+    double step = 2 * PI / VISIBILITY_BINS;
+    for (int k = 1; k <= VISIBILITY_BINS; k++) {
+        int b = (first_closed + k) % VISIBILITY_BINS;
+        if (!open[b] || open[(b + VISIBILITY_BINS - 1) % VISIBILITY_BINS]) continue;
+        // a run starts at b, it can't wrap past first_closed
+        int length = 1;
+        while (open[(b + length) % VISIBILITY_BINS]) length++;
+        double a0 = -PI + b * step, a1 = a0 + length * step;
+        Box box = {from.x, from.y, from.x, from.y};
+        auto extend = [&](double angle) {
+            double x = from.x + r * std::cos(angle), y = from.y + r * std::sin(angle);
+            box = Box{std::min(box.left, x), std::min(box.top, y), std::max(box.right, x), std::max(box.bottom, y)};
+        };
+        extend(a0);
+        extend(a1);
+        for (double axis = -PI; axis < a1; axis += PI / 2) {
+            if (axis > a0) extend(axis);
+        }
+        out.push_back(box);
+    }
+}
+
+double Scene::visibility_toward(Point2D from, const Box& view, VisibilityPolygon& out) const {
+    out.points.clear();
+    out.rays.clear();
+    out.shapes.clear();
+    double reach = ray_reach(from, view);
+    if (reach == 0) return 0;
+    Box toward = {std::min(view.left, from.x), std::min(view.top, from.y), std::max(view.right, from.x),
+                  std::max(view.bottom, from.y)};
+    auto square = [&](double r) {
+        return Box{std::max(from.x - r, toward.left), std::max(from.y - r, toward.top),
+                   std::min(from.x + r, toward.right), std::min(from.y + r, toward.bottom)};
+    };
+    auto bin_of = [](double angle) {
+        int bin = (int)std::floor((angle + PI) / (2 * PI) * VISIBILITY_BINS);
+        return (bin % VISIBILITY_BINS + VISIBILITY_BINS) % VISIBILITY_BINS;
+    };
+    
+    double r = std::min(VISIBILITY_FIRST_RING, reach);
+    std::vector<int> candidates, wider, found;
+    std::vector<char> open(VISIBILITY_BINS);
+    std::vector<Box> wedges;
+    grid.query(square(r), candidates);
+    for (;;) {
+        compute_visibility(from, shapes, out, 0.5, r, &candidates);
+        if (r >= reach) return reach;
+        
+        // The directions where the boundary got to the square's edge while
+        // still headed for the view; a ray that left the box around the
+        // light and the view never comes back into it. Everywhere else it's
+        // blocked for good, by shapes already on the boundary.
+        std::fill(open.begin(), open.end(), 0);
+        bool any = false;
+        double edge = r * 0.999;
+        for (const Point2D& p : out.points) {
+            double dx = p.x - from.x, dy = p.y - from.y;
+            if (dx * dx + dy * dy < edge * edge || p.x < toward.left || p.x > toward.right || p.y < toward.top ||
+                p.y > toward.bottom) continue;
+            // the bins either side too, the arc between two points lies in one of them
+            int bin = bin_of(std::atan2(dy, dx));
+            for (int k = -1; k <= 1; k++) open[(bin + k + VISIBILITY_BINS) % VISIBILITY_BINS] = 1;
+            any = true;
+        }
+        if (!any) return reach;
+        
+        // so the next square only adds what lies in those directions to the boundary's shapes, and
+        // only the boxes around the open wedges are looked at, not all of it
+        double inner = r;
+        r = std::min(2 * r, reach);
+        open_boxes(from, r, open, wedges);
+        wider.clear();
+        for (const Box& wedge : wedges) {
+            Box box = square(r);
+            box = Box{std::max(box.left, wedge.left), std::max(box.top, wedge.top), std::min(box.right, wedge.right),
+                      std::min(box.bottom, wedge.bottom)};
+            if (box.left > box.right || box.top > box.bottom) continue;
+            grid.query(box, found);
+            wider.insert(wider.end(), found.begin(), found.end());
+        }
+        candidates = out.shapes;
+        for (int i : wider) {
+            const Shape& s = shapes[i];
+            double dx = s.center.x - from.x, dy = s.center.y - from.y, br = s.bounding_radius();
+            if (std::fabs(dx) + br < inner && std::fabs(dy) + br < inner) continue;
+            double d = std::sqrt(dx * dx + dy * dy);
+            if (d <= br) continue;
+            double mid = std::atan2(dy, dx), half = std::asin(br / d);
+            int first = bin_of(mid - half), count = (int)std::ceil(2 * half / (2 * PI) * VISIBILITY_BINS) + 1;
+            for (int k = 0; k <= count; k++) {
+                if (open[(first + k) % VISIBILITY_BINS]) {
+                    candidates.push_back(i);
+                    break;
+                }
+            }
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    }
+}
+
+bool Scene::try_move_shape(int index, Point2D pos) {
+    if (overlaps_any_shape(pos, shapes[index].bounding_radius(), index)) return false;
+    log_edit(shapes[index]);
+    shapes[index].center = pos;
+    shape_changed(index);
+    log_edit(shapes[index]);
+    return true;
+}
+
+bool Scene::try_resize_shape(int index, double size) {
+    if (overlaps_any_shape(shapes[index].center, size, index)) return false;
+    log_edit(shapes[index]);
+    shapes[index].resize(size);
+    shape_changed(index);
+    log_edit(shapes[index]);
+    return true;
+}
+
+void Scene::rotate_shape(int index, double by) {
+    shapes[index].rotate(by);
+    shape_changed(index);
+    log_edit(shapes[index]);
+}
+
+void Scene::move_light(int index, Point2D pos) {
+    double lr = shapes[index].size1;
+    
+    // Every push can land the light in a circle further along, so after one
+    // the overlaps are looked up again, keeping only the ones not handled yet.
+    std::vector<int> near;
+    grid.overlapping(pos, lr, near);
+    int handled = -1;
+    for (size_t k = 0; k < near.size(); k++) {
+        int i = near[k];
+        if (i <= handled) continue;
+        handled = i;
+        const Shape& s = shapes[i];
+        double dx = pos.x - s.center.x, dy = pos.y - s.center.y;
+        double min_dist = lr + s.bounding_radius();
+        if (dx * dx + dy * dy >= min_dist * min_dist) continue;
+        
+        double angle = std::atan2(dy, dx);
+        pos.x = s.center.x + std::cos(angle) * min_dist;
+        pos.y = s.center.y + std::sin(angle) * min_dist;
+        grid.overlapping(pos, lr, near);
+        k = (size_t)-1;
+    }
+    
+    // lights aren't in the grid or the stores, but a copy following this one still has to hear about it
+    shapes[index].center = pos;
+    note_change(index);
+}
+
+int Scene::cast_light(int index, const RaySettings& settings, std::vector<RayHit>& hits, VisibilityPolygon& polygon,
+                      ThreadPool* pool) const {
+    Point2D origin = shapes[index].center;
+    if (settings.exact) {
+        // the exact lit region from the tangent angles, and only the rays along its edges
+        compute_visibility(origin, shapes, polygon);
+        hits = polygon.rays;
+        return (int)hits.size();
+    }
+    return tracer.cast_adaptive(origin, settings, hits, pool);
+}
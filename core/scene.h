@@ -0,0 +1,136 @@
+#pragma once
+
+#include <vector>
+#include "circle_store.h"
+#include "geometry.h"
+#include "primitive_store.h"
+#include "slot_map.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
+#include "tracer.h"
+#include "visibility.h"
+
+// Where the occluders changed: the old or the new bounding circle of a
+// shape that was added, erased, moved, turned or resized. An infinite radius
+// means anything may have changed, like after rebuild(). Erasing a shape
+// also moves the last shape into its index, which caches holding shape
+// indices have to follow, even for a light, whose edit has no area.
+struct SceneEdit {
+    Point2D center;
+    double radius;    // 0 when no occluder changed
+    int erased = -1;  // index of the erased shape, -1 for anything else
+    int moved = -1;   // the index the shape that took its place had, -1 when it was the last one
+};
+
+// The shapes, the lights among them and everything derived from them that
+// the ray casting needs. Both the editor and the headless tools own one of
+// these. Shapes can be changed directly as long as the matching shape_*()
+// call follows, so the grid and the stores stay in sync. The add,
+// erase and try_* helpers do that and also log the edit.
+//
+// The shapes stay packed in one vector for the tracer and the stores, in no
+// particular order: erasing moves the last shape into the hole. Whatever has
+// to keep pointing at a shape across edits, like the editor's selection,
+// holds a ShapeHandle and asks index_of() for where the shape is now.
+class Scene {
+public:
+    std::vector<Shape> shapes;
+    SpatialGrid grid;     // used for ray queries in big scenes
+    CircleStore circles;  // SoA copy of the circles for the batch kernel
+    PrimitiveStore primitives;  // everything else, bucketed by type
+    RayTracer tracer;
+    
+    // occluder changes since the owner last called clear_edits(), so cached
+    // lighting only has to redo what they touch
+    std::vector<SceneEdit> edits;
+    
+    Scene() : grid(shapes), circles(shapes), primitives(shapes), tracer(grid, circles, primitives) {}
+    Scene(const Scene&) = delete;
+    Scene& operator=(const Scene&) = delete;
+    
+    // after replacing the shapes vector wholesale
+    void rebuild();
+    
+    // Swaps in `new_shapes` and rebuilds like rebuild(), but logs `new_edits`
+    // instead of everything: a copy that follows another scene, like the
+    // editor's ray thread does, gets the shapes and the edits made since.
+    void assign(std::vector<Shape>& new_shapes, const std::vector<SceneEdit>& new_edits);
+    
+    // The cheap way for such a copy to keep up while no shape is added or
+    // erased: the shapes at `indices` become `new_shapes` in the same order,
+    // through shape_changed(), and `new_edits` are logged like assign() does.
+    void follow(const std::vector<int>& indices, const std::vector<Shape>& new_shapes,
+                const std::vector<SceneEdit>& new_edits);
+    
+    // What a copy needs to follow(): the shapes changed in place since the
+    // owner last called clear_changes(), each once. After an add, an erase or
+    // a rebuild the indices don't line up any more, reshaped() says so and
+    // only assign() will do.
+    const std::vector<int>& changed_shapes() const { return changed; }
+    bool reshaped() const { return reshaped_since_clear; }
+    void clear_changes();
+    
+    void shape_added(int index);
+    void shape_changed(int index);
+    void shape_erased(int index);  // after the last shape was moved into shapes[index] and popped
+    
+    // indices of the light shapes, in shape order
+    const std::vector<int>& lights() const { return light_indices; }
+    
+    int add_shape(const Shape& shape);  // returns the new index
+    void erase_shape(int index);        // O(1), the last shape takes its index
+    
+    // the handle of the shape at `index`, and where a handle's shape is now, -1 once it was erased
+    ShapeHandle handle_of(int index) const { return handles.handle_of(index); }
+    int index_of(ShapeHandle handle) const { return handles.index_of(handle); }
+    void clear_edits() { edits.clear(); }
+    
+    // Would a shape with bounding radius `size` at `pos` overlap any non-light
+    // shape? Asks the grid, so only the shapes nearby are looked at.
+    bool check_collision_with_shapes(Point2D pos, double size, int exclude_index = -1) const;
+    
+    // the same with the lights counted as obstacles too
+    bool overlaps_any_shape(Point2D pos, double size, int exclude_index = -1) const;
+    
+    // compute_visibility() from `from` as far as `view` needs it, out to
+    // ray_reach(). Only occluders in the box around both can shade the view,
+    // and of those only the ones in a square around `from` that starts small
+    // and doubles while the polygon still gets to its edge somewhere. Each
+    // bigger square only adds the shapes in the directions that were still
+    // open to the ones the last boundary ran along, so a light hemmed in by
+    // shapes costs about the same however many lie beyond. Returns the
+    // reach, 0 with `out` left empty when the light can't get to the view.
+    double visibility_toward(Point2D from, const Box& view, VisibilityPolygon& out) const;
+    
+    // Drag and resize for the shape at `index`: the change only happens, and
+    // the grid and stores only hear about it, if nothing would overlap. The
+    // size is the new bounding radius, shapes other than circles are scaled.
+    bool try_move_shape(int index, Point2D pos);
+    bool try_resize_shape(int index, double size);
+    
+    // turning keeps the bounding circle, so it always fits
+    void rotate_shape(int index, double by);
+    
+    // Moves the light shape at `index` to `pos`, pushed out of every circle
+    // it would land in, one after another in shape order.
+    void move_light(int index, Point2D pos);
+    
+    // Casts the rays around the light shape at `index` the way `settings`
+    // says. In exact mode the polygon is filled and its shadow-edge rays
+    // become the hits, otherwise the polygon is left alone. Returns how many
+    // rays were cast.
+    int cast_light(int index, const RaySettings& settings, std::vector<RayHit>& hits, VisibilityPolygon& polygon,
+                   ThreadPool* pool = nullptr) const;
+
+private:
+    void find_lights();
+    void log_edit(const Shape& shape, int erased = -1, int moved = -1);
+    void log_edits(const std::vector<SceneEdit>& new_edits);
+    void note_change(int index);
+    
+    std::vector<int> light_indices;
+    SlotMap handles;
+    std::vector<int> changed;         // see changed_shapes()
+    std::vector<char> changed_flag;   // per shape index, whether it's in `changed`
+    bool reshaped_since_clear = true;
+};
@@ -0,0 +1,459 @@
+#include "scene_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SCENE_IO_MMAP 1
+#endif
+
+bool SceneFile::open(const char* path, std::string& error) {
+    close();
+    const unsigned char* bytes = nullptr;
+    size_t size = 0;
+
+#ifdef SCENE_IO_MMAP
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        error = std::string(path) + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        size = (size_t)info.st_size;
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            mapping = data;
+            mapping_size = size;
+            bytes = (const unsigned char*)data;
+        }
+    }
+    ::close(fd);
+#endif
+
+    if (!bytes) {
+        // no mmap here, or it failed: one read into an 8-byte aligned buffer
+        FILE* file = std::fopen(path, "rb");
+        if (!file) {
+            error = std::string(path) + ": " + std::strerror(errno);
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        long length = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        size = length > 0 ? (size_t)length : 0;
+        buffer.resize((size + sizeof(double) - 1) / sizeof(double));
+        size_t got = size ? std::fread(buffer.data(), 1, size, file) : 0;
+        std::fclose(file);
+        if (got != size) {
+            error = std::string(path) + ": read failed";
+            close();
+            return false;
+        }
+        bytes = (const unsigned char*)buffer.data();
+    }
+    
+    const SceneFileHeader* h = (const SceneFileHeader*)bytes;
+    if (size < sizeof(SceneFileHeader) || std::memcmp(h->magic, SCENE_MAGIC, sizeof(SCENE_MAGIC)) != 0) {
+        error = std::string(path) + ": not a binary scene";
+    } else if (h->byte_order != SCENE_BYTE_ORDER) {
+        error = std::string(path) + ": written on a machine with the other byte order";
+    } else if (h->version < 1 || h->version > SCENE_VERSION) {
+        error = std::string(path) + ": unsupported version " + std::to_string(h->version);
+    } else if (h->circle_count > (size - sizeof(SceneFileHeader)) / (3 * sizeof(double))) {
+        error = std::string(path) + ": truncated, the header promises " + std::to_string(h->circle_count) + " circles";
+    } else if (h->version > 1 && h->light_count > (size - sizeof(SceneFileHeader) - h->circle_count * 3 * sizeof(double)) /
+                                                      sizeof(SceneFileLight)) {
+        error = std::string(path) + ": truncated, the header promises " + std::to_string(h->light_count) + " lights";
+    } else if (h->version > 2 && h->material_count != 0 && h->material_count != h->circle_count) {
+        error = std::string(path) + ": " + std::to_string(h->material_count) + " materials for " +
+                std::to_string(h->circle_count) + " circles";
+    } else if (h->version > 2 && h->material_count * 3 * sizeof(double) >
+                                     size - sizeof(SceneFileHeader) - h->circle_count * 3 * sizeof(double) -
+                                     h->light_count * sizeof(SceneFileLight)) {
+        error = std::string(path) + ": truncated, the materials are missing";
+    } else {
+        header = h;
+        xs = (const double*)(bytes + sizeof(SceneFileHeader));
+        if (h->version > 2 && h->material_count) {
+            materials = (const double*)((const unsigned char*)(xs + 3 * h->circle_count) +
+                                        h->light_count * sizeof(SceneFileLight));
+        }
+        if (h->version < 4) return true;
+        
+        // the other shapes' count and records come after everything above
+        size_t used = sizeof(SceneFileHeader) + (3 * h->circle_count + 3 * h->material_count) * sizeof(double) +
+                      h->light_count * sizeof(SceneFileLight);
+        uint64_t count = 0;
+        if (size - used >= sizeof(count)) std::memcpy(&count, bytes + used, sizeof(count));
+        if (size - used < sizeof(count) || count > (size - used - sizeof(count)) / sizeof(SceneFilePrimitive)) {
+            error = std::string(path) + ": truncated, the shapes after the circles are missing";
+        } else {
+            primitive_total = (size_t)count;
+            primitive_records = (const SceneFilePrimitive*)(bytes + used + sizeof(count));
+            return true;
+        }
+    }
+    close();
+    return false;
+}
+
+void SceneFile::close() {
+#ifdef SCENE_IO_MMAP
+    if (mapping) munmap(mapping, mapping_size);
+#endif
+    mapping = nullptr;
+    mapping_size = 0;
+    buffer.clear();
+    buffer.shrink_to_fit();
+    header = nullptr;
+    xs = nullptr;
+    materials = nullptr;
+    primitive_records = nullptr;
+    primitive_total = 0;
+}
+
+size_t SceneFile::light_count() const {
+    if (!header) return 0;
+    if (header->version == 1) return header->light_radius > 0 ? 1 : 0;
+    return (size_t)header->light_count;
+}
+
+SceneFileLight SceneFile::light(size_t index) const {
+    if (header->version == 1) {
+        LightColor color;
+        return SceneFileLight{header->light_x, header->light_y, header->light_radius, color.r, color.g, color.b, 1};
+    }
+    SceneFileLight light;
+    std::memcpy(&light, xs + 3 * circle_count() + index * 7, sizeof(light));
+    return light;
+}
+
+SceneFormat scene_format_for(const char* path) {
+    size_t length = std::strlen(path);
+    return length >= 4 && std::strcmp(path + length - 4, ".bin") == 0 ? SCENE_BINARY : SCENE_TEXT;
+}
+
+// Checks what a file says about a circle or a light, the same for both
+// variants: a finite center and a positive, finite radius.
+static bool check_circle(double x, double y, double r, std::string& what) {
+    if (!std::isfinite(x) || !std::isfinite(y)) {
+        what = "center must be finite";
+        return false;
+    }
+    if (!(r > 0) || !std::isfinite(r)) {
+        what = "radius must be positive";
+        return false;
+    }
+    return true;
+}
+
+// Checks what a file says about a segment, rectangle or polygon, the same
+// for both variants: a finite center, positive sizes, and a polygon's
+// corners convex, which come out in increasing angle whichever way round
+// they were given.
+static bool check_primitive(Shape& s, std::string& what) {
+    if (!std::isfinite(s.center.x) || !std::isfinite(s.center.y)) {
+        what = "center must be finite";
+        return false;
+    }
+    if (s.type == SHAPE_POLYGON) {
+        int n = (int)s.vertices.size();
+        if (n < 3 || n > MAX_POLYGON_VERTICES) {
+            what = "a polygon needs 3 to " + std::to_string(MAX_POLYGON_VERTICES) + " corners";
+            return false;
+        }
+        if (polygon_area2(s.vertices) < 0) std::reverse(s.vertices.begin(), s.vertices.end());
+        for (int i = 0; i < n; i++) {
+            const Point2D& a = s.vertices[i];
+            const Point2D& b = s.vertices[(i + 1) % n];
+            const Point2D& c = s.vertices[(i + 2) % n];
+            if ((b.x - a.x) * (c.y - b.y) - (b.y - a.y) * (c.x - b.x) <= 0) {
+                what = "polygon must be convex";
+                return false;
+            }
+        }
+        return true;
+    }
+    if (!(s.size1 > 0) || (s.type == SHAPE_RECT && !(s.size2 > 0))) {
+        what = s.type == SHAPE_RECT ? "width and height must be positive" : "length must be positive";
+        return false;
+    }
+    return true;
+}
+
+static bool load_binary(const char* path, std::vector<Shape>& shapes, std::string& error) {
+    SceneFile file;
+    if (!file.open(path, error)) return false;
+    size_t count = file.circle_count();
+    const double* x = file.x();
+    const double* y = file.y();
+    const double* r = file.radius();
+    shapes.reserve(count + file.light_count());
+    std::string what;
+    for (size_t i = 0; i < file.light_count(); i++) {
+        SceneFileLight light = file.light(i);
+        if (!check_circle(light.x, light.y, light.radius, what)) {
+            error = std::string(path) + ": light " + std::to_string(i) + ": " + what;
+            return false;
+        }
+        Shape s(SHAPE_CIRCLE, Point2D(light.x, light.y), light.radius, 0, true);
+        s.color = LightColor((float)light.red, (float)light.green, (float)light.blue);
+        s.intensity = (float)light.intensity;
+        shapes.push_back(s);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!check_circle(x[i], y[i], r[i], what)) {
+            error = std::string(path) + ": circle " + std::to_string(i) + ": " + what;
+            return false;
+        }
+        shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(x[i], y[i]), r[i]));
+        if (file.reflectance()) {
+            shapes.back().material = Material((float)file.reflectance()[i], (float)file.ior()[i], (float)file.absorption()[i]);
+        }
+    }
+    for (size_t i = 0; i < file.primitive_count(); i++) {
+        const SceneFilePrimitive& p = file.primitives()[i];
+        std::string what = "unknown shape type " + std::to_string(p.type);
+        bool known = p.type == SHAPE_SEGMENT || p.type == SHAPE_RECT || p.type == SHAPE_POLYGON;
+        Shape s((ShapeType)p.type, Point2D(p.x, p.y), p.size1, p.size2);
+        s.angle = p.angle;
+        s.material = Material((float)p.reflectance, (float)p.ior, (float)p.absorption);
+        if (known && s.type == SHAPE_POLYGON) {
+            for (uint32_t k = 0; k < std::min(p.vertex_count, (uint32_t)MAX_POLYGON_VERTICES); k++) {
+                s.vertices.push_back(Point2D(p.vx[k], p.vy[k]));
+            }
+        }
+        if (p.vertex_count > (uint32_t)MAX_POLYGON_VERTICES) {
+            known = false;
+            what = "a polygon needs 3 to " + std::to_string(MAX_POLYGON_VERTICES) + " corners";
+        }
+        if (!known || !check_primitive(s, what)) {
+            error = std::string(path) + ": shape " + std::to_string(i) + " after the circles: " + what;
+            return false;
+        }
+        shapes.push_back(s);
+    }
+    return true;
+}
+
+static bool load_text(const char* path, const std::string& text, std::vector<Shape>& shapes, std::string& error) {
+    std::vector<Shape> occluders, lights;
+    
+    const char* p = text.c_str();
+    for (int line = 1; *p; line++) {
+        const char* end = std::strchr(p, '\n');
+        if (!end) end = p + std::strlen(p);
+        auto fail = [&](const std::string& what) {
+            error = std::string(path) + ":" + std::to_string(line) + ": " + what;
+            return false;
+        };
+        
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p < end && *p != '#') {
+            const char* word = p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '#') p++;
+            std::string keyword(word, p);
+            
+            // every number up to the end of the line or a comment, from_chars is
+            // several times faster than strtod
+            const int MAX_NUMBERS = 6 + 2 * MAX_POLYGON_VERTICES;
+            double v[MAX_NUMBERS + 1] = {};
+            int count = 0;
+            const char* cursor = p;
+            while (true) {
+                while (cursor < end && (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')) cursor++;
+                if (cursor == end || *cursor == '#') break;
+                if (count > MAX_NUMBERS) return fail("too many numbers");
+                auto parsed = std::from_chars(cursor, end, v[count]);
+                if (parsed.ec != std::errc() || parsed.ptr == cursor) return fail("expected a number");
+                cursor = parsed.ptr;
+                count++;
+            }
+            
+            if (keyword == "light" || keyword == "circle") {
+                bool is_light = keyword == "light";
+                if (count < 3) return fail("expected x, y and radius");
+                if (count > (is_light ? 7 : 6)) return fail("too many numbers");
+                if (count == 4 || count == 5) {
+                    return fail(is_light ? "a light's color needs all three channels" : "a material needs all three numbers");
+                }
+                std::string what;
+                if (!check_circle(v[0], v[1], v[2], what)) return fail(what);
+                
+                Shape s(SHAPE_CIRCLE, Point2D(v[0], v[1]), v[2], 0, is_light);
+                if (count >= 6 && is_light) s.color = LightColor((float)v[3], (float)v[4], (float)v[5]);
+                if (count == 6 && !is_light) s.material = Material((float)v[3], (float)v[4], (float)v[5]);
+                if (count == 7) s.intensity = (float)v[6];
+                (is_light ? lights : occluders).push_back(s);
+            } else if (keyword == "segment" || keyword == "rect" || keyword == "polygon") {
+                // how many numbers come before the optional material
+                int shape_numbers;
+                Shape s(SHAPE_SEGMENT, Point2D(v[0], v[1]), v[2], v[3]);
+                if (keyword == "segment") {
+                    if (count < 4) return fail("expected x, y, half length and angle");
+                    shape_numbers = 4;
+                    s.size2 = 0;
+                    s.angle = v[3];
+                } else if (keyword == "rect") {
+                    if (count < 4) return fail("expected x, y, half width and half height");
+                    shape_numbers = count == 4 || count == 7 ? 4 : 5;
+                    s.type = SHAPE_RECT;
+                    if (shape_numbers == 5) s.angle = v[4];
+                } else {
+                    int corners = count >= 3 ? (int)v[2] : 0;
+                    if (count < 3 || v[2] != corners || corners < 3 || corners > MAX_POLYGON_VERTICES) {
+                        return fail("expected x, y and 3 to " + std::to_string(MAX_POLYGON_VERTICES) + " corners");
+                    }
+                    shape_numbers = 3 + 2 * corners;
+                    if (count < shape_numbers) return fail("expected " + std::to_string(corners) + " corners");
+                    s = Shape(SHAPE_POLYGON, Point2D(v[0], v[1]), 0);
+                    for (int k = 0; k < corners; k++) s.vertices.push_back(Point2D(v[3 + 2 * k], v[4 + 2 * k]));
+                }
+                if (count != shape_numbers && count != shape_numbers + 3) return fail("a material needs all three numbers");
+                if (count == shape_numbers + 3) {
+                    s.material = Material((float)v[shape_numbers], (float)v[shape_numbers + 1], (float)v[shape_numbers + 2]);
+                }
+                std::string what;
+                if (!check_primitive(s, what)) return fail(what);
+                occluders.push_back(s);
+            } else {
+                return fail("expected 'light', 'circle', 'segment', 'rect' or 'polygon'");
+            }
+        }
+        p = *end ? end + 1 : end;
+    }
+    
+    shapes.reserve(occluders.size() + lights.size());
+    shapes.insert(shapes.end(), lights.begin(), lights.end());
+    shapes.insert(shapes.end(), occluders.begin(), occluders.end());
+    return true;
+}
+
+bool load_scene(const char* path, Scene& scene, std::string& error) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        error = std::string(path) + ": " + std::strerror(errno);
+        return false;
+    }
+    char magic[sizeof(SCENE_MAGIC)] = {};
+    size_t got = std::fread(magic, 1, sizeof(magic), file);
+    
+    std::vector<Shape> shapes;
+    bool ok;
+    if (got == sizeof(magic) && std::memcmp(magic, SCENE_MAGIC, sizeof(magic)) == 0) {
+        std::fclose(file);
+        ok = load_binary(path, shapes, error);
+    } else {
+        std::string text(magic, got);
+        char chunk[1 << 16];
+        size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) text.append(chunk, n);
+        std::fclose(file);
+        ok = load_text(path, text, shapes, error);
+    }
+    if (!ok) return false;
+    
+    scene.shapes.swap(shapes);
+    scene.rebuild();
+    return true;
+}
+
+bool save_scene(const char* path, const Scene& scene, SceneFormat format) {
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    
+    if (format == SCENE_TEXT) {
+        // %.17g so the doubles read back exactly
+        std::fprintf(file, "# raytrace scene\n");
+        for (auto& s : scene.shapes) {
+            if (!s.is_light) continue;
+            std::fprintf(file, "light %.17g %.17g %.17g %.9g %.9g %.9g %.9g\n", s.center.x, s.center.y, s.size1,
+                         s.color.r, s.color.g, s.color.b, s.intensity);
+        }
+        for (auto& s : scene.shapes) {
+            if (s.is_light) continue;
+            if (s.type == SHAPE_SEGMENT) {
+                std::fprintf(file, "segment %.17g %.17g %.17g %.17g", s.center.x, s.center.y, s.size1, s.angle);
+            } else if (s.type == SHAPE_RECT) {
+                std::fprintf(file, "rect %.17g %.17g %.17g %.17g %.17g", s.center.x, s.center.y, s.size1, s.size2, s.angle);
+            } else if (s.type == SHAPE_POLYGON) {
+                std::fprintf(file, "polygon %.17g %.17g %d", s.center.x, s.center.y, (int)s.vertices.size());
+                for (const Point2D& v : s.vertices) std::fprintf(file, " %.17g %.17g", v.x, v.y);
+            } else {
+                std::fprintf(file, "circle %.17g %.17g %.17g", s.center.x, s.center.y, s.size1);
+            }
+            const Material& m = s.material;
+            if (m.scatters() || m.ior != 1) std::fprintf(file, " %.9g %.9g %.9g", m.reflectance, m.ior, m.absorption);
+            std::fputc('\n', file);
+        }
+        return std::fclose(file) == 0;
+    }
+    
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, SCENE_MAGIC, sizeof(SCENE_MAGIC));
+    header.version = SCENE_VERSION;
+    header.byte_order = SCENE_BYTE_ORDER;
+    
+    std::vector<double> x, y, r, reflectance, ior, absorption;
+    std::vector<SceneFileLight> lights;
+    std::vector<SceneFilePrimitive> primitives;
+    bool any_material = false;
+    for (auto& s : scene.shapes) {
+        if (s.is_light) {
+            lights.push_back({s.center.x, s.center.y, s.size1, s.color.r, s.color.g, s.color.b, s.intensity});
+            continue;
+        }
+        if (s.type != SHAPE_CIRCLE) {
+            SceneFilePrimitive p = {};
+            p.type = s.type;
+            p.vertex_count = (uint32_t)std::min((int)s.vertices.size(), MAX_POLYGON_VERTICES);
+            p.x = s.center.x;
+            p.y = s.center.y;
+            p.size1 = s.size1;
+            p.size2 = s.size2;
+            p.angle = s.angle;
+            p.reflectance = s.material.reflectance;
+            p.ior = s.material.ior;
+            p.absorption = s.material.absorption;
+            for (uint32_t k = 0; k < p.vertex_count; k++) {
+                p.vx[k] = s.vertices[k].x;
+                p.vy[k] = s.vertices[k].y;
+            }
+            primitives.push_back(p);
+            continue;
+        }
+        x.push_back(s.center.x);
+        y.push_back(s.center.y);
+        r.push_back(s.size1);
+        reflectance.push_back(s.material.reflectance);
+        ior.push_back(s.material.ior);
+        absorption.push_back(s.material.absorption);
+        any_material = any_material || s.material.scatters() || s.material.ior != 1;
+    }
+    header.circle_count = x.size();
+    header.light_count = lights.size();
+    header.material_count = any_material ? x.size() : 0;
+    
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+    for (auto* column : {&x, &y, &r}) {
+        ok = ok && std::fwrite(column->data(), sizeof(double), column->size(), file) == column->size();
+    }
+    ok = ok && std::fwrite(lights.data(), sizeof(SceneFileLight), lights.size(), file) == lights.size();
+    for (auto* column : {&reflectance, &ior, &absorption}) {
+        if (!any_material) break;
+        ok = ok && std::fwrite(column->data(), sizeof(double), column->size(), file) == column->size();
+    }
+    uint64_t primitive_count = primitives.size();
+    ok = ok && std::fwrite(&primitive_count, sizeof(primitive_count), 1, file) == 1;
+    ok = ok && std::fwrite(primitives.data(), sizeof(SceneFilePrimitive), primitives.size(), file) == primitives.size();
+    return std::fclose(file) == 0 && ok;
+}
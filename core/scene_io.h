@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scene.h"
+
+// Scenes on disk come in two variants, told apart by their first bytes.
+//
+// Text, one item per line, '#' starts a comment:
+//
+//     light <x> <y> <radius> [<red> <green> <blue> [<intensity>]]
+//     circle <x> <y> <radius> [<material>]
+//     segment <x> <y> <half length> <angle> [<material>]
+//     rect <x> <y> <half width> <half height> [<angle> [<material>]]
+//     polygon <x> <y> <n> <x1> <y1> ... <xn> <yn> [<material>]
+//
+// with the light's color channels from 0 to 1, the warm yellow and an
+// intensity of 1 when left out, a material as <reflectance> <ior>
+// <absorption>, opaque and matte when left out, angles in radians and a
+// polygon's 3 to MAX_POLYGON_VERTICES corners relative to its center,
+// convex and in either order.
+//
+// Binary: a 64-byte SceneFileHeader, then the circles' x, y and radius as
+// three arrays of little-endian doubles, one after the other, then one
+// SceneFileLight per light, then, if any circle has a material, the
+// circles' reflectance, ior and absorption as three more double arrays,
+// then the number of other shapes as a uint64_t and a SceneFilePrimitive
+// for each. Nothing in it needs parsing, so a mapped file is used in place.
+// Version 1 files had room for one light, in the header, version 2 had no
+// materials and version 3 only circles.
+enum SceneFormat {
+    SCENE_TEXT,
+    SCENE_BINARY
+};
+
+const char SCENE_MAGIC[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', 0};
+const uint32_t SCENE_VERSION = 4;
+const uint32_t SCENE_BYTE_ORDER = 0x01020304;  // reads back differently on a big-endian machine
+
+struct SceneFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t circle_count;
+    double light_x, light_y, light_radius;  // version 1's only light, unused since
+    uint64_t light_count;                   // version 2, zero in version 1 files' padding
+    uint64_t material_count;                // version 3, circle_count or zero when there are no materials
+};
+static_assert(sizeof(SceneFileHeader) == 64, "the circle arrays start 64 bytes in");
+
+struct SceneFileLight {
+    double x, y, radius;
+    double red, green, blue, intensity;
+};
+
+// a segment, rectangle or polygon, with the fields Shape has for it
+struct SceneFilePrimitive {
+    uint32_t type;          // a ShapeType other than SHAPE_CIRCLE
+    uint32_t vertex_count;  // polygons only
+    double x, y, size1, size2, angle;
+    double reflectance, ior, absorption;
+    double vx[MAX_POLYGON_VERTICES], vy[MAX_POLYGON_VERTICES];  // corners past vertex_count are 0
+};
+static_assert(sizeof(SceneFilePrimitive) == 8 + (8 + 2 * MAX_POLYGON_VERTICES) * sizeof(double),
+              "no padding, the records are read in place");
+
+// A binary scene file mapped read-only into memory (read in one go where
+// mmap isn't available). The arrays point straight into the file.
+class SceneFile {
+public:
+    SceneFile() {}
+    ~SceneFile() { close(); }
+    SceneFile(const SceneFile&) = delete;
+    SceneFile& operator=(const SceneFile&) = delete;
+    
+    // false with a message in `error` if the file is missing or not a binary scene
+    bool open(const char* path, std::string& error);
+    void close();
+    
+    size_t circle_count() const { return header ? (size_t)header->circle_count : 0; }
+    size_t light_count() const;
+    SceneFileLight light(size_t index) const;  // version 1's light comes back in the default color
+    const double* x() const { return xs; }
+    const double* y() const { return xs + circle_count(); }
+    const double* radius() const { return xs + 2 * circle_count(); }
+    
+    // null when the file has no materials, then every circle is opaque and matte
+    const double* reflectance() const { return materials; }
+    const double* ior() const { return materials ? materials + circle_count() : nullptr; }
+    const double* absorption() const { return materials ? materials + 2 * circle_count() : nullptr; }
+    
+    // the shapes that aren't circles, none before version 4
+    size_t primitive_count() const { return primitive_total; }
+    const SceneFilePrimitive* primitives() const { return primitive_records; }
+
+private:
+    const SceneFileHeader* header = nullptr;
+    const double* xs = nullptr;
+    const double* materials = nullptr;
+    const SceneFilePrimitive* primitive_records = nullptr;
+    size_t primitive_total = 0;
+    void* mapping = nullptr;    // what mmap returned
+    size_t mapping_size = 0;
+    std::vector<double> buffer;  // the whole file when it couldn't be mapped
+};
+
+// Replaces the scene's shapes with the file's: the lights first, then the
+// other shapes, both in file order (in a binary file the circles before the
+// rest). Either variant is accepted. On failure the
+// scene is left alone and `error` says what was wrong.
+bool load_scene(const char* path, Scene& scene, std::string& error);
+
+bool save_scene(const char* path, const Scene& scene, SceneFormat format);
+
+// SCENE_BINARY for paths ending in ".bin", SCENE_TEXT otherwise
+SceneFormat scene_format_for(const char* path);
@@ -0,0 +1,172 @@
+#include "scene_renderer.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const Rgb GRID_COLOR(40, 40, 40);
+static const Rgb SHAPE_FILL(220, 220, 220);
+static const Rgb SHAPE_OUTLINE(255, 255, 255);
+static const Rgb MIRROR_FILL(170, 190, 215);
+static const Rgb GLASS_FILL(40, 70, 90);
+static const Rgb GLASS_OUTLINE(150, 210, 240);
+static const Rgb SELECT_COLOR(100, 200, 255);
+
+static int channel(double value) {
+    return (int)std::lround(std::max(0.0, std::min(1.0, value)) * 255);
+}
+
+LightColor light_palette(int index) {
+    static const LightColor palette[] = {LightColor(), LightColor(0.4f, 0.7f, 1), LightColor(1, 0.35f, 0.35f),
+                                         LightColor(0.45f, 1, 0.5f), LightColor(0.85f, 0.5f, 1)};
+    return palette[index % 5];
+}
+
+Rgb light_rgb(const LightColor& color) {
+    return Rgb(channel(color.r), channel(color.g), channel(color.b));
+}
+
+// The glow rings around a light, ring j from the inside out. The strongest
+// channel stays, the middle one fades a little with every ring and the
+// weakest one faster, so the default yellow goes orange towards the edge.
+static Rgb glow_color(const LightColor& c, int j) {
+    double v[3] = {c.r, c.g, c.b};
+    double fade[3];
+    for (int i = 0; i < 3; i++) {
+        int above = 0;
+        for (int k = 0; k < 3; k++) above += v[k] > v[i] || (v[k] == v[i] && k < i);
+        fade[i] = above == 0 ? 1 : above == 1 ? 1 - j / 12.0 : 1 - j * 0.15;
+    }
+    return Rgb(channel(v[0] * fade[0]), channel(v[1] * fade[1]), channel(v[2] * fade[2]));
+}
+
+Box shape_draw_bounds(const Shape& shape) {
+    double margin = shape.is_light ? 44 : 10;
+    double r = shape.bounding_radius();
+    Box b = {(double)(int)(shape.center.x - r) - margin, (double)(int)(shape.center.y - r) - margin,
+             (double)(int)(shape.center.x + r) + margin, (double)(int)(shape.center.y + r) + margin};
+    return b;
+}
+
+Point2D resize_handle(const Shape& shape) {
+    return Point2D(shape.center.x + shape.bounding_radius(), shape.center.y);
+}
+
+void draw_canvas_background(RenderBackend& out, int width, int height) {
+    Box canvas = {0, 0, (double)width, (double)height};
+    out.fill_rect(canvas, Rgb(0, 0, 0));
+    for (int x = 0; x < width; x += 20) {
+        out.line(Point2D(x, 0), Point2D(x, height), GRID_COLOR);
+    }
+    for (int y = 0; y < height; y += 20) {
+        out.line(Point2D(0, y), Point2D(width, y), GRID_COLOR);
+    }
+}
+
+void draw_rays(RenderBackend& out, Point2D origin, const std::vector<RayHit>& hits, Rgb color) {
+    for (auto& hit : hits) {
+        Box bounds = {std::min(origin.x, hit.end.x) - 1, std::min(origin.y, hit.end.y) - 1,
+                      std::max(origin.x, hit.end.x) + 2, std::max(origin.y, hit.end.y) + 2};
+        if (!out.visible(bounds)) continue;
+        out.line(origin, hit.end, color);
+    }
+}
+
+void draw_bounces(RenderBackend& out, const std::vector<RaySegment>& segments, Rgb color) {
+    for (auto& segment : segments) {
+        Box bounds = {std::min(segment.from.x, segment.to.x) - 1, std::min(segment.from.y, segment.to.y) - 1,
+                      std::max(segment.from.x, segment.to.x) + 2, std::max(segment.from.y, segment.to.y) + 2};
+        if (!out.visible(bounds)) continue;
+        float k = std::min(segment.energy, 1.0f);
+        out.line(segment.from, segment.to, Rgb((int)(color.r * k), (int)(color.g * k), (int)(color.b * k)));
+    }
+}
+
+// a shape other than a circle: the filled outline with a rim, a segment as a thin bar
+static void draw_primitive(RenderBackend& out, const Shape& shape, Rgb fill, Rgb outline,
+                           std::vector<Point2D>& corners) {
+    shape.outline(corners);
+    if (shape.type == SHAPE_SEGMENT) {
+        double c = std::cos(shape.angle) * 1.5, s = std::sin(shape.angle) * 1.5;
+        Point2D a = corners[0], b = corners[1];
+        corners.assign({Point2D(a.x + s, a.y - c), Point2D(b.x + s, b.y - c), Point2D(b.x - s, b.y + c),
+                        Point2D(a.x - s, a.y + c)});
+        out.fill_polygon(corners, outline);
+        return;
+    }
+    out.fill_polygon(corners, fill);
+    for (size_t k = 0; k < corners.size(); k++) out.line(corners[k], corners[(k + 1) % corners.size()], outline);
+}
+
+// one shape as draw_shapes() has it, the handle left out for draw_scene_view() to draw on screen
+static void draw_shape(RenderBackend& out, const Shape& shape, bool selected, std::vector<Point2D>& corners,
+                       bool handle = true) {
+    if (!out.visible(shape_draw_bounds(shape))) return;
+    if (shape.is_light) {
+        // making the light source glow nicely
+        for (int j = 5; j > 0; j--) {
+            Rgb glow = glow_color(shape.color, j);
+            out.fill_circle(shape.center, shape.size1 + j*8, glow, glow, 1);
+        }
+        // the bright center of the light
+        out.fill_circle(shape.center, shape.size1, Rgb(255, 255, 255), glow_color(shape.color, 1), 1);
+        return;
+    }
+    
+    // glass lets light through, so it's drawn dark with a bright rim, mirrors a cool silver
+    const Material& m = shape.material;
+    Rgb fill = m.absorption < 1 ? GLASS_FILL : m.reflectance > 0 ? MIRROR_FILL : SHAPE_FILL;
+    Rgb outline = m.absorption < 1 ? GLASS_OUTLINE : SHAPE_OUTLINE;
+    if (shape.type == SHAPE_CIRCLE) out.fill_circle(shape.center, shape.size1, fill, outline, 2);
+    else draw_primitive(out, shape, fill, outline, corners);
+    
+    // showing which shape is selected, with the blue handle for resizing
+    if (selected) {
+        double r = shape.bounding_radius();
+        out.dotted_circle(shape.center, r + 5, SELECT_COLOR, 2);
+        if (handle) out.fill_circle(resize_handle(shape), HANDLE_RADIUS, SELECT_COLOR, SELECT_COLOR, 2);
+    }
+}
+
+void draw_shapes(RenderBackend& out, const std::vector<Shape>& shapes, int selected) {
+    std::vector<Point2D> corners;
+    for (int i = 0; i < (int)shapes.size(); i++) draw_shape(out, shapes[i], i == selected, corners);
+}
+
+void draw_scene_view(RenderBackend& out, const Scene& scene, const Camera& camera, int width, int height,
+                     int selected) {
+    CameraBackend world(out, camera);
+    
+    // wide enough for the selection outline shape_draw_bounds() allows for and its rounding, and the handle
+    Box view = camera.view(width, height);
+    double margin = std::max(11.0, (HANDLE_RADIUS + 2) / camera.zoom);
+    Box around = {view.left - margin, view.top - margin, view.right + margin, view.bottom + margin};
+    std::vector<int> shown;
+    std::vector<SpatialGrid::Block> blocks;
+    scene.grid.query_view(around, camera.zoom, LOD_PIXELS, shown, blocks);
+    for (const SpatialGrid::Block& block : blocks) {
+        double c = block.coverage;
+        world.fill_rect(block.box, Rgb((int)(SHAPE_FILL.r * c), (int)(SHAPE_FILL.g * c), (int)(SHAPE_FILL.b * c)));
+    }
+    // the selection stays visible over the blocks
+    if (!blocks.empty() && selected >= 0 && !scene.shapes[selected].is_light) shown.push_back(selected);
+    
+    // the lights merged in by index, so everything overlaps the way draw_shapes() has it
+    const std::vector<int>& lights = scene.lights();
+    std::vector<Point2D> corners;
+    size_t next_light = 0;
+    for (int i : shown) {
+        for (; next_light < lights.size() && lights[next_light] < i; next_light++) {
+            draw_shape(world, scene.shapes[lights[next_light]], false, corners);
+        }
+        draw_shape(world, scene.shapes[i], i == selected, corners, false);
+        
+        // the handle is something to click, so it stays the same size on screen however far the view zooms
+        if (i == selected && !scene.shapes[i].is_light) {
+            Point2D handle = camera.to_screen(resize_handle(scene.shapes[i]));
+            Box bounds = {handle.x - HANDLE_RADIUS - 2, handle.y - HANDLE_RADIUS - 2, handle.x + HANDLE_RADIUS + 2,
+                          handle.y + HANDLE_RADIUS + 2};
+            if (out.visible(bounds)) out.fill_circle(handle, HANDLE_RADIUS, SELECT_COLOR, SELECT_COLOR, 2);
+        }
+    }
+    for (; next_light < lights.size(); next_light++) draw_shape(world, scene.shapes[lights[next_light]], false, corners);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include "bounce.h"
+#include "camera.h"
+#include "geometry.h"
+#include "render_backend.h"
+#include "scene.h"
+#include "tracer.h"
+
+// The editor's look, shared by the window and the headless renderer. Each
+// part skips whatever the backend says is not visible.
+
+// zoomed out so far that the grid's cells come out narrower than this, draw_scene_view() draws its blocks
+const double LOD_PIXELS = 4;
+
+// area a shape's drawing can touch: its selection outline and resize handle, or the light's glow
+Box shape_draw_bounds(const Shape& shape);
+
+// the resize handle of a selected shape, on its bounding circle straight right of the center;
+// draw_scene_view() draws it HANDLE_RADIUS pixels big at any zoom
+Point2D resize_handle(const Shape& shape);
+const double HANDLE_RADIUS = 6;
+
+// black with a subtle grid every 20 pixels
+void draw_canvas_background(RenderBackend& out, int width, int height);
+
+// the colors new lights get in turn, the first one is the default warm yellow
+LightColor light_palette(int index);
+
+// a light's color as 8-bit RGB, the default one is the editor's ray yellow (255, 240, 100)
+Rgb light_rgb(const LightColor& color);
+
+void draw_rays(RenderBackend& out, Point2D origin, const std::vector<RayHit>& hits, Rgb color = Rgb(255, 240, 100));
+
+// reflected and refracted rays in the light's color, dimmer the less energy they carry
+void draw_bounces(RenderBackend& out, const std::vector<RaySegment>& segments, Rgb color);
+
+// shapes in order, the lights with their glow in their color, mirrors and glass tinted, `selected`
+// with its outline and handle
+void draw_shapes(RenderBackend& out, const std::vector<Shape>& shapes, int selected = -1);
+
+// What draw_shapes() draws of the scene, as `camera` shows it on a width x
+// height canvas, with `out` in canvas pixels. Only the shapes the grid finds
+// in view are looked at, so the cost follows the view and not the scene.
+// Zoomed out past LOD_PIXELS the occluders are drawn as the grid's blocks,
+// shaded by how much of each they cover; lights are always drawn one by one.
+void draw_scene_view(RenderBackend& out, const Scene& scene, const Camera& camera, int width, int height,
+                     int selected = -1);
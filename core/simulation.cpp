@@ -0,0 +1,64 @@
+#include "simulation.h"
+
+#include <algorithm>
+#include <cstring>
+
+int Simulation::advance(Scene& scene, double seconds, int* moved) {
+    if (moved) *moved = 0;
+    if (!running) {
+        pending = 0;
+        return 0;
+    }
+    pending += seconds;
+    int steps = std::min((int)(pending / SIMULATION_STEP), MAX_SIMULATION_STEPS);
+    pending = std::min(pending - steps * SIMULATION_STEP, SIMULATION_STEP);
+    for (int i = 0; i < steps; i++) {
+        int n = step(scene);
+        if (moved) *moved += n;
+    }
+    return steps;
+}
+
+int Simulation::step(Scene& scene) {
+    int moved = 0;
+    for (int i = 0; i < (int)scene.shapes.size(); i++) {
+        const Shape& s = scene.shapes[i];
+        Point2D v = s.velocity;
+        if (v.x == 0 && v.y == 0) continue;
+        
+        // off the walls first, only when headed out
+        double r = s.bounding_radius();
+        Point2D at(s.center.x + v.x * SIMULATION_STEP, s.center.y + v.y * SIMULATION_STEP);
+        if ((v.x < 0 && at.x - r < bounds.left) || (v.x > 0 && at.x + r > bounds.right)) v.x = -v.x;
+        if ((v.y < 0 && at.y - r < bounds.top) || (v.y > 0 && at.y + r > bounds.bottom)) v.y = -v.y;
+        
+        // then off the other shapes, through the same check a drag goes through
+        Point2D from = s.center;
+        const Point2D tries[] = {v, Point2D(-v.x, v.y), Point2D(v.x, -v.y), Point2D(-v.x, -v.y)};
+        Point2D next = v;  // boxed in, it stays put this step
+        for (const Point2D& t : tries) {
+            if (scene.try_move_shape(i, Point2D(from.x + t.x * SIMULATION_STEP, from.y + t.y * SIMULATION_STEP))) {
+                next = t;
+                moved++;
+                break;
+            }
+        }
+        scene.shapes[i].velocity = next;
+    }
+    return moved;
+}
+
+uint64_t scene_checksum(const Scene& scene) {
+    // FNV-1a over the centers' bits
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&](double value) {
+        unsigned char bytes[sizeof(double)];
+        std::memcpy(bytes, &value, sizeof(double));
+        for (unsigned char b : bytes) hash = (hash ^ b) * 1099511628211ull;
+    };
+    for (const Shape& s : scene.shapes) {
+        add(s.center.x);
+        add(s.center.y);
+    }
+    return hash;
+}
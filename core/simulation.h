@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include "scene.h"
+
+// one step of the simulation, whatever the frame rate, and the most a frame
+// runs; after a stall it falls behind instead of jumping ahead in one go
+const double SIMULATION_STEP = 1.0 / 120;
+const int MAX_SIMULATION_STEPS = 8;
+
+// Moves every shape and light that has a velocity, on a fixed timestep so
+// the same steps from the same scene always end up in the same place. A
+// step tries each moving shape where its velocity takes it through
+// Scene::try_move_shape, the editor's own collision check on the grid, and
+// bounces it off whatever is in the way: straight on first, then with its
+// x or its y turned back, then both, keeping the first that fits. When none
+// does it stays where it is for the step and tries again on the next one.
+// Shapes bounce off the edges of `bounds` too. Shapes move in index order, each
+// against where the others are at that point.
+class Simulation {
+public:
+    Box bounds = {0, 0, 800, 600};
+    bool running = false;
+    
+    // Adds `seconds` of real time and runs the whole steps that makes, none
+    // while it isn't running. Returns how many ran, and with `moved` how many
+    // shape moves they made between them, 0 when everything was boxed in.
+    int advance(Scene& scene, double seconds, int* moved = nullptr);
+    
+    // one step, returns how many shapes moved
+    int step(Scene& scene);
+
+private:
+    double pending = 0;  // real time not stepped yet
+};
+
+// where every shape is, hashed, so a replay can tell it went the same way
+uint64_t scene_checksum(const Scene& scene);
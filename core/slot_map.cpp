@@ -0,0 +1,41 @@
+#include "slot_map.h"
+
+void SlotMap::reset(int count) {
+    owner.clear();
+    free.clear();
+    for (int s = (int)slots.size() - 1; s >= 0; s--) {
+        if (slots[s].index >= 0) slots[s].generation++;
+        slots[s].index = -1;
+        free.push_back(s);
+    }
+    for (int i = 0; i < count; i++) add();
+}
+
+ShapeHandle SlotMap::add() {
+    int s;
+    if (!free.empty()) {
+        s = free.back();
+        free.pop_back();
+    } else {
+        s = (int)slots.size();
+        slots.push_back(Slot{-1, 0});
+    }
+    slots[s].index = (int)owner.size();
+    owner.push_back(s);
+    return ShapeHandle{s, slots[s].generation};
+}
+
+void SlotMap::erase(int index) {
+    Slot& gone = slots[owner[index]];
+    gone.index = -1;
+    gone.generation++;
+    free.push_back(owner[index]);
+    
+    // the last position's slot follows its element into the hole
+    int last = (int)owner.size() - 1;
+    if (index != last) {
+        owner[index] = owner[last];
+        slots[owner[index]].index = index;
+    }
+    owner.pop_back();
+}
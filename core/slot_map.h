@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+// A shape that stays the same shape while others come and go: the slot it
+// got when it was added, and that slot's generation at the time. Erasing the
+// shape frees the slot and bumps its generation, so an old handle finds
+// nothing instead of whatever gets the slot next.
+struct ShapeHandle {
+    int slot = -1;
+    unsigned generation = 0;
+    
+    bool operator==(const ShapeHandle& o) const { return slot == o.slot && generation == o.generation; }
+    bool operator!=(const ShapeHandle& o) const { return !(*this == o); }
+};
+
+// Handles for a packed array. The array stays contiguous for the loops that
+// walk all of it, and erasing fills the hole with its last element instead of
+// moving everything after it down, so elements move but handles don't: the
+// map keeps which slot owns each position and where each slot's element is.
+// Adding, erasing and looking up are O(1); freed slots are reused, newest first.
+class SlotMap {
+public:
+    // handles for positions 0 to count - 1, every handle from before goes stale
+    void reset(int count);
+    
+    // a handle for the element just appended at position size()
+    ShapeHandle add();
+    
+    // the element at `index` was erased and the last one moved into its place
+    void erase(int index);
+    
+    // where the handle's element is now, -1 once it was erased
+    int index_of(ShapeHandle handle) const {
+        if (handle.slot < 0 || handle.slot >= (int)slots.size()) return -1;
+        const Slot& s = slots[handle.slot];
+        return s.generation == handle.generation && s.index >= 0 ? s.index : -1;
+    }
+    
+    ShapeHandle handle_of(int index) const { return ShapeHandle{owner[index], slots[owner[index]].generation}; }
+    
+    int size() const { return (int)owner.size(); }
+
+private:
+    struct Slot {
+        int index;            // position of the element, -1 while the slot is free
+        unsigned generation;  // bumped every time the slot is freed
+    };
+    
+    std::vector<Slot> slots;
+    std::vector<int> owner;  // the slot of every position
+    std::vector<int> free;   // slots to hand out again, the last one first
+};
@@ -0,0 +1,242 @@
+#include "soft_raster.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "scanline.h"
+
+static const double PI = 3.14159265359;
+
+SoftwareRaster::SoftwareRaster(int width, int height) : w(0), h(0) {
+    resize(width, height);
+}
+
+void SoftwareRaster::resize(int width, int height) {
+    w = std::max(width, 0);
+    h = std::max(height, 0);
+    rgba.assign((size_t)w * h * 4, 255);
+}
+
+Rgb SoftwareRaster::pixel(int x, int y) const {
+    const unsigned char* p = &rgba[((size_t)y * w + x) * 4];
+    return Rgb(p[0], p[1], p[2]);
+}
+
+void SoftwareRaster::put(int x, int y, Rgb color) {
+    if (x < 0 || y < 0 || x >= w || y >= h) return;
+    unsigned char* p = &rgba[((size_t)y * w + x) * 4];
+    p[0] = color.r;
+    p[1] = color.g;
+    p[2] = color.b;
+}
+
+void SoftwareRaster::span(int y, int x0, int x1, Rgb color) {
+    if (y < 0 || y >= h) return;
+    x0 = std::max(x0, 0);
+    x1 = std::min(x1, w - 1);
+    unsigned char* p = &rgba[((size_t)y * w + x0) * 4];
+    for (int x = x0; x <= x1; x++, p += 4) {
+        p[0] = color.r;
+        p[1] = color.g;
+        p[2] = color.b;
+    }
+}
+
+void SoftwareRaster::fill_rect(const Box& box, Rgb color) {
+    int x0 = (int)std::floor(box.left), x1 = (int)std::ceil(box.right) - 1;
+    int y0 = std::max((int)std::floor(box.top), 0), y1 = std::min((int)std::ceil(box.bottom), h);
+    for (int y = y0; y < y1; y++) span(y, x0, x1, color);
+    draw_calls++;
+}
+
+void SoftwareRaster::line(Point2D from, Point2D to, Rgb color) {
+    draw_calls++;
+    if (w == 0 || h == 0) return;
+    
+    // clipping to the framebuffer first, rays reach far past it (Liang-Barsky)
+    double dx = to.x - from.x, dy = to.y - from.y;
+    double t0 = 0, t1 = 1;
+    double p[4] = {-dx, dx, -dy, dy};
+    double q[4] = {from.x, w - 1 - from.x, from.y, h - 1 - from.y};
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) return;
+            continue;
+        }
+        double r = q[i] / p[i];
+        if (p[i] < 0) t0 = std::max(t0, r);
+        else t1 = std::min(t1, r);
+        if (t0 > t1) return;
+    }
+    
+    // then a plain Bresenham walk between the truncated end points, like GDI
+    int x = (int)(from.x + t0 * dx), y = (int)(from.y + t0 * dy);
+    int x_end = (int)(from.x + t1 * dx), y_end = (int)(from.y + t1 * dy);
+    int step_x = x < x_end ? 1 : -1, step_y = y < y_end ? 1 : -1;
+    int adx = std::abs(x_end - x), ady = -std::abs(y_end - y);
+    int err = adx + ady;
+    while (true) {
+        put(x, y, color);
+        if (x == x_end && y == y_end) break;
+        int e2 = 2 * err;
+        if (e2 >= ady) { err += ady; x += step_x; }
+        if (e2 <= adx) { err += adx; y += step_y; }
+    }
+}
+
+// the pixels of row y whose centers are inside the circle, false if there are none
+static bool circle_span(Point2D center, double radius, int y, int& x0, int& x1) {
+    double dy = y + 0.5 - center.y;
+    if (radius <= 0 || std::fabs(dy) > radius) return false;
+    double half = std::sqrt(radius * radius - dy * dy);
+    x0 = (int)std::ceil(center.x - half - 0.5);
+    x1 = (int)std::floor(center.x + half - 0.5);
+    return x0 <= x1;
+}
+
+void SoftwareRaster::fill_circle(Point2D center, double radius, Rgb fill, Rgb outline, int outline_width) {
+    draw_calls++;
+    int y0 = std::max((int)std::floor(center.y - radius), 0);
+    int y1 = std::min((int)std::ceil(center.y + radius), h - 1);
+    double inner = radius - outline_width;
+    for (int y = y0; y <= y1; y++) {
+        int ox0, ox1, ix0, ix1;
+        if (!circle_span(center, radius, y, ox0, ox1)) continue;
+        if (outline_width <= 0) {
+            span(y, ox0, ox1, fill);
+        } else if (!circle_span(center, inner, y, ix0, ix1)) {
+            span(y, ox0, ox1, outline);
+        } else {
+            span(y, ox0, ix0 - 1, outline);
+            span(y, ix0, ix1, fill);
+            span(y, ix1 + 1, ox1, outline);
+        }
+    }
+}
+
+void SoftwareRaster::dotted_circle(Point2D center, double radius, Rgb color, int width) {
+    draw_calls++;
+    int y0 = std::max((int)std::floor(center.y - radius), 0);
+    int y1 = std::min((int)std::ceil(center.y + radius), h - 1);
+    for (int y = y0; y <= y1; y++) {
+        int ox0, ox1, ix0 = 0, ix1 = -1;
+        if (!circle_span(center, radius, y, ox0, ox1)) continue;
+        bool hollow = circle_span(center, radius - width, y, ix0, ix1);
+        for (int x = std::max(ox0, 0); x <= std::min(ox1, w - 1); x++) {
+            if (hollow && x >= ix0 && x <= ix1) continue;
+            // dashes about 3 pixels long along the outline
+            double angle = std::atan2(y + 0.5 - center.y, x + 0.5 - center.x) + PI;
+            if ((int)(angle * radius / 3) % 2 == 0) put(x, y, color);
+        }
+    }
+}
+
+void SoftwareRaster::fill_polygon(const std::vector<Point2D>& points, Rgb color) {
+    draw_calls++;
+    if (points.size() < 3 || h == 0) return;
+    
+    // only the rows the polygon covers, small shapes are drawn by the thousand
+    double top = points[0].y, bottom = points[0].y;
+    for (const Point2D& p : points) {
+        top = std::min(top, p.y);
+        bottom = std::max(bottom, p.y);
+    }
+    int row_begin = (int)std::max(0.0, std::floor(top)), row_end = (int)std::min((double)h, std::ceil(bottom) + 1);
+    scan_polygon(points, row_begin, row_end, [&](int y, int x0, int x1) { span(y, x0, x1, color); });
+}
+
+bool SoftwareRaster::write_ppm(const char* path) const {
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    std::fprintf(file, "P6\n%d %d\n255\n", w, h);
+    std::vector<unsigned char> row((size_t)w * 3);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            const unsigned char* p = &rgba[((size_t)y * w + x) * 4];
+            row[x * 3] = p[0];
+            row[x * 3 + 1] = p[1];
+            row[x * 3 + 2] = p[2];
+        }
+        std::fwrite(row.data(), 1, row.size(), file);
+    }
+    return std::fclose(file) == 0;
+}
+
+static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0) {
+    static unsigned int table[256];
+    static bool ready = false;
+    if (!ready) {
+        for (unsigned int n = 0; n < 256; n++) {
+            unsigned int c = n;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        ready = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_u32(std::vector<unsigned char>& out, unsigned int v) {
+    out.push_back((unsigned char)(v >> 24));
+    out.push_back((unsigned char)(v >> 16));
+    out.push_back((unsigned char)(v >> 8));
+    out.push_back((unsigned char)v);
+}
+
+static void write_chunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk;
+    put_u32(chunk, (unsigned int)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put_u32(chunk, crc32(&chunk[4], chunk.size() - 4));
+    std::fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+bool SoftwareRaster::write_png(const char* path) const {
+    FILE* file = std::fopen(path, "wb");
+    if (!file) return false;
+    static const unsigned char signature[8] = {137, 'P', 'N', 'G', '\r', '\n', 26, '\n'};
+    std::fwrite(signature, 1, 8, file);
+    
+    // 8-bit RGBA, no interlacing
+    std::vector<unsigned char> header;
+    put_u32(header, (unsigned int)w);
+    put_u32(header, (unsigned int)h);
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    write_chunk(file, "IHDR", header);
+    
+    // every row behind a "no filter" byte
+    std::vector<unsigned char> raw;
+    raw.reserve((size_t)h * (w * 4 + 1));
+    for (int y = 0; y < h; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba.begin() + (size_t)y * w * 4, rgba.begin() + (size_t)(y + 1) * w * 4);
+    }
+    
+    // a zlib stream of uncompressed deflate blocks, no compressor needed
+    std::vector<unsigned char> data = {0x78, 0x01};
+    size_t offset = 0;
+    do {
+        size_t size = std::min(raw.size() - offset, (size_t)65535);
+        bool last = offset + size == raw.size();
+        data.push_back(last ? 1 : 0);
+        data.push_back((unsigned char)size);
+        data.push_back((unsigned char)(size >> 8));
+        data.push_back((unsigned char)~size);
+        data.push_back((unsigned char)(~size >> 8));
+        data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+    
+    unsigned int a = 1, b = 0;
+    for (unsigned char c : raw) {
+        a = (a + c) % 65521;
+        b = (b + a) % 65521;
+    }
+    put_u32(data, (b << 16) | a);
+    write_chunk(file, "IDAT", data);
+    write_chunk(file, "IEND", std::vector<unsigned char>());
+    return std::fclose(file) == 0;
+}
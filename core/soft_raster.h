@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "render_backend.h"
+
+// Draws into an RGBA framebuffer in memory, with no platform dependency,
+// so the scene can be rendered and timed headless. Coordinates follow GDI:
+// pixel (x, y) covers [x, x+1) x [y, y+1) and shapes cover the pixels whose
+// centers they contain. Everything is drawn opaque, alpha is always 255.
+class SoftwareRaster : public RenderBackend {
+public:
+    SoftwareRaster(int width = 0, int height = 0);
+    
+    void resize(int width, int height);
+    int width() const { return w; }
+    int height() const { return h; }
+    
+    // 4 bytes per pixel, rows top to bottom
+    const std::vector<unsigned char>& pixels() const { return rgba; }
+    std::vector<unsigned char>& pixels() { return rgba; }
+    Rgb pixel(int x, int y) const;
+    
+    void fill_rect(const Box& box, Rgb color) override;
+    void line(Point2D from, Point2D to, Rgb color) override;
+    void fill_circle(Point2D center, double radius, Rgb fill, Rgb outline, int outline_width) override;
+    void dotted_circle(Point2D center, double radius, Rgb color, int width) override;
+    void fill_polygon(const std::vector<Point2D>& points, Rgb color) override;
+    
+    // binary PPM (alpha dropped) or PNG with stored deflate blocks, false if the file can't be written
+    bool write_ppm(const char* path) const;
+    bool write_png(const char* path) const;
+
+private:
+    int w, h;
+    std::vector<unsigned char> rgba;
+    
+    void put(int x, int y, Rgb color);
+    void span(int y, int x0, int x1, Rgb color);  // x0 to x1, both included, clipped
+};
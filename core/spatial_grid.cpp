@@ -0,0 +1,378 @@
+#include "spatial_grid.h"
+#include "primitive_store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// what a shape covers for the pyramid, a segment as a line one unit wide
+static float shape_area(const Shape& s) {
+    switch (s.type) {
+        case SHAPE_CIRCLE: return (float)(3.14159265359 * s.size1 * s.size1);
+        case SHAPE_SEGMENT: return (float)(2 * s.size1);
+        case SHAPE_RECT: return (float)(4 * s.size1 * s.size2);
+        default: return (float)(std::fabs(polygon_area2(s.vertices)) / 2);
+    }
+}
+
+void SpatialGrid::rebuild() {
+    cells.clear();
+    levels.clear();
+    spans.assign(shapes.size(), CellSpan{0, 0, -1, -1, 0});
+    cols = rows = 0;
+    indexed = 0;
+    
+    // fitting the grid around everything that can block a ray
+    double lo_x = 0, lo_y = 0, hi_x = 0, hi_y = 0, radius_sum = 0;
+    int count = 0;
+    for (const Shape& s : shapes) {
+        if (s.is_light) continue;
+        double r = s.bounding_radius();
+        if (count == 0) {
+            lo_x = s.center.x - r; hi_x = s.center.x + r;
+            lo_y = s.center.y - r; hi_y = s.center.y + r;
+        } else {
+            lo_x = std::min(lo_x, s.center.x - r); hi_x = std::max(hi_x, s.center.x + r);
+            lo_y = std::min(lo_y, s.center.y - r); hi_y = std::max(hi_y, s.center.y + r);
+        }
+        radius_sum += r;
+        count++;
+    }
+    indexed_at_rebuild = count;
+    if (count == 0) return;
+    
+    // roughly one shape per cell, but never cells smaller than a shape
+    double width = hi_x - lo_x, height = hi_y - lo_y;
+    double avg_diameter = 2 * radius_sum / count;
+    cell_size = std::max(avg_diameter, std::sqrt(width * height / count));
+    cell_size = std::max(cell_size, 1.0);
+    
+    // some slack on every side so new shapes near the edge don't force a rebuild
+    double pad = std::max(cell_size, 0.25 * std::max(width, height));
+    min_x = lo_x - pad;
+    min_y = lo_y - pad;
+    cols = (int)std::ceil((width + 2 * pad) / cell_size);
+    rows = (int)std::ceil((height + 2 * pad) / cell_size);
+    
+    // keeping memory sane for very spread out scenes
+    const double max_cells = 4.0 * count + 4096;
+    if ((double)cols * rows > max_cells) {
+        double scale = std::sqrt((double)cols * rows / max_cells);
+        cell_size *= scale;
+        cols = (int)std::ceil((width + 2 * pad) / cell_size);
+        rows = (int)std::ceil((height + 2 * pad) / cell_size);
+    }
+    cols = std::max(cols, 1);
+    rows = std::max(rows, 1);
+    cells.assign((size_t)cols * rows, std::vector<int>());
+    levels.assign(1, Level{cols, rows, std::vector<float>((size_t)cols * rows, 0.0f)});
+    
+    // counting first so every cell is allocated once, big scene loads spend most of their time here
+    std::vector<int> counts((size_t)cols * rows, 0);
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (shapes[i].is_light) continue;
+        CellSpan span = span_for(shapes[i]);
+        for (int y = span.y0; y <= span.y1; y++) {
+            for (int x = span.x0; x <= span.x1; x++) counts[(size_t)y * cols + x]++;
+        }
+    }
+    for (size_t c = 0; c < cells.size(); c++) {
+        if (counts[c]) cells[c].reserve(counts[c]);
+    }
+    
+    for (int i = 0; i < (int)shapes.size(); i++) {
+        if (!shapes[i].is_light) add_to_cells(i);
+    }
+    
+    // the coarser levels once, from the cells' sums
+    build_levels();
+}
+
+void SpatialGrid::build_levels() {
+    while (levels.back().cols > 1 || levels.back().rows > 1) {
+        const Level& fine = levels.back();
+        Level coarse{(fine.cols + 1) / 2, (fine.rows + 1) / 2, std::vector<float>()};
+        coarse.area.assign((size_t)coarse.cols * coarse.rows, 0.0f);
+        for (int y = 0; y < fine.rows; y++) {
+            for (int x = 0; x < fine.cols; x++) {
+                coarse.area[(size_t)(y / 2) * coarse.cols + x / 2] += fine.area[(size_t)y * fine.cols + x];
+            }
+        }
+        levels.push_back(std::move(coarse));
+    }
+}
+
+void SpatialGrid::add_area(const CellSpan& span, float area) {
+    // every level the block holding the middle cell is in, only level 0 while rebuild() fills it
+    int x = (span.x0 + span.x1) / 2, y = (span.y0 + span.y1) / 2;
+    for (Level& level : levels) {
+        level.area[(size_t)y * level.cols + x] += area;
+        x /= 2;
+        y /= 2;
+    }
+}
+
+void SpatialGrid::insert(int index) {
+    // the grid only handles appends incrementally, anything else is rare enough to rebuild
+    if (index != (int)spans.size()) { rebuild(); return; }
+    spans.push_back(CellSpan{0, 0, -1, -1, 0});
+    
+    const Shape& shape = shapes[index];
+    if (shape.is_light) return;
+    
+    // re-tuning the cell size once the scene has grown a lot since the last fit
+    bool grew_a_lot = indexed + 1 > 2 * std::max(indexed_at_rebuild, 16);
+    if (cols == 0 || grew_a_lot || !fits(shape)) { rebuild(); return; }
+    add_to_cells(index);
+}
+
+void SpatialGrid::update(int index) {
+    const Shape& shape = shapes[index];
+    if (shape.is_light) return;
+    
+    // a small move, like a simulation step, mostly stays in the same cells with the same area
+    const CellSpan& old = spans[index];
+    if (cols > 0 && old.x0 <= old.x1 && fits(shape)) {
+        CellSpan span = span_for(shape);
+        if (span.x0 == old.x0 && span.y0 == old.y0 && span.x1 == old.x1 && span.y1 == old.y1 &&
+            shape_area(shape) == old.area) return;
+    }
+    remove_from_cells(index);
+    if (cols == 0 || !fits(shape)) { rebuild(); return; }
+    add_to_cells(index);
+}
+
+void SpatialGrid::erase(int index) {
+    remove_from_cells(index);
+    
+    // the last shape took the erased one's place, only its own cells list it
+    int last = (int)spans.size() - 1;
+    if (index != last) {
+        const CellSpan& span = spans[index] = spans[last];
+        for (int y = span.y0; y <= span.y1; y++) {
+            for (int x = span.x0; x <= span.x1; x++) {
+                auto& cell = cells[(size_t)y * cols + x];
+                *std::find(cell.begin(), cell.end(), last) = index;
+            }
+        }
+    }
+    spans.pop_back();
+}
+
+bool SpatialGrid::first_hit(Point2D from, Point2D dir, double max_t, double& t, int& hit_index,
+                            const PrimitiveStore* primitives) const {
+    if (cols == 0) return false;
+    const double inf = std::numeric_limits<double>::infinity();
+    double max_x = min_x + cols * cell_size;
+    double max_y = min_y + rows * cell_size;
+    
+    // clipping the ray to the grid bounds first
+    double t_enter = 0, t_leave = max_t;
+    if (dir.x != 0) {
+        double a = (min_x - from.x) / dir.x, b = (max_x - from.x) / dir.x;
+        t_enter = std::max(t_enter, std::min(a, b));
+        t_leave = std::min(t_leave, std::max(a, b));
+    } else if (from.x < min_x || from.x > max_x) {
+        return false;
+    }
+    if (dir.y != 0) {
+        double a = (min_y - from.y) / dir.y, b = (max_y - from.y) / dir.y;
+        t_enter = std::max(t_enter, std::min(a, b));
+        t_leave = std::min(t_leave, std::max(a, b));
+    } else if (from.y < min_y || from.y > max_y) {
+        return false;
+    }
+    if (t_enter > t_leave) return false;
+    
+    // the cell where the ray enters the grid
+    double px = from.x + dir.x * t_enter, py = from.y + dir.y * t_enter;
+    int cx = std::min(std::max((int)std::floor((px - min_x) / cell_size), 0), cols - 1);
+    int cy = std::min(std::max((int)std::floor((py - min_y) / cell_size), 0), rows - 1);
+    
+    int step_x = dir.x > 0 ? 1 : -1;
+    int step_y = dir.y > 0 ? 1 : -1;
+    double next_x = dir.x > 0 ? (min_x + (cx + 1) * cell_size - from.x) / dir.x
+                  : dir.x < 0 ? (min_x + cx * cell_size - from.x) / dir.x : inf;
+    double next_y = dir.y > 0 ? (min_y + (cy + 1) * cell_size - from.y) / dir.y
+                  : dir.y < 0 ? (min_y + cy * cell_size - from.y) / dir.y : inf;
+    double delta_x = dir.x != 0 ? cell_size / std::fabs(dir.x) : inf;
+    double delta_y = dir.y != 0 ? cell_size / std::fabs(dir.y) : inf;
+    
+    double best = max_t;
+    bool found = false;
+    while (true) {
+        for (int i : cells[(size_t)cy * cols + cx]) {
+            double hit_t;
+            const Shape& s = shapes[i];
+            bool hit = s.type == SHAPE_CIRCLE || !primitives ? s.intersects_ray(from, dir, hit_t)
+                                                             : primitives->hit(i, from, dir, hit_t);
+            if (hit && hit_t < best) {
+                best = hit_t;
+                hit_index = i;
+                found = true;
+            }
+        }
+        
+        // a hit inside this cell can't be beaten by anything further along
+        double cell_exit = std::min(next_x, next_y);
+        if (found && best <= cell_exit) break;
+        if (cell_exit > t_leave) break;
+        
+        if (next_x < next_y) {
+            cx += step_x;
+            if (cx < 0 || cx >= cols) break;
+            next_x += delta_x;
+        } else {
+            cy += step_y;
+            if (cy < 0 || cy >= rows) break;
+            next_y += delta_y;
+        }
+    }
+    
+    if (found) t = best;
+    return found;
+}
+
+bool SpatialGrid::any_overlap(Point2D center, double radius, int exclude_index) const {
+    if (cols == 0) return false;
+    int x0, y0, x1, y1;
+    cell_range(Box{center.x - radius, center.y - radius, center.x + radius, center.y + radius}, x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            for (int i : cells[(size_t)y * cols + x]) {
+                if (i == exclude_index) continue;
+                const Shape& s = shapes[i];
+                double dx = center.x - s.center.x, dy = center.y - s.center.y;
+                double reach = radius + s.bounding_radius();
+                if (dx * dx + dy * dy < reach * reach) return true;
+            }
+        }
+    }
+    return false;
+}
+
+void SpatialGrid::overlapping(Point2D center, double radius, std::vector<int>& out) const {
+    out.clear();
+    if (cols == 0) return;
+    int x0, y0, x1, y1;
+    cell_range(Box{center.x - radius, center.y - radius, center.x + radius, center.y + radius}, x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            for (int i : cells[(size_t)y * cols + x]) {
+                const Shape& s = shapes[i];
+                double dx = center.x - s.center.x, dy = center.y - s.center.y;
+                double reach = radius + s.bounding_radius();
+                if (dx * dx + dy * dy < reach * reach) out.push_back(i);
+            }
+        }
+    }
+    // big shapes sit in several cells
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+void SpatialGrid::query(const Box& box, std::vector<int>& out) const {
+    out.clear();
+    if (cols == 0) return;
+    int x0, y0, x1, y1;
+    cell_range(box, x0, y0, x1, y1);
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            for (int i : cells[(size_t)y * cols + x]) {
+                // a shape in several cells only counts in the first one the box shares with it
+                const CellSpan& span = spans[i];
+                if (x != std::max(span.x0, x0) || y != std::max(span.y0, y0)) continue;
+                const Shape& s = shapes[i];
+                double r = s.bounding_radius();
+                if (s.center.x + r < box.left || s.center.x - r > box.right || s.center.y + r < box.top ||
+                    s.center.y - r > box.bottom) continue;
+                out.push_back(i);
+            }
+        }
+    }
+    std::sort(out.begin(), out.end());
+}
+
+void SpatialGrid::query_view(const Box& box, double pixels_per_unit, double min_pixels, std::vector<int>& out,
+                             std::vector<Block>& blocks) const {
+    out.clear();
+    blocks.clear();
+    if (cols == 0) return;
+    if (cell_size * pixels_per_unit >= min_pixels) {
+        query(box, out);
+        return;
+    }
+    
+    // the finest level that's coarse enough, or the single top block
+    size_t k = 0;
+    double size = cell_size;
+    while (size * pixels_per_unit < min_pixels && k + 1 < levels.size()) {
+        size *= 2;
+        k++;
+    }
+    const Level& level = levels[k];
+    auto block_of = [&](double v, double lo, int count) {
+        double b = std::floor((v - lo) / size);
+        return (int)std::min(std::max(b, 0.0), (double)(count - 1));
+    };
+    int x0 = block_of(box.left, min_x, level.cols), x1 = block_of(box.right, min_x, level.cols);
+    int y0 = block_of(box.top, min_y, level.rows), y1 = block_of(box.bottom, min_y, level.rows);
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            float area = level.area[(size_t)y * level.cols + x];
+            if (area <= 0) continue;
+            Box b = {min_x + x * size, min_y + y * size, min_x + (x + 1) * size, min_y + (y + 1) * size};
+            blocks.push_back(Block{b, std::min(area / (size * size), 1.0)});
+        }
+    }
+}
+
+void SpatialGrid::add_to_cells(int index) {
+    CellSpan span = span_for(shapes[index]);
+    for (int y = span.y0; y <= span.y1; y++) {
+        for (int x = span.x0; x <= span.x1; x++) {
+            cells[(size_t)y * cols + x].push_back(index);
+        }
+    }
+    span.area = shape_area(shapes[index]);
+    add_area(span, span.area);
+    spans[index] = span;
+    indexed++;
+}
+
+void SpatialGrid::remove_from_cells(int index) {
+    CellSpan& span = spans[index];
+    if (span.x0 > span.x1) return;
+    for (int y = span.y0; y <= span.y1; y++) {
+        for (int x = span.x0; x <= span.x1; x++) {
+            auto& cell = cells[(size_t)y * cols + x];
+            auto it = std::find(cell.begin(), cell.end(), index);
+            if (it != cell.end()) {
+                *it = cell.back();
+                cell.pop_back();
+            }
+        }
+    }
+    add_area(span, -span.area);
+    span = CellSpan{0, 0, -1, -1, 0};
+    indexed--;
+}
+
+SpatialGrid::CellSpan SpatialGrid::span_for(const Shape& shape) const {
+    double r = shape.bounding_radius();
+    CellSpan span;
+    span.area = 0;
+    span.x0 = (int)std::floor((shape.center.x - r - min_x) / cell_size);
+    span.y0 = (int)std::floor((shape.center.y - r - min_y) / cell_size);
+    span.x1 = (int)std::floor((shape.center.x + r - min_x) / cell_size);
+    span.y1 = (int)std::floor((shape.center.y + r - min_y) / cell_size);
+    span.x0 = std::max(span.x0, 0); span.y0 = std::max(span.y0, 0);
+    span.x1 = std::min(span.x1, cols - 1); span.y1 = std::min(span.y1, rows - 1);
+    return span;
+}
+
+bool SpatialGrid::fits(const Shape& shape) const {
+    double r = shape.bounding_radius();
+    return shape.center.x - r >= min_x && shape.center.x + r <= min_x + cols * cell_size &&
+           shape.center.y - r >= min_y && shape.center.y + r <= min_y + rows * cell_size;
+}
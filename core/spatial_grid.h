@@ -0,0 +1,106 @@
+#pragma once
+
+#include <vector>
+#include "geometry.h"
+
+class PrimitiveStore;
+
+// A uniform grid over the non-light shapes. Every shape is listed in each
+// cell its bounding box touches, and rays walk the cells in order (DDA) so
+// they only test the shapes they actually pass by.
+//
+// The grid keeps indices into the shape vector it was built for, so it has
+// to be told about every add, move, resize and erase to stay in sync.
+//
+// On top of the cells sits a pyramid of coarser levels, each block of level
+// k adding up the area the shapes centered in its 2^k x 2^k cells cover. A
+// view too far out to draw single shapes reads those blocks instead, so
+// what it costs depends on the view and never on how many shapes are in it.
+class SpatialGrid {
+public:
+    // a pyramid block in a zoomed-out view, and the share of it the shapes cover
+    struct Block {
+        Box box;
+        double coverage;
+    };
+    
+    explicit SpatialGrid(const std::vector<Shape>& shapes) : shapes(shapes) {}
+    
+    // throws everything away and fits the grid to the current shapes
+    void rebuild();
+    
+    // incremental updates, called right after the shape vector changed
+    void insert(int index);              // shapes[index] was just added
+    void update(int index);              // shapes[index] moved or resized
+    void erase(int index);               // shapes[index] was erased, the last shape moved into its place
+    
+    // Nearest hit along the ray with t < max_t, same answer as testing every
+    // shape. Circles are tested in place; with `primitives` the other shapes
+    // are tested against its records instead of working out their frame or
+    // edges again for every ray.
+    bool first_hit(Point2D from, Point2D dir, double max_t, double& t, int& hit_index,
+                   const PrimitiveStore* primitives = nullptr) const;
+    
+    // Overlap queries for placing, dragging and resizing: a shape overlaps
+    // when its bounding circle and the given one are closer than their
+    // radii added up. Only the cells the circle's box touches are visited.
+    bool any_overlap(Point2D center, double radius, int exclude_index = -1) const;
+    void overlapping(Point2D center, double radius, std::vector<int>& out) const;  // sorted by index
+    
+    // the shapes whose bounding box touches `box`, each once, sorted by index
+    void query(const Box& box, std::vector<int>& out) const;
+    
+    // What a view of `box` at `pixels_per_unit` should draw. Where a cell
+    // comes out at least `min_pixels` wide that's query(), otherwise `out`
+    // stays empty and `blocks` gets the non-empty blocks touching the box
+    // from the finest level whose blocks are at least that wide.
+    void query_view(const Box& box, double pixels_per_unit, double min_pixels, std::vector<int>& out,
+                    std::vector<Block>& blocks) const;
+    
+    int column_count() const { return cols; }
+    int row_count() const { return rows; }
+    double cell_width() const { return cell_size; }
+
+private:
+    struct CellSpan {
+        int x0, y0, x1, y1;  // inclusive range, x0 > x1 means not in the grid
+        float area;          // what the shape added to the pyramid, in the cell at the middle of the range
+    };
+    
+    // cols x rows blocks of 2^k x 2^k cells for level k
+    struct Level {
+        int cols, rows;
+        std::vector<float> area;
+    };
+    
+    void add_to_cells(int index);
+    void remove_from_cells(int index);
+    void add_area(const CellSpan& span, float area);
+    void build_levels();
+    CellSpan span_for(const Shape& shape) const;
+    bool fits(const Shape& shape) const;
+    void cell_range(const Box& box, int& x0, int& y0, int& x1, int& y1) const;
+    
+    const std::vector<Shape>& shapes;
+    std::vector<std::vector<int>> cells;
+    std::vector<CellSpan> spans;  // one per shape index
+    std::vector<Level> levels;    // level 0 is the cells themselves, up to a single block
+    double min_x = 0, min_y = 0;
+    double cell_size = 64;
+    int cols = 0, rows = 0;
+    int indexed = 0;              // shapes currently in the grid
+    int indexed_at_rebuild = 0;   // used to re-tune the cell size as the scene grows
+};
+
+// here rather than in the .cpp so the collision queries can inline it
+inline void SpatialGrid::cell_range(const Box& box, int& x0, int& y0, int& x1, int& y1) const {
+    // clamped as doubles first, a huge radius would overflow the int
+    auto cell_of = [&](double v, double lo, int count) {
+        double c = std::floor((v - lo) / cell_size);
+        return (int)std::min(std::max(c, 0.0), (double)(count - 1));
+    };
+    x0 = cell_of(box.left, min_x, cols);
+    y0 = cell_of(box.top, min_y, rows);
+    x1 = cell_of(box.right, min_x, cols);
+    y1 = cell_of(box.bottom, min_y, rows);
+}
@@ -0,0 +1,115 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) {
+    if (threads <= 0) threads = std::max(1, (int)std::thread::hardware_concurrency());
+    for (int i = 0; i < threads; i++) queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    
+    // the calling thread does its share, so one worker fewer than threads
+    for (int i = 0; i < threads - 1; i++) {
+        workers.push_back(std::thread(&ThreadPool::worker_loop, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(job_lock);
+        stopping = true;
+    }
+    job_ready.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+void ThreadPool::parallel_for(int count, int chunk, const std::function<void(int, int)>& fn) {
+    if (count <= 0) return;
+    chunk = std::max(chunk, 1);
+    
+    // nothing to share, skipping the handoff entirely
+    if (workers.empty() || count <= chunk) {
+        fn(0, count);
+        return;
+    }
+    
+    std::lock_guard<std::mutex> submit(submit_lock);
+    int threads = thread_count();
+    int chunks = (count + chunk - 1) / chunk;
+    
+    // the body has to be in place before a range shows up in any queue,
+    // a worker still draining the last job could grab it right away
+    {
+        std::lock_guard<std::mutex> guard(job_lock);
+        body = &fn;
+        remaining = chunks;
+    }
+    
+    // dealing neighbouring chunks to the same thread keeps its rays coherent
+    int per_thread = (chunks + threads - 1) / threads;
+    for (int c = 0; c < chunks; c++) {
+        Queue& q = *queues[std::min(c / per_thread, threads - 1)];
+        std::lock_guard<std::mutex> guard(q.lock);
+        q.ranges.push_back(Range{c * chunk, std::min(count, (c + 1) * chunk)});
+    }
+    
+    {
+        std::lock_guard<std::mutex> guard(job_lock);
+        job_id++;
+    }
+    job_ready.notify_all();
+    
+    int self = threads - 1;
+    while (run_one(self)) {}
+    
+    std::unique_lock<std::mutex> guard(job_lock);
+    job_done.wait(guard, [this] { return remaining == 0; });
+    body = nullptr;
+}
+
+void ThreadPool::worker_loop(int id) {
+    unsigned long long seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(job_lock);
+            job_ready.wait(guard, [&] { return stopping || job_id != seen; });
+            if (stopping) return;
+            seen = job_id;
+        }
+        while (run_one(id)) {}
+    }
+}
+
+bool ThreadPool::run_one(int id) {
+    Range range;
+    bool found = false;
+    
+    // own work from the front first
+    {
+        Queue& own = *queues[id];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.ranges.empty()) {
+            range = own.ranges.front();
+            own.ranges.pop_front();
+            found = true;
+        }
+    }
+    
+    // then stealing from the back of everyone else
+    for (int k = 1; !found && k < (int)queues.size(); k++) {
+        Queue& victim = *queues[(id + k) % queues.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.ranges.empty()) {
+            range = victim.ranges.back();
+            victim.ranges.pop_back();
+            found = true;
+        }
+    }
+    if (!found) return false;
+    
+    (*body)(range.begin, range.end);
+    
+    if (--remaining == 0) {
+        std::lock_guard<std::mutex> guard(job_lock);
+        job_done.notify_all();
+    }
+    return true;
+}
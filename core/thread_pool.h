@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A persistent pool of worker threads for splitting loops across cores.
+// Each thread (the caller included) has its own queue of index ranges; it
+// works through its own queue first and steals from the back of the others
+// when it runs dry, so uneven chunks still balance out.
+//
+// parallel_for() blocks until the whole range is done and must not be called
+// from inside a body it is running.
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads = 0);  // 0 picks one thread per core
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    // threads taking part in parallel_for, the calling thread included
+    int thread_count() const { return (int)queues.size(); }
+    
+    // runs body(begin, end) over [0, count) in pieces of at most `chunk`
+    void parallel_for(int count, int chunk, const std::function<void(int, int)>& body);
+    
+private:
+    struct Range {
+        int begin, end;
+    };
+    
+    struct Queue {
+        std::mutex lock;
+        std::deque<Range> ranges;
+    };
+    
+    void worker_loop(int id);
+    bool run_one(int id);
+    
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;  // the caller uses the last one
+    
+    std::mutex submit_lock;  // one parallel_for at a time
+    std::mutex job_lock;
+    std::condition_variable job_ready;
+    std::condition_variable job_done;
+    const std::function<void(int, int)>* body = nullptr;
+    std::atomic<int> remaining{0};
+    unsigned long long job_id = 0;
+    bool stopping = false;
+};
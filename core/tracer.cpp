@@ -0,0 +1,119 @@
+#include "tracer.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double TWO_PI = 2 * 3.14159265359;
+
+int RaySettings::coarse_rays() const {
+    if (!adaptive) return std::max(ray_count, 0);
+    return std::min(std::max(ray_count, 3), std::max(budget, 3));
+}
+
+template <typename Scalar>
+bool BasicRayTracer<Scalar>::nearest_hit(Point2D from, Point2D dir, double& t, int& shape) const {
+    // small scenes test every shape at once, a bucket at a time, big ones walk the grid
+    if (circles.size() + primitives.size() < GRID_MIN_SHAPES) {
+        bool found = circles.nearest_hit(from, dir, max_t, t, shape);
+        return primitives.nearest_hit(from, dir, found ? t : max_t, t, shape) || found;
+    }
+    return grid.first_hit(from, dir, max_t, t, shape, &primitives);
+}
+
+template <typename Scalar>
+RayHit BasicRayTracer<Scalar>::cast(Point2D from, double angle) const {
+    Point2D dir(std::cos(angle), std::sin(angle));
+    RayHit hit;
+    hit.angle = angle;
+    hit.dir = dir;
+    hit.shape = -1;
+    if (nearest_hit(from, dir, hit.t, hit.shape)) {
+        hit.end = Point2D(from.x + dir.x * hit.t, from.y + dir.y * hit.t);
+    } else {
+        hit.t = miss_length;
+        hit.end = Point2D(from.x + dir.x * miss_length, from.y + dir.y * miss_length);
+    }
+    return hit;
+}
+
+template <typename Scalar>
+void BasicRayTracer<Scalar>::cast_fan(Point2D origin, int count, std::vector<RayHit>& hits, ThreadPool* pool) const {
+    hits.resize(std::max(count, 0));
+    auto cast_range = [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            hits[i] = cast(origin, i * TWO_PI / count);
+        }
+    };
+    
+    if (!pool) {
+        cast_range(0, count);
+        return;
+    }
+    // a few chunks per thread so stealing has something to even out
+    int chunk = std::max(8, count / (pool->thread_count() * 4));
+    pool->parallel_for(count, chunk, cast_range);
+}
+
+template <typename Scalar>
+int BasicRayTracer<Scalar>::cast_adaptive(Point2D origin, const RaySettings& settings, std::vector<RayHit>& hits,
+                                          ThreadPool* pool) const {
+    int coarse = settings.coarse_rays();
+    cast_fan(origin, coarse, hits, pool);
+    if (!settings.adaptive) return coarse;
+    return coarse + refine(origin, settings, hits, pool);
+}
+
+template <typename Scalar>
+int BasicRayTracer<Scalar>::refine(Point2D origin, const RaySettings& settings, std::vector<RayHit>& hits,
+                                   ThreadPool* pool) const {
+    int coarse = (int)hits.size();
+    if (coarse < 2) return 0;
+    
+    // gaps between neighbouring rays, the last one wraps around to ray 0
+    struct Gap {
+        int a, b;
+    };
+    std::vector<Gap> gaps, next_gaps;
+    for (int i = 0; i < coarse; i++) {
+        int j = (i + 1) % coarse;
+        if (hits[i].shape != hits[j].shape) gaps.push_back(Gap{i, j});
+    }
+    
+    int total = coarse;
+    std::vector<RayHit> fresh;
+    for (int depth = 0; depth < settings.max_depth && !gaps.empty() && total < settings.budget; depth++) {
+        // one generation at a time, so the budget cuts the same gaps every frame
+        int splits = std::min((int)gaps.size(), settings.budget - total);
+        fresh.resize(splits);
+        auto split_range = [&](int begin, int end) {
+            for (int g = begin; g < end; g++) {
+                double a = hits[gaps[g].a].angle, b = hits[gaps[g].b].angle;
+                if (b < a) b += TWO_PI;
+                fresh[g] = cast(origin, (a + b) / 2);
+            }
+        };
+        if (pool) pool->parallel_for(splits, std::max(8, splits / (pool->thread_count() * 4)), split_range);
+        else split_range(0, splits);
+        
+        next_gaps.clear();
+        for (int g = 0; g < splits; g++) {
+            int mid = (int)hits.size();
+            hits.push_back(fresh[g]);
+            if (hits[gaps[g].a].shape != fresh[g].shape) next_gaps.push_back(Gap{gaps[g].a, mid});
+            if (fresh[g].shape != hits[gaps[g].b].shape) next_gaps.push_back(Gap{mid, gaps[g].b});
+        }
+        gaps.swap(next_gaps);
+        total += splits;
+    }
+    
+    // the refined rays were appended, putting everything back in angle order
+    for (auto& hit : hits) {
+        if (hit.angle >= TWO_PI) hit.angle -= TWO_PI;
+    }
+    std::sort(hits.begin(), hits.end(), [](const RayHit& l, const RayHit& r) { return l.angle < r.angle; });
+    return total - coarse;
+}
+
+template class BasicRayTracer<double>;
+template class BasicRayTracer<float>;
+template class BasicRayTracer<Fixed16>;
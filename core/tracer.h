@@ -0,0 +1,83 @@
+#pragma once
+
+#include <vector>
+#include "circle_store.h"
+#include "geometry.h"
+#include "primitive_store.h"
+#include "spatial_grid.h"
+#include "thread_pool.h"
+
+// how far a ray looks for a hit, and how long it's drawn when it finds none
+const double RAY_MAX_T = 10000;
+const double RAY_MISS_LENGTH = 2000;
+
+// below this many occluders one pass over the stores beats walking the grid
+const int GRID_MIN_SHAPES = 32;
+
+// what one ray found, filled by the compute stage and read by the draw stage
+struct RayHit {
+    double angle;  // radians, rays come out sorted by it
+    Point2D dir;
+    Point2D end;   // hit point, or RAY_MISS_LENGTH along the ray on a miss
+    double t;
+    int shape;     // index in the shape vector, -1 on a miss
+};
+
+// How the rays around a light are spread. The editor changes these at runtime.
+struct RaySettings {
+    int ray_count = 360;    // uniform rays, or the coarse pass when adaptive
+    bool adaptive = false;  // refine only where neighbouring rays disagree
+    int max_depth = 4;      // times a coarse interval may be halved
+    int budget = 2048;      // most rays one adaptive fan may cast, coarse pass included
+    bool exact = false;     // fill the exact visibility polygon, cast only the shadow-edge rays
+    
+    // rays in the uniform fan, the coarse pass when adaptive
+    int coarse_rays() const;
+};
+
+// The compute half of the ray casting. It only reads the scene through the
+// grid and the stores, so any number of threads can use it at once.
+//
+// Scalar is the circle store's precision (see BasicCircleStore), which is
+// what small scenes are tested against; the grid walk and the other shapes
+// stay double, and so do the hits handed out.
+template <typename Scalar>
+class BasicRayTracer {
+public:
+    BasicRayTracer(const SpatialGrid& grid, const BasicCircleStore<Scalar>& circles, const PrimitiveStore& primitives)
+        : grid(grid), circles(circles), primitives(primitives) {}
+    
+    bool nearest_hit(Point2D from, Point2D dir, double& t, int& shape) const;
+    RayHit cast(Point2D from, double angle) const;
+    
+    // How far rays go: hits past `length` are ignored and misses end there.
+    // Until this is called that's RAY_MAX_T for hits and RAY_MISS_LENGTH for
+    // misses. Not to be changed while other threads are casting.
+    void set_reach(double length) { max_t = miss_length = length; }
+    double reach() const { return miss_length; }
+    
+    // `count` rays evenly spread around `origin`, ray i at angle 2*pi*i/count.
+    // With a pool the fan is split into angular chunks across its threads,
+    // and the hits are the same as casting them one by one.
+    void cast_fan(Point2D origin, int count, std::vector<RayHit>& hits, ThreadPool* pool = nullptr) const;
+    
+    // Casts settings.ray_count rays, then keeps halving the angular gaps
+    // between neighbours that hit different shapes (or hit vs miss) until
+    // max_depth or the budget runs out. Without `adaptive` it's cast_fan().
+    // Returns how many rays were cast.
+    int cast_adaptive(Point2D origin, const RaySettings& settings, std::vector<RayHit>& hits,
+                      ThreadPool* pool = nullptr) const;
+    
+    // the refinement half of cast_adaptive(), for a coarse fan cast elsewhere,
+    // returns how many rays it added
+    int refine(Point2D origin, const RaySettings& settings, std::vector<RayHit>& hits,
+               ThreadPool* pool = nullptr) const;
+
+private:
+    const SpatialGrid& grid;
+    const BasicCircleStore<Scalar>& circles;
+    const PrimitiveStore& primitives;
+    double max_t = RAY_MAX_T, miss_length = RAY_MISS_LENGTH;
+};
+
+using RayTracer = BasicRayTracer<double>;
@@ -0,0 +1,243 @@
+#include "visibility.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+static const double PI = 3.14159265359;
+static const double TWO_PI = 2 * PI;
+
+namespace {
+
+// the angles a circle or a straight edge covers, end may run past 2*pi
+struct Span {
+    int shape;
+    double start, end;
+    bool edge;      // from a to b, otherwise the shape is a circle
+    Point2D a, b;
+};
+
+struct Event {
+    double angle;
+    bool opens;
+    int span;
+};
+
+// distance to the near side of a circle, or to an edge's line, along the ray at `angle`
+double near_distance(Point2D origin, const std::vector<Shape>& shapes, const Span& span, double angle) {
+    double c = std::cos(angle), s = std::sin(angle);
+    if (span.edge) {
+        double ex = span.b.x - span.a.x, ey = span.b.y - span.a.y;
+        double wx = span.a.x - origin.x, wy = span.a.y - origin.y;
+        double den = c * ey - s * ex;
+        if (den == 0) return std::sqrt(wx * wx + wy * wy);
+        return (wx * ey - wy * ex) / den;
+    }
+    const Shape& shape = shapes[span.shape];
+    double dx = origin.x - shape.center.x, dy = origin.y - shape.center.y;
+    double b = dx * c + dy * s;
+    double cc = dx * dx + dy * dy - shape.size1 * shape.size1;
+    return -b - std::sqrt(std::max(b * b - cc, 0.0));
+}
+
+// Two circles or edges that don't overlap keep the same front-to-back order
+// over every angle they both cover, so comparing them once in the middle of
+// their common span is enough to keep the active set sorted for the whole
+// sweep.
+struct NearerFirst {
+    Point2D origin;
+    const std::vector<Shape>* shapes;
+    const std::vector<Span>* spans;
+    
+    bool operator()(int a, int b) const {
+        if (a == b) return false;
+        const Span& sa = (*spans)[a];
+        const Span& sb = (*spans)[b];
+        double best_lo = sa.start, best_hi = sa.start, best_len = -1;
+        for (int k = -1; k <= 1; k++) {
+            double lo = std::max(sa.start, sb.start + k * TWO_PI);
+            double hi = std::min(sa.end, sb.end + k * TWO_PI);
+            if (hi - lo > best_len) { best_lo = lo; best_hi = hi; best_len = hi - lo; }
+        }
+        double angle = (best_lo + best_hi) / 2;
+        double da = near_distance(origin, *shapes, sa, angle);
+        double db = near_distance(origin, *shapes, sb, angle);
+        if (da != db) return da < db;
+        return a < b;
+    }
+};
+
+// appending the boundary between two angles, with `span` the nearest one or null
+void emit_interval(Point2D origin, const std::vector<Shape>& shapes, const Span* span, double a0, double a1,
+                   double max_error, double max_dist, std::vector<Point2D>& points) {
+    auto add = [&](Point2D p) {
+        if (!points.empty() && std::fabs(points.back().x - p.x) < 1e-9 && std::fabs(points.back().y - p.y) < 1e-9) return;
+        points.push_back(p);
+    };
+    if (span && span->edge) {
+        // a straight edge needs no more than its two ends
+        for (double a : {a0, a1}) {
+            double t = near_distance(origin, shapes, *span, a);
+            add(Point2D(origin.x + std::cos(a) * t, origin.y + std::sin(a) * t));
+        }
+        return;
+    }
+    
+    Point2D center = origin;
+    double radius = max_dist;
+    double from, to;
+    if (span) {
+        // walking the occluder's near arc, in angles around its own center
+        const Shape& s = shapes[span->shape];
+        center = s.center;
+        radius = s.size1;
+        double t0 = near_distance(origin, shapes, *span, a0), t1 = near_distance(origin, shapes, *span, a1);
+        from = std::atan2(origin.y + std::sin(a0) * t0 - s.center.y, origin.x + std::cos(a0) * t0 - s.center.x);
+        to = std::atan2(origin.y + std::sin(a1) * t1 - s.center.y, origin.x + std::cos(a1) * t1 - s.center.x);
+        // the near arc is always the short way round, less than half the circle
+        while (to - from > PI) to -= TWO_PI;
+        while (from - to > PI) to += TWO_PI;
+    } else {
+        from = a0;
+        to = a1;
+    }
+    
+    // chords whose sagitta stays under max_error
+    double step = 2 * std::acos(std::max(-1.0, 1 - max_error / radius));
+    int segments = std::max(1, (int)std::ceil(std::fabs(to - from) / std::max(step, 1e-6)));
+    for (int k = 0; k <= segments; k++) {
+        double a = from + (to - from) * k / segments;
+        add(Point2D(center.x + std::cos(a) * radius, center.y + std::sin(a) * radius));
+    }
+}
+
+RayHit event_ray(Point2D origin, const std::vector<Shape>& shapes, const std::vector<Span>& spans, double angle,
+                 int before, int after, double max_dist) {
+    // the ray runs out to the farther side of the jump so the shadow edge is drawn
+    auto reach = [&](int span) { return span >= 0 ? near_distance(origin, shapes, spans[span], angle) : max_dist; };
+    double t = std::max(reach(before), reach(after));
+    RayHit hit;
+    hit.angle = angle;
+    hit.dir = Point2D(std::cos(angle), std::sin(angle));
+    hit.t = t;
+    hit.end = Point2D(origin.x + hit.dir.x * t, origin.y + hit.dir.y * t);
+    hit.shape = after >= 0 ? spans[after].shape : -1;
+    return hit;
+}
+
+}  // namespace
+
+void compute_visibility(Point2D origin, const std::vector<Shape>& shapes, VisibilityPolygon& out,
+                        double max_error, double max_dist, const std::vector<int>* candidates) {
+    out.points.clear();
+    out.rays.clear();
+    out.shapes.clear();
+    
+    std::vector<Span> spans;
+    std::vector<Event> events;
+    auto add_span = [&](const Span& span) {
+        int id = (int)spans.size();
+        spans.push_back(span);
+        events.push_back(Event{span.start, true, id});
+        // spans that wrap past 2*pi close after angle 0 and start out active
+        events.push_back(Event{span.end >= TWO_PI ? span.end - TWO_PI : span.end, false, id});
+    };
+    std::vector<Point2D> corners;
+    int count = candidates ? (int)candidates->size() : (int)shapes.size();
+    for (int c = 0; c < count; c++) {
+        int i = candidates ? (*candidates)[c] : c;
+        const Shape& s = shapes[i];
+        if (s.is_light) continue;
+        if (s.type != SHAPE_CIRCLE) {
+            // every edge facing the origin, the ones facing away are always behind them
+            bool closed = s.type != SHAPE_SEGMENT;
+            s.outline(corners);
+            if (corners.size() < 2 || (closed && s.contains_point(origin))) continue;
+            double winding = closed && polygon_area2(corners) < 0 ? -1 : 1;
+            int edges = closed ? (int)corners.size() : 1;
+            for (int k = 0; k < edges; k++) {
+                Point2D a = corners[k], b = corners[(k + 1) % corners.size()];
+                double facing = (b.y - a.y) * (origin.x - a.x) + (a.x - b.x) * (origin.y - a.y);
+                if (closed && facing * winding <= 0) continue;
+                double from = std::atan2(a.y - origin.y, a.x - origin.x);
+                double width = std::atan2(b.y - origin.y, b.x - origin.x) - from;
+                while (width > PI) width -= TWO_PI;
+                while (width <= -PI) width += TWO_PI;
+                if (std::fabs(width) < 1e-12) continue;  // seen edge-on, it covers nothing
+                if (width < 0) {
+                    from += width;
+                    width = -width;
+                }
+                while (from < 0) from += TWO_PI;
+                while (from >= TWO_PI) from -= TWO_PI;
+                add_span(Span{i, from, from + width, true, a, b});
+            }
+            continue;
+        }
+        
+        double dx = s.center.x - origin.x, dy = s.center.y - origin.y;
+        double d = std::sqrt(dx * dx + dy * dy);
+        if (d <= s.size1 || d - s.size1 >= RAY_MAX_T) continue;
+        
+        // the two tangent directions
+        double mid = std::atan2(dy, dx);
+        double half = std::asin(s.size1 / d);
+        double start = mid - half;
+        while (start < 0) start += TWO_PI;
+        while (start >= TWO_PI) start -= TWO_PI;
+        
+        add_span(Span{i, start, start + 2 * half, false, Point2D(), Point2D()});
+    }
+    
+    // closing before opening at the same angle keeps touching circles apart
+    std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+        if (a.angle != b.angle) return a.angle < b.angle;
+        return !a.opens && b.opens;
+    });
+    
+    NearerFirst order{origin, &shapes, &spans};
+    std::set<int, NearerFirst> active(order);
+    std::vector<std::set<int, NearerFirst>::iterator> where(spans.size(), active.end());
+    for (int id = 0; id < (int)spans.size(); id++) {
+        if (spans[id].end >= TWO_PI) where[id] = active.insert(id).first;
+    }
+    
+    // the nearest span, one per edge, so the boundary turns at a polygon's corners too
+    auto nearest = [&]() { return active.empty() ? -1 : *active.begin(); };
+    auto span_at = [&](int id) { return id >= 0 ? &spans[id] : nullptr; };
+    auto shape_of = [&](int id) { return id >= 0 ? spans[id].shape : -1; };
+    double prev = 0;
+    size_t e = 0;
+    while (e < events.size()) {
+        double angle = events[e].angle;
+        int before = nearest();
+        
+        // every event at this angle before looking at the boundary again
+        for (; e < events.size() && events[e].angle == angle; e++) {
+            int id = events[e].span;
+            if (events[e].opens) {
+                where[id] = active.insert(id).first;
+            } else if (where[id] != active.end()) {
+                active.erase(where[id]);
+                where[id] = active.end();
+            }
+        }
+        // hidden shapes open and close too, only a change of nearest shape is a shadow edge
+        if (nearest() == before) continue;
+        emit_interval(origin, shapes, span_at(before), prev, angle, max_error, max_dist, out.points);
+        if (before >= 0) out.shapes.push_back(shape_of(before));
+        if (shape_of(nearest()) != shape_of(before)) {
+            out.rays.push_back(event_ray(origin, shapes, spans, angle, before, nearest(), max_dist));
+        }
+        prev = angle;
+    }
+    emit_interval(origin, shapes, span_at(nearest()), prev, TWO_PI, max_error, max_dist, out.points);
+    if (nearest() >= 0) out.shapes.push_back(shape_of(nearest()));
+    
+    // the first and last point meet at angle 0
+    if (out.points.size() > 1) {
+        Point2D& a = out.points.front();
+        Point2D& b = out.points.back();
+        if (std::fabs(a.x - b.x) < 1e-9 && std::fabs(a.y - b.y) < 1e-9) out.points.pop_back();
+    }
+}
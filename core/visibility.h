@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include "geometry.h"
+#include "tracer.h"
+
+// The exact lit region around a light, found from the shapes' tangent and
+// corner angles instead of sampling rays.
+struct VisibilityPolygon {
+    std::vector<Point2D> points;  // boundary in increasing angle around the origin
+    std::vector<RayHit> rays;     // one ray per shadow edge, the only rays that matter
+    std::vector<int> shapes;      // what the boundary runs along, a shape index per stretch in angle order
+};
+
+// Every circle seen from `origin` covers the angles between its two tangent
+// lines, every edge facing it the angles between its two ends. Sorting
+// those events and sweeping them once with the covering circles and edges
+// ordered by distance gives the nearest one for every angle in O(n log n).
+// Between events the boundary follows that circle's near arc, split into
+// chords no more than `max_error` off the arc, runs straight along the
+// edge, or lies on a circle of radius `max_dist` where nothing is hit.
+//
+// Occluders must not overlap each other, which the editor already enforces.
+// Shapes that contain the origin are ignored. With `candidates` only the
+// shapes at those indices are looked at, the ones the caller's culling kept.
+void compute_visibility(Point2D origin, const std::vector<Shape>& shapes, VisibilityPolygon& out,
+                        double max_error = 0.5, double max_dist = RAY_MISS_LENGTH,
+                        const std::vector<int>* candidates = nullptr);
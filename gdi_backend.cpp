@@ -0,0 +1,94 @@
+#include "gdi_backend.h"
+
+int gdi_allocations = 0;
+
+HPEN make_pen(int style, int width, COLORREF color) {
+    gdi_allocations++;
+    return CreatePen(style, width, color);
+}
+
+HBRUSH make_brush(COLORREF color) {
+    gdi_allocations++;
+    return CreateSolidBrush(color);
+}
+
+HFONT make_font(int height, int weight) {
+    gdi_allocations++;
+    return CreateFontA(height, 0, 0, 0, weight, 0, 0, 0, 0, 0, 0, 0, 0, "Segoe UI");
+}
+
+HPEN GdiBackend::pen(int style, int width, Rgb color) {
+    COLORREF c = RGB(color.r, color.g, color.b);
+    unsigned long long key = ((unsigned long long)style << 48) | ((unsigned long long)width << 32) | c;
+    auto found = pens.find(key);
+    if (found != pens.end()) return found->second;
+    HPEN made = make_pen(style, width, c);
+    pens[key] = made;
+    return made;
+}
+
+HBRUSH GdiBackend::brush(Rgb color) {
+    COLORREF c = RGB(color.r, color.g, color.b);
+    auto found = brushes.find(c);
+    if (found != brushes.end()) return found->second;
+    HBRUSH made = make_brush(c);
+    brushes[c] = made;
+    return made;
+}
+
+bool GdiBackend::visible(const Box& box) const {
+    if (!clip) return true;
+    RECT r = {(LONG)box.left, (LONG)box.top, (LONG)box.right, (LONG)box.bottom};
+    for (auto& d : *clip) {
+        if (r.left < d.right && d.left < r.right && r.top < d.bottom && d.top < r.bottom) return true;
+    }
+    return false;
+}
+
+void GdiBackend::fill_rect(const Box& box, Rgb color) {
+    RECT r = {(LONG)box.left, (LONG)box.top, (LONG)box.right, (LONG)box.bottom};
+    FillRect(dc, &r, brush(color));
+    draw_calls++;
+}
+
+void GdiBackend::line(Point2D from, Point2D to, Rgb color) {
+    SelectObject(dc, pen(PS_SOLID, 1, color));
+    MoveToEx(dc, (int)from.x, (int)from.y, NULL);
+    LineTo(dc, (int)to.x, (int)to.y);
+    draw_calls++;
+}
+
+void GdiBackend::fill_circle(Point2D center, double radius, Rgb fill, Rgb outline_color, int outline_width) {
+    SelectObject(dc, brush(fill));
+    SelectObject(dc, outline_width > 0 ? (HGDIOBJ)pen(PS_SOLID, outline_width, outline_color) : GetStockObject(NULL_PEN));
+    Ellipse(dc, (int)(center.x - radius), (int)(center.y - radius),
+                (int)(center.x + radius), (int)(center.y + radius));
+    draw_calls++;
+}
+
+void GdiBackend::dotted_circle(Point2D center, double radius, Rgb color, int width) {
+    SelectObject(dc, pen(PS_DOT, width, color));
+    SelectObject(dc, GetStockObject(NULL_BRUSH));
+    Ellipse(dc, (int)(center.x - radius), (int)(center.y - radius),
+                (int)(center.x + radius), (int)(center.y + radius));
+    draw_calls++;
+}
+
+void GdiBackend::fill_polygon(const std::vector<Point2D>& points, Rgb color) {
+    outline.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+        outline[i].x = (LONG)points[i].x;
+        outline[i].y = (LONG)points[i].y;
+    }
+    SelectObject(dc, brush(color));
+    SelectObject(dc, GetStockObject(NULL_PEN));
+    Polygon(dc, outline.data(), (int)outline.size());
+    draw_calls++;
+}
+
+void GdiBackend::destroy() {
+    for (auto& p : pens) DeleteObject(p.second);
+    for (auto& b : brushes) DeleteObject(b.second);
+    pens.clear();
+    brushes.clear();
+}
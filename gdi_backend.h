@@ -0,0 +1,38 @@
+#pragma once
+
+#include <windows.h>
+#include <map>
+#include <vector>
+#include "core/render_backend.h"
+
+// GDI objects created since the last frame, should stay at 0 while nothing is resized.
+extern int gdi_allocations;
+
+HPEN make_pen(int style, int width, COLORREF color);
+HBRUSH make_brush(COLORREF color);
+HFONT make_font(int height, int weight);
+
+// The scene drawing on top of GDI. Pens and brushes are made the first time
+// a color is used and kept until destroy(), so a steady frame allocates nothing.
+class GdiBackend : public RenderBackend {
+public:
+    HDC dc = NULL;                           // where the drawing goes
+    const std::vector<RECT>* clip = nullptr;  // only shapes touching these get drawn, everything when null
+    
+    bool visible(const Box& box) const override;
+    void fill_rect(const Box& box, Rgb color) override;
+    void line(Point2D from, Point2D to, Rgb color) override;
+    void fill_circle(Point2D center, double radius, Rgb fill, Rgb outline, int outline_width) override;
+    void dotted_circle(Point2D center, double radius, Rgb color, int width) override;
+    void fill_polygon(const std::vector<Point2D>& points, Rgb color) override;
+    
+    void destroy();
+
+private:
+    std::map<unsigned long long, HPEN> pens;  // by style, width and color
+    std::map<COLORREF, HBRUSH> brushes;
+    std::vector<POINT> outline;  // reused by fill_polygon
+    
+    HPEN pen(int style, int width, Rgb color);
+    HBRUSH brush(Rgb color);
+};
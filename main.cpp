@@ -1,109 +1,426 @@
 #include <windows.h>
 #include <windowsx.h>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
 #include <vector>
+#include "core/background_worker.h"
+#include "core/bounce.h"
+#include "core/area_light.h"
+#include "core/camera.h"
+#include "core/light_map.h"
+#include "core/profiler.h"
+#include "core/ray_cache.h"
+#include "core/replay.h"
+#include "core/scene.h"
+#include "core/scene_io.h"
+#include "core/scene_renderer.h"
+#include "core/simulation.h"
+#include "gdi_backend.h"
 
 #define IDI_ICON1 101
+#define WM_RAYS_DONE (WM_APP + 1)  // posted by the ray thread, only to wake the frame loop up
+
+typedef std::chrono::steady_clock Clock;
 
 int canvas_width = 800;
 int canvas_height = 600;
 const int SIDEBAR_WIDTH = 250;
 
-struct Point2D {
-    double x, y;
-    Point2D(double x = 0, double y = 0) : x(x), y(y) {}
+// one light's rays, filled by the compute stage and drawn by Render()
+struct LightRays {
+    Point2D origin;  // where the light was when the hits were cast
+    Rgb color;
+    std::vector<RayHit> hits;
+    std::vector<RaySegment> bounces;  // reflected and refracted rays, when bounce_settings asks for them
 };
 
-enum ShapeType {
-    SHAPE_CIRCLE
+Scene scene;                       // the shapes, the lights and the structures the rays are cast through
+Camera camera;                     // the part of the world on the canvas, the wheel zooms and the middle button pans
+ThreadPool ray_pool;               // persistent workers for the ray casting
+std::vector<LightRays> light_rays; // in the scene's light order
+std::string scene_path = "scene.txt";  // where S saves, the file from the command line if there was one
+RaySettings ray_settings;          // ray count and adaptive refinement, changed from the keyboard
+BounceSettings bounce_settings;    // how deep reflected and refracted rays are followed, off to start with
+bool soft_shadows = false;         // exact mode with the lights sampled across their discs, O toggles it
+AreaLightSettings area_settings;   // how many samples a frame adds to the soft shadows
+SoftwareRaster canvas_background;  // the canvas part of the static layer, for the light map to go onto
+std::vector<unsigned char> lit_canvas;  // the tone-mapped light map over the background, BGRA for GDI
+int lit_width = 0, lit_height = 0;      // its size, the canvas may have been resized since it was cast
+bool rays_exact = false;           // light_rays and lit_canvas come from exact mode
+
+// what the ray thread reported with the rays on screen, shown in the sidebar
+int rays_cast = 0;                 // rays cast for them
+int lights_recomputed = 0;         // lights the light map had to redo
+double rays_recast = 0;            // fraction of the fans cast again
+BounceStats bounce_stats;          // secondary rays and their time per depth
+int area_samples = 0;              // origins per light in the soft shadows
+double area_change = 0;            // what one more moved their average per pixel
+bool area_converged = true;        // and whether more would still be added while nothing moves
+
+// The rays are cast on their own thread, through its own copy of the scene,
+// so the editor keeps up with the mouse however long they take. Only that
+// thread touches ray_scene, the light maps and ray_caches; the main thread fills
+// ray_job and reads ray_frame only while the worker is idle, then swaps the
+// frame's rays in front of the ones Render() draws.
+struct RayJob {
+    bool full = true;                // shapes were added or erased, `shapes` is all of them...
+    std::vector<int> changed;        // ...otherwise only the ones changed since the last job, at these indices
+    std::vector<Shape> shapes;
+    std::vector<SceneEdit> edits;    // and the editor's edits since the last job
+    RaySettings settings;
+    BounceSettings bounces;
+    bool soft = false;
+    AreaLightSettings area;
+    Camera camera;                   // what the canvas shows, lights that can't reach it are left out
+    bool refine = false;             // nothing changed, only more soft shadow samples; shapes and edits are left out
+    bool reset = false;              // the caches start over, the mode changed
+    bool has_input = false;          // an input event is waiting for these rays
+    Clock::time_point input_time;
 };
 
-struct Shape {
-    ShapeType type;
-    Point2D center;
-    double size1, size2;
-    bool is_light;
-    
-    Shape(ShapeType t, Point2D c, double s1, double s2 = 0, bool light = false) 
-        : type(t), center(c), size1(s1), size2(s2), is_light(light) {}
+struct RayFrame {
+    std::vector<LightRays> light_rays;
+    std::vector<unsigned char> lit_canvas;
+    int lit_width = 0, lit_height = 0;
+    bool exact = false;
+    int rays_cast = 0, lights_recomputed = 0;
+    double rays_recast = 0;
+    BounceStats bounce_stats;
+    int area_samples = 0;
+    double area_change = 0;
+    bool area_converged = true;
+    Clock::time_point cast_start, cast_end;  // how long the job took, for the profiler
+};
+
+Scene ray_scene;                   // the ray thread's copy of the scene
+LightMap light_map;                // every light added up when ray_settings.exact is on
+AreaLightMap area_map;             // the same with soft shadows, built up over the jobs while nothing moves
+std::vector<RayCache> ray_caches;  // each light's uniform fan, only the rays an edit reached get cast again
+RayJob ray_job;
+RayFrame ray_frame;                // the back buffer the ray thread fills
+BackgroundWorker ray_worker;       // after everything its jobs use, so it's stopped first
+bool rays_in_flight = false;       // ray_frame will be ready to swap in once the worker is idle
+bool reset_ray_caches = false;     // for the next job
+
+// Input-to-photon latency: from the moment an input event happened to the
+// end of the first frame that shows what it did, once for the shapes and
+// once more for the rays cast after it.
+struct LatencyStats {
+    static const int HISTORY = 120;
+    double samples[HISTORY];
+    int count = 0;
     
-    bool intersects_ray(Point2D from, Point2D direction, double& t);
-    bool contains_point(Point2D p);
-    void draw(HDC hdc);
+    void add(Clock::duration d) { samples[count++ % HISTORY] = std::chrono::duration<double, std::milli>(d).count(); }
+    double average() const {
+        int n = std::min(count, HISTORY);
+        double sum = 0;
+        for (int i = 0; i < n; i++) sum += samples[i];
+        return n ? sum / n : 0;
+    }
 };
 
-Point2D light_pos(150, 400);
-std::vector<Shape> shapes;
-ShapeType selected_shape = SHAPE_CIRCLE;
-int selected_shape_index = -1;  // which shape we're currently editing
-bool dragging_light = false;
+LatencyStats shape_latency, ray_latency;
+Clock::time_point event_time;      // when the input being handled happened
+bool shape_input_waiting = false;  // an input's edit isn't on screen yet...
+Clock::time_point shape_input_time;  // ...since then
+bool ray_input_waiting = false;    // an input's edit hasn't been sent to the ray thread yet
+Clock::time_point ray_input_time;
+bool ray_input_shown = false;      // the rays on screen are the first cast after an input...
+Clock::time_point ray_shown_input_time;  // ...that happened then
+
+// Frame pacing: at most one composed frame per refresh interval, and however
+// many mouse moves came in since the last one, only the newest is applied.
+Clock::duration frame_interval = std::chrono::microseconds(16667);
+bool mouse_move_pending = false;
+int pending_mouse_x = 0, pending_mouse_y = 0;
+Clock::time_point pending_mouse_time;  // when the oldest unapplied move happened
+
+ShapeType selected_shape = SHAPE_CIRCLE;  // what a left click adds, P cycles it
+ShapeHandle selection;          // which shape we're currently editing, it keeps it when others are erased
+ShapeHandle dragged_light;      // the light being dragged
 bool dragging_shape = false;
 bool resizing_shape = false;
+bool panning = false;           // the middle button is down, the view follows the mouse
+POINT pan_from;                 // where the mouse was at the last pan step
 Point2D drag_offset;
+bool show_profiler = false;     // the stage timings in place of the instructions card, F toggles it
 
-bool Shape::intersects_ray(Point2D from, Point2D direction, double& t) {
-    // checking if a ray hits our circle
-    double dx = from.x - center.x;
-    double dy = from.y - center.y;
-    double a = direction.x * direction.x + direction.y * direction.y;
-    double b = 2 * (dx * direction.x + dy * direction.y);
-    double c = dx * dx + dy * dy - size1 * size1;
-    double discriminant = b * b - 4 * a * c;
-    if (discriminant < 0) return false;
-    double sqrt_d = std::sqrt(discriminant);
-    double t1 = (-b - sqrt_d) / (2 * a);
-    if (t1 > 0.001) { t = t1; return true; }
-    double t2 = (-b + sqrt_d) / (2 * a);
-    if (t2 > 0.001) { t = t2; return true; }
-    return false;
-}
+Simulation simulation;          // G starts and stops it, K sets everything moving
+Clock::time_point last_simulated;  // when the simulation last caught up
+ReplayRecorder recorder;        // W records the session to replay.rtlog
 
-bool Shape::contains_point(Point2D p) {
-    // is the point inside our circle?
-    double dx = p.x - center.x, dy = p.y - center.y;
-    return (dx * dx + dy * dy) <= (size1 * size1);
-}
+// An offscreen surface: a memory DC with its own bitmap selected into it.
+struct Surface {
+    HDC dc = NULL;
+    HBITMAP bitmap = NULL;
+    HBITMAP old_bitmap = NULL;
+    int width = 0, height = 0;
+    
+    void create(HDC reference, int w, int h) {
+        destroy();
+        dc = CreateCompatibleDC(reference);
+        bitmap = CreateCompatibleBitmap(reference, w, h);
+        old_bitmap = (HBITMAP)SelectObject(dc, bitmap);
+        width = w;
+        height = h;
+        gdi_allocations += 2;
+    }
+    
+    void destroy() {
+        if (!dc) return;
+        SelectObject(dc, old_bitmap);
+        DeleteObject(bitmap);
+        DeleteDC(dc);
+        dc = NULL;
+    }
+};
 
-bool check_collision_with_shapes(Point2D pos, double size, int exclude_index = -1) {
-    for (int i = 0; i < shapes.size(); i++) {
-        if (i == exclude_index || shapes[i].is_light) continue;
+// Every pen, brush, font and surface the window draws with. The sidebar's
+// pens, brushes and fonts are made once on WM_CREATE, the scene's the first
+// time the canvas backend needs them, the surfaces on every WM_SIZE, and all
+// of it goes away on WM_DESTROY. Drawing code only ever selects these, it
+// never creates or deletes GDI objects itself.
+struct GdiCache {
+    HPEN accent_pen, card_pen, info_card_pen;
+    HBRUSH sidebar_brush, card_brush, info_card_brush;
+    HFONT title_font, text_font, credit_font;
+    HRGN dirty_region, dirty_piece;  // reused with SetRectRgn every frame
+    GdiBackend canvas;               // the rays and shapes go through this
+    
+    // the canvas background and sidebar cards, and the signature with its mask
+    Surface static_layer, credit_layer, credit_mask;
+    RECT credit_rect;
+    
+    // the composed frame, kept between paints so only dirty parts are redrawn
+    Surface back_buffer;
+    
+    void create() {
+        accent_pen = make_pen(PS_SOLID, 2, RGB(100, 120, 255));
+        card_pen = make_pen(PS_SOLID, 1, RGB(70, 70, 80));
+        info_card_pen = make_pen(PS_SOLID, 1, RGB(60, 60, 70));
+        sidebar_brush = make_brush(RGB(30, 30, 35));
+        card_brush = make_brush(RGB(45, 45, 55));
+        info_card_brush = make_brush(RGB(40, 40, 48));
         
-        double dx = pos.x - shapes[i].center.x;
-        double dy = pos.y - shapes[i].center.y;
-        double dist = std::sqrt(dx * dx + dy * dy);
-        double min_dist = size + (shapes[i].type == SHAPE_CIRCLE ? shapes[i].size1 : 
-                                  std::max(shapes[i].size1, shapes[i].size2) * 0.7);
+        title_font = make_font(24, FW_SEMIBOLD);
+        text_font = make_font(15, FW_NORMAL);
+        credit_font = make_font(32, FW_NORMAL);
+        dirty_region = CreateRectRgn(0, 0, 0, 0);
+        dirty_piece = CreateRectRgn(0, 0, 0, 0);
+        gdi_allocations += 2;
+        credit_rect = RECT{0, 0, 0, 0};
+    }
+    
+    void destroy() {
+        static_layer.destroy();
+        credit_layer.destroy();
+        credit_mask.destroy();
+        back_buffer.destroy();
+        canvas.destroy();
         
-        if (dist < min_dist) return true;
+        HGDIOBJ objects[] = {accent_pen, card_pen, info_card_pen, sidebar_brush, card_brush, info_card_brush,
+                             title_font, text_font, credit_font, dirty_region, dirty_piece};
+        for (HGDIOBJ object : objects) DeleteObject(object);
+    }
+};
+
+GdiCache gdi;
+
+// What changed since the last frame.
+std::vector<RECT> dirty_rects;  // client areas to compose again
+bool rays_dirty = true;         // the scene or the ray settings changed, rays must be cast again
+int draw_calls = 0;             // GDI drawing calls the last composed frame made
+
+RECT shape_rect(const Shape& shape) {
+    // plus the resize handle, which is drawn the same size in pixels at any zoom
+    Box b = camera.to_screen(shape_draw_bounds(shape));
+    double pad = HANDLE_RADIUS + 2;
+    RECT r = {(LONG)std::floor(b.left - pad), (LONG)std::floor(b.top - pad), (LONG)std::ceil(b.right + pad),
+              (LONG)std::ceil(b.bottom + pad)};
+    return r;
+}
+
+bool rects_touch(const RECT& a, const RECT& b) {
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+bool touches_dirty(const RECT& r) {
+    for (auto& d : dirty_rects) {
+        if (rects_touch(r, d)) return true;
     }
     return false;
 }
 
-void Shape::draw(HDC hdc) {
-    // drawing a simple circle
-    HBRUSH brush = CreateSolidBrush(RGB(220, 220, 220));
-    HPEN pen = CreatePen(PS_SOLID, 2, RGB(255, 255, 255));
-    SelectObject(hdc, brush);
-    SelectObject(hdc, pen);
-    Ellipse(hdc, (int)(center.x - size1), (int)(center.y - size1),
-                 (int)(center.x + size1), (int)(center.y + size1));
-    DeleteObject(brush);
-    DeleteObject(pen);
+// Nothing is invalidated here, the frame loop in WinMain does that once per
+// frame for everything marked since. An edit marked while handling input
+// also starts its latency clock.
+void mark_dirty(RECT r) {
+    dirty_rects.push_back(r);
+}
+
+void note_input() {
+    if (shape_input_waiting) return;
+    shape_input_waiting = true;
+    shape_input_time = event_time;
+}
+
+void mark_shape_dirty(int index) {
+    if (index < 0) return;
+    mark_dirty(shape_rect(scene.shapes[index]));
+    note_input();
+}
+
+void mark_rays_dirty() {
+    // the area they cover is only known once the ray thread has cast them again
+    rays_dirty = true;
+    note_input();
+    if (!ray_input_waiting) {
+        ray_input_waiting = true;
+        ray_input_time = event_time;
+    }
+}
+
+void mark_all_dirty() {
+    RECT r = {0, 0, canvas_width + SIDEBAR_WIDTH, canvas_height};
+    mark_dirty(r);
+}
+
+// the whole canvas moved, and the rays and light map follow the view
+void mark_camera_moved() {
+    mark_all_dirty();
+    mark_rays_dirty();
+}
+
+// The topmost shape under `p`, lights only if `lights` says so, or -1.
+// Only what the grid has near the point is tried, and the lights.
+int shape_at(Point2D p, bool lights) {
+    std::vector<int> near;
+    scene.grid.overlapping(p, SEGMENT_PICK_DISTANCE + 1, near);
+    if (lights) {
+        near.insert(near.end(), scene.lights().begin(), scene.lights().end());
+        std::sort(near.begin(), near.end());
+    }
+    for (auto it = near.rbegin(); it != near.rend(); ++it) {
+        if (scene.shapes[*it].contains_point(p)) return *it;
+    }
+    return -1;
+}
+
+RECT sidebar_stats_rect() {
+    // sits right under the title card
+    RECT r = {canvas_width + 20, 130, canvas_width + SIDEBAR_WIDTH - 20, 262};
+    return r;
+}
+
+void DrawSidebarStats(HDC hdc) {
+    // the live numbers on top of the cached stats card
+    RECT stats_card_rect = sidebar_stats_rect();
+    SetBkMode(hdc, TRANSPARENT);
+    SetTextColor(hdc, RGB(200, 200, 210));
+    SelectObject(hdc, gdi.text_font);
+    char stats_text[256];
+    int lights = (int)scene.lights().size();
+    if (soft_shadows && ray_settings.exact) {
+        snprintf(stats_text, sizeof(stats_text), "Soft shadows, %d lights\n%d samples per light, +%d a frame\n%s, %.6f a sample\nDraw calls: %d",
+                 lights, area_samples, area_settings.samples_per_frame, area_converged ? "Converged" : "Refining",
+                 area_change, draw_calls);
+    } else if (ray_settings.exact) {
+        snprintf(stats_text, sizeof(stats_text), "Exact visibility, %d lights\n%d lights recomputed\nShadow-edge rays: %d\nDraw calls: %d",
+                 lights, lights_recomputed, rays_cast, draw_calls);
+    } else if (ray_settings.adaptive) {
+        snprintf(stats_text, sizeof(stats_text), "Adaptive: %d coarse, depth %d\nBudget %d, %d lights\n%d rays, %.1f%% recast\nDraw calls: %d",
+                 ray_settings.ray_count, ray_settings.max_depth, ray_settings.budget, lights, rays_cast, rays_recast * 100,
+                 draw_calls);
+    } else {
+        snprintf(stats_text, sizeof(stats_text), "Uniform rays: %d\n%d lights, %.1f%% recast\nRays this frame: %d\nDraw calls: %d",
+                 ray_settings.ray_count, lights, rays_recast * 100, rays_cast, draw_calls);
+    }
+    if (!ray_settings.exact) {
+        long long bounced = 0;
+        double seconds = 0;
+        for (size_t d = 0; d < bounce_stats.rays.size(); d++) {
+            bounced += bounce_stats.rays[d];
+            seconds += bounce_stats.seconds[d];
+        }
+        size_t used = strlen(stats_text);
+        snprintf(stats_text + used, sizeof(stats_text) - used, "\nBounces %d: %lld rays, %.1f Mrays/s",
+                 bounce_settings.max_depth, bounced, seconds > 0 ? bounced / (seconds * 1e6) : 0.0);
+    }
+    size_t used = strlen(stats_text);
+    snprintf(stats_text + used, sizeof(stats_text) - used, "\nLatency %.1f ms, rays %.1f ms",
+             shape_latency.average(), ray_latency.average());
+    RECT stats_text_rect = {stats_card_rect.left + 20, stats_card_rect.top + 15, stats_card_rect.right - 20, stats_card_rect.bottom - 10};
+    DrawText(hdc, stats_text, -1, &stats_text_rect, DT_LEFT | DT_WORDBREAK);
+    draw_calls++;
+}
+
+// the instructions card, which the profiler panel covers when it's shown
+RECT sidebar_info_rect(int height) {
+    RECT r = {canvas_width + 20, sidebar_stats_rect().bottom + 20, canvas_width + SIDEBAR_WIDTH - 20, height - 30};
+    return r;
+}
+
+// min, average and p99 of every stage over the profiler's last frames, drawn
+// every frame over the instructions card
+void DrawProfilerPanel(HDC hdc, int height) {
+#if RAYTRACE_PROFILER
+    RECT card = sidebar_info_rect(height);
+    FillRect(hdc, &card, gdi.info_card_brush);
+    SelectObject(hdc, gdi.info_card_pen);
+    SelectObject(hdc, GetStockObject(NULL_BRUSH));
+    Rectangle(hdc, card.left, card.top, card.right, card.bottom);
+    SetBkMode(hdc, TRANSPARENT);
+    SetTextColor(hdc, RGB(200, 200, 210));
+    SelectObject(hdc, gdi.text_font);
+    draw_calls += 2;
+    
+    std::vector<StageSummary> stages;
+    frame_profiler().summary(stages);
+    char title[64];
+    snprintf(title, sizeof(title), "Last %d frames, ms", frame_profiler().frames());
+    RECT row = {card.left + 12, card.top + 12, card.right - 12, card.top + 30};
+    DrawText(hdc, title, -1, &row, DT_LEFT | DT_SINGLELINE);
+    draw_calls++;
+    
+    // the name on the left and three right-aligned number columns, the font isn't monospaced
+    const int column = 42;
+    for (size_t i = 0; i <= stages.size() && row.bottom + 18 <= card.bottom - 8; i++) {
+        row.top += 18;
+        row.bottom += 18;
+        const char* name = "stage";
+        char numbers[3][16] = {"min", "avg", "p99"};
+        if (i > 0) {
+            const StageSummary& stage = stages[i - 1];
+            name = stage.name;
+            snprintf(numbers[0], sizeof(numbers[0]), "%.2f", stage.min_ms);
+            snprintf(numbers[1], sizeof(numbers[1]), "%.2f", stage.avg_ms);
+            snprintf(numbers[2], sizeof(numbers[2]), "%.2f", stage.p99_ms);
+        }
+        DrawText(hdc, name, -1, &row, DT_LEFT | DT_SINGLELINE);
+        for (int c = 0; c < 3; c++) {
+            RECT cell = {row.right - (3 - c) * column, row.top, row.right - (2 - c) * column, row.bottom};
+            DrawText(hdc, numbers[c], -1, &cell, DT_RIGHT | DT_SINGLELINE);
+        }
+        draw_calls += 4;
+    }
+#else
+    (void)hdc; (void)height;
+#endif
 }
 
 void DrawSidebar(HDC hdc, int height) {
     // drawing the control panel on the right side
     RECT sidebar = {canvas_width, 0, canvas_width + SIDEBAR_WIDTH, height};
-    HBRUSH dark_brush = CreateSolidBrush(RGB(30, 30, 35));
-    FillRect(hdc, &sidebar, dark_brush);
-    DeleteObject(dark_brush);
+    FillRect(hdc, &sidebar, gdi.sidebar_brush);
     
     // a nice accent line on the left edge
-    HPEN border_pen = CreatePen(PS_SOLID, 2, RGB(100, 120, 255));
-    SelectObject(hdc, border_pen);
+    SelectObject(hdc, gdi.accent_pen);
     MoveToEx(hdc, canvas_width, 0, NULL);
     LineTo(hdc, canvas_width, height);
-    DeleteObject(border_pen);
     
     // the title card at the top
     int card_margin = 20;
@@ -112,236 +429,606 @@ void DrawSidebar(HDC hdc, int height) {
     RECT card_rect = {canvas_width + card_margin, card_y, canvas_width + SIDEBAR_WIDTH - card_margin, card_y + card_height};
     
     // making it look modern with a card background
-    HBRUSH card_brush = CreateSolidBrush(RGB(45, 45, 55));
-    FillRect(hdc, &card_rect, card_brush);
-    DeleteObject(card_brush);
+    FillRect(hdc, &card_rect, gdi.card_brush);
     
     // subtle border around the card
-    HPEN card_pen = CreatePen(PS_SOLID, 1, RGB(70, 70, 80));
-    SelectObject(hdc, card_pen);
+    SelectObject(hdc, gdi.card_pen);
     SelectObject(hdc, GetStockObject(NULL_BRUSH));
     Rectangle(hdc, card_rect.left, card_rect.top, card_rect.right, card_rect.bottom);
-    DeleteObject(card_pen);
     
     // the title text with a nice font
     SetBkMode(hdc, TRANSPARENT);
     SetTextColor(hdc, RGB(255, 255, 255));
-    HFONT title_font = CreateFont(24, 0, 0, 0, FW_SEMIBOLD, 0, 0, 0, 0, 0, 0, 0, 0, "Segoe UI");
-    SelectObject(hdc, title_font);
+    SelectObject(hdc, gdi.title_font);
     RECT title_rect = {card_rect.left + 15, card_rect.top + 15, card_rect.right - 15, card_rect.bottom - 15};
-    DrawText(hdc, "Add Circle", -1, &title_rect, DT_LEFT | DT_VCENTER | DT_SINGLELINE);
-    DeleteObject(title_font);
+    const char* titles[] = {"Add Circle", "Add Segment", "Add Rectangle", "Add Polygon"};
+    DrawText(hdc, titles[selected_shape], -1, &title_rect, DT_LEFT | DT_VCENTER | DT_SINGLELINE);
+    
+    // a small card with the ray settings, its text is drawn every frame by DrawSidebarStats()
+    RECT stats_card_rect = sidebar_stats_rect();
+    
+    FillRect(hdc, &stats_card_rect, gdi.info_card_brush);
+    SelectObject(hdc, gdi.info_card_pen);
+    SelectObject(hdc, GetStockObject(NULL_BRUSH));
+    Rectangle(hdc, stats_card_rect.left, stats_card_rect.top, stats_card_rect.right, stats_card_rect.bottom);
     
     // another card for instructions below
-    int info_card_y = card_y + card_height + 20;
-    RECT info_card_rect = {canvas_width + card_margin, info_card_y, canvas_width + SIDEBAR_WIDTH - card_margin, height - 30};
+    RECT info_card_rect = sidebar_info_rect(height);
     
     // darker background for the info card
-    HBRUSH info_card_brush = CreateSolidBrush(RGB(40, 40, 48));
-    FillRect(hdc, &info_card_rect, info_card_brush);
-    DeleteObject(info_card_brush);
+    FillRect(hdc, &info_card_rect, gdi.info_card_brush);
     
     // border for the info card
-    HPEN info_card_pen = CreatePen(PS_SOLID, 1, RGB(60, 60, 70));
-    SelectObject(hdc, info_card_pen);
+    SelectObject(hdc, gdi.info_card_pen);
     SelectObject(hdc, GetStockObject(NULL_BRUSH));
     Rectangle(hdc, info_card_rect.left, info_card_rect.top, info_card_rect.right, info_card_rect.bottom);
-    DeleteObject(info_card_pen);
     
     // helpful instructions for the user
     SetTextColor(hdc, RGB(200, 200, 210));
-    HFONT info_font = CreateFont(15, 0, 0, 0, FW_NORMAL, 0, 0, 0, 0, 0, 0, 0, 0, "Segoe UI");
-    SelectObject(hdc, info_font);
+    SelectObject(hdc, gdi.text_font);
     RECT text_rect = {info_card_rect.left + 20, info_card_rect.top + 20, info_card_rect.right - 20, info_card_rect.bottom - 20};
-    DrawText(hdc, "Left click: Add circle\n\n Drag light or circle to move\n\n Drag blue handle to resize\n\n Right click: Delete circle", -1, &text_rect, 
-             DT_LEFT | DT_WORDBREAK);
-    DeleteObject(info_font);
+    // related keys share a line, so all of it fits the card at the default window height
+    std::string instructions = "Click: Add, right: Delete\n Drag: Move, handle resizes\n P / R: Type / rotate\n L / M: Light / material\n"
+                               " V / O: Exact / soft light\n A, { }: Adaptive, samples\n + / -: Ray count\n [ ] , .: Depth, budget\n"
+                               " B: Bounce depth\n Wheel, mid drag, C: View\n G / K: Simulate / kick\n W / S: Record / save";
+    if (RAYTRACE_PROFILER) instructions += "\n F / T: Timings / trace";
+    DrawText(hdc, instructions.c_str(), -1, &text_rect, DT_LEFT | DT_WORDBREAK);
 }
 
-void Render(HDC hdc, int total_width, int height) {
-    // black background for the canvas
-    RECT canvas = {0, 0, canvas_width, height};
-    FillRect(hdc, &canvas, (HBRUSH)GetStockObject(BLACK_BRUSH));
-    
-    // drawing a subtle grid
-    HPEN grid_pen = CreatePen(PS_SOLID, 1, RGB(40, 40, 40));
-    SelectObject(hdc, grid_pen);
-    for (int x = 0; x < canvas_width; x += 20) {
-        MoveToEx(hdc, x, 0, NULL);
-        LineTo(hdc, x, height);
-    }
-    for (int y = 0; y < height; y += 20) {
-        MoveToEx(hdc, 0, y, NULL);
-        LineTo(hdc, canvas_width, y);
-    }
-    DeleteObject(grid_pen);
-    
-    // casting rays from the light source
-    HPEN ray_pen = CreatePen(PS_SOLID, 1, RGB(255, 240, 100));
-    SelectObject(hdc, ray_pen);
-    for (int i = 0; i < 360; i++) {
-        double angle = i * 3.14159265359 / 180.0;
-        Point2D dir(std::cos(angle), std::sin(angle));
-        double min_t = 10000;
-        bool hit = false;
-        
-        for (auto& shape : shapes) {
-            if (shape.is_light) continue;
-            double t;
-            if (shape.intersects_ray(light_pos, dir, t) && t < min_t) {
-                min_t = t;
-                hit = true;
-            }
+void BuildStaticLayers(HDC reference, int width, int height) {
+    // the ray thread reads canvas_background
+    ray_worker.wait();
+    
+    // the canvas background and the sidebar cards in one surface
+    gdi.static_layer.create(reference, width, height);
+    gdi.canvas.dc = gdi.static_layer.dc;
+    gdi.canvas.clip = nullptr;
+    draw_canvas_background(gdi.canvas, canvas_width, height);
+    
+    // and the same canvas in memory, what the light map gets added onto
+    canvas_background.resize(canvas_width, height);
+    draw_canvas_background(canvas_background, canvas_width, height);
+    DrawSidebar(gdi.static_layer.dc, height);
+    
+    // my signature in the corner
+    const char* credit_text = "Made by Batuhan Eroglu";
+    SelectObject(gdi.static_layer.dc, gdi.credit_font);
+    SIZE text_size;
+    GetTextExtentPoint32A(gdi.static_layer.dc, credit_text, strlen(credit_text), &text_size);
+    
+    // keeping it in the bottom-left corner, with room for the shadow
+    RECT& r = gdi.credit_rect;
+    r.left = 15;
+    r.top = height - text_size.cy - 15;
+    r.right = r.left + text_size.cx + 2;
+    r.bottom = r.top + text_size.cy + 2;
+    int w = r.right - r.left, h = r.bottom - r.top;
+    RECT all = {0, 0, w, h};
+    
+    // the mask is black wherever the text or its shadow is, white elsewhere
+    gdi.credit_mask.create(reference, w, h);
+    HDC mask = gdi.credit_mask.dc;
+    FillRect(mask, &all, (HBRUSH)GetStockObject(WHITE_BRUSH));
+    SelectObject(mask, gdi.credit_font);
+    SetBkMode(mask, TRANSPARENT);
+    SetTextColor(mask, RGB(0, 0, 0));
+    TextOutA(mask, 2, 2, credit_text, strlen(credit_text));
+    TextOutA(mask, 0, 0, credit_text, strlen(credit_text));
+    
+    // and the colors go on black, so the shadow simply stays black
+    gdi.credit_layer.create(reference, w, h);
+    HDC color = gdi.credit_layer.dc;
+    FillRect(color, &all, (HBRUSH)GetStockObject(BLACK_BRUSH));
+    SelectObject(color, gdi.credit_font);
+    SetBkMode(color, TRANSPARENT);
+    SetTextColor(color, RGB(255, 255, 255));
+    TextOutA(color, 0, 0, credit_text, strlen(credit_text));
+}
+
+// the light map tone mapped over the canvas background, swizzled to the BGRA GDI wants
+void UpdateLitCanvas(RayFrame& frame, bool soft) {
+    SoftwareRaster lit = canvas_background;
+    if (soft) area_map.tone_map(lit, &ray_pool);
+    else light_map.tone_map(lit, &ray_pool);
+    const std::vector<unsigned char>& rgba = lit.pixels();
+    std::vector<unsigned char>& out = frame.lit_canvas;
+    frame.lit_width = lit.width();
+    frame.lit_height = lit.height();
+    out.resize(rgba.size());
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+        out[i] = rgba[i + 2];
+        out[i + 1] = rgba[i + 1];
+        out[i + 2] = rgba[i];
+        out[i + 3] = 255;
+    }
+}
+
+// The ray thread's job: catch ray_scene up with the editor's shapes, then one
+// fan per light, each spread over all cores; in exact mode the light map only
+// redoes the lights the edits reached, and with soft shadows every job adds
+// more samples to the average until it has enough. Everything is culled to
+// the camera's view: a light that can't reach it casts nothing, the others
+// only as far as the view needs.
+void CastRays() {
+    RayFrame& frame = ray_frame;
+    const RaySettings& settings = ray_job.settings;
+    if (!ray_job.refine && ray_job.full) ray_scene.assign(ray_job.shapes, ray_job.edits);
+    else if (!ray_job.refine) ray_scene.follow(ray_job.changed, ray_job.shapes, ray_job.edits);
+    if (ray_job.reset) {
+        light_map.clear();
+        area_map.clear();
+        ray_caches.clear();
+    }
+    light_map.set_camera(ray_job.camera);
+    area_map.set_camera(ray_job.camera);
+    Box view = ray_job.camera.view(canvas_background.width(), canvas_background.height());
+    
+    const std::vector<int>& lights = ray_scene.lights();
+    frame.light_rays.resize(lights.size());
+    frame.exact = settings.exact;
+    frame.rays_cast = 0;
+    frame.area_converged = true;
+    if (ray_job.soft) {
+        // only the lit canvas, shadow-edge rays would draw the hard edges back in
+        area_map.resize(canvas_background.width(), canvas_background.height());
+        frame.rays_cast = area_map.update(ray_scene, ray_job.area, &ray_pool);
+        frame.area_samples = area_map.samples();
+        frame.area_change = area_map.last_change();
+        frame.area_converged = area_map.converged(ray_job.area);
+        ray_scene.clear_edits();
+        UpdateLitCanvas(frame, true);
+        for (auto& rays : frame.light_rays) {
+            rays.hits.clear();
+            rays.bounces.clear();
+        }
+        return;
+    }
+    if (settings.exact) {
+        light_map.resize(canvas_background.width(), canvas_background.height());
+        frame.lights_recomputed = light_map.update(ray_scene, &ray_pool);
+        ray_scene.clear_edits();
+        UpdateLitCanvas(frame, false);
+    }
+    ray_caches.resize(lights.size());
+    frame.bounce_stats.clear();
+    int coarse = settings.coarse_rays(), recast = 0;
+    BounceSettings bounces = ray_job.bounces;
+    int bounce_budget = bounces.budget;  // shared by all lights
+    for (size_t k = 0; k < lights.size(); k++) {
+        const Shape& light = ray_scene.shapes[lights[k]];
+        LightRays& rays = frame.light_rays[k];
+        rays.origin = light.center;
+        rays.color = light_rgb(light.color);
+        rays.bounces.clear();
+        if (settings.exact) {
+            rays.hits = light_map.lights()[k].polygon.rays;
+            frame.rays_cast += (int)rays.hits.size();
+            continue;
+        }
+        double reach = ray_reach(light.center, view);
+        if (reach == 0) {
+            rays.hits.clear();
+            ray_caches[k].clear();
+            continue;
         }
         
-        Point2D end = hit ? Point2D(light_pos.x + dir.x * min_t, light_pos.y + dir.y * min_t)
-                          : Point2D(light_pos.x + dir.x * 2000, light_pos.y + dir.y * 2000);
-        MoveToEx(hdc, (int)light_pos.x, (int)light_pos.y, NULL);
-        LineTo(hdc, (int)end.x, (int)end.y);
-    }
-    DeleteObject(ray_pen);
-    
-    // drawing all the shapes on screen
-    for (int i = 0; i < shapes.size(); i++) {
-        auto& shape = shapes[i];
-        if (shape.is_light) {
-            // making the light source glow nicely
-            for (int j = 5; j > 0; j--) {
-                HBRUSH glow = CreateSolidBrush(RGB(255, 240 - j*20, 100 - j*15));
-                HPEN glow_pen = CreatePen(PS_SOLID, 1, RGB(255, 240 - j*20, 100 - j*15));
-                SelectObject(hdc, glow);
-                SelectObject(hdc, glow_pen);
-                Ellipse(hdc, (int)(shape.center.x - shape.size1 - j*8), 
-                             (int)(shape.center.y - shape.size1 - j*8),
-                             (int)(shape.center.x + shape.size1 + j*8), 
-                             (int)(shape.center.y + shape.size1 + j*8));
-                DeleteObject(glow);
-                DeleteObject(glow_pen);
-            }
-            // the bright center of the light
-            HBRUSH light_brush = CreateSolidBrush(RGB(255, 255, 255));
-            SelectObject(hdc, light_brush);
-            Ellipse(hdc, (int)(shape.center.x - shape.size1), (int)(shape.center.y - shape.size1),
-                         (int)(shape.center.x + shape.size1), (int)(shape.center.y + shape.size1));
-            DeleteObject(light_brush);
+        // the coarse fan from the cache, the adaptive refinement on top of it every time
+        ray_scene.tracer.set_reach(reach);
+        recast += ray_caches[k].update(ray_scene, light.center, coarse, &ray_pool);
+        rays.hits = ray_caches[k].rays();
+        frame.rays_cast += settings.adaptive ? ray_scene.tracer.refine(light.center, settings, rays.hits, &ray_pool) : 0;
+        frame.rays_cast += trace_bounces(ray_scene, rays.hits, bounces, bounce_budget, rays.bounces, &frame.bounce_stats,
+                                         &ray_pool);
+    }
+    if (!settings.exact) {
+        frame.rays_cast += recast;
+        frame.rays_recast = lights.empty() || coarse == 0 ? 0 : (double)recast / (coarse * lights.size());
+        ray_scene.clear_edits();
+    }
+}
+
+// hands the shapes as they are now to the ray thread, which posts WM_RAYS_DONE
+// when it's through; with nothing changed, it only refines the soft shadows
+void StartRays(HWND hwnd) {
+    ray_job.refine = !rays_dirty && scene.edits.empty();
+    if (!ray_job.refine) {
+        // the whole scene only once shapes were added or erased, a drag or a step sends just what moved
+        ray_job.full = scene.reshaped();
+        ray_job.changed.clear();
+        if (ray_job.full) {
+            ray_job.shapes = scene.shapes;
         } else {
-            shape.draw(hdc);
-            
-            // showing which shape is selected
-            if (i == selected_shape_index) {
-                HPEN select_pen = CreatePen(PS_DOT, 2, RGB(100, 200, 255));
-                SelectObject(hdc, select_pen);
-                SelectObject(hdc, GetStockObject(NULL_BRUSH));
-                
-                // dotted outline around selected shape
-                Ellipse(hdc, (int)(shape.center.x - shape.size1 - 5), 
-                             (int)(shape.center.y - shape.size1 - 5),
-                             (int)(shape.center.x + shape.size1 + 5), 
-                             (int)(shape.center.y + shape.size1 + 5));
-                
-                // blue handle for resizing
-                HBRUSH handle_brush = CreateSolidBrush(RGB(100, 200, 255));
-                SelectObject(hdc, handle_brush);
-                int hx = (int)(shape.center.x + shape.size1);
-                int hy = (int)shape.center.y;
-                Ellipse(hdc, hx - 6, hy - 6, hx + 6, hy + 6);
-                DeleteObject(handle_brush);
-                DeleteObject(select_pen);
+            ray_job.shapes.clear();
+            for (int i : scene.changed_shapes()) {
+                ray_job.changed.push_back(i);
+                ray_job.shapes.push_back(scene.shapes[i]);
             }
         }
+        scene.clear_changes();
+        ray_job.edits.swap(scene.edits);
+        scene.clear_edits();
+    }
+    ray_job.settings = ray_settings;
+    ray_job.bounces = bounce_settings;
+    ray_job.soft = soft_shadows && ray_settings.exact;
+    ray_job.area = area_settings;
+    ray_job.camera = camera;
+    ray_job.reset = reset_ray_caches;
+    ray_job.has_input = ray_input_waiting;
+    ray_job.input_time = ray_input_time;
+    reset_ray_caches = false;
+    ray_input_waiting = false;
+    rays_dirty = false;
+    auto job = [] {
+        ray_frame.cast_start = Clock::now();
+        CastRays();
+        ray_frame.cast_end = Clock::now();
+    };
+    rays_in_flight = ray_worker.start(job, [hwnd] { PostMessage(hwnd, WM_RAYS_DONE, 0, 0); });
+}
+
+// Swaps the rays the thread just cast in front and marks what they changed.
+// The old ones go to the back, where the next job overwrites them.
+void ApplyRays() {
+    rays_in_flight = false;
+    PROFILE_WORKER("ray thread", ray_frame.cast_start, ray_frame.cast_end);
+    light_rays.swap(ray_frame.light_rays);
+    const std::vector<LightRays>& previous = ray_frame.light_rays;
+    bool was_exact = rays_exact;
+    rays_exact = ray_frame.exact;
+    if (rays_exact) {
+        lit_canvas.swap(ray_frame.lit_canvas);
+        lit_width = ray_frame.lit_width;
+        lit_height = ray_frame.lit_height;
+        // cast for a canvas that has been resized since, it's drawn as it is until the next job
+        if (lit_width != canvas_background.width() || lit_height != canvas_background.height()) rays_dirty = true;
+    }
+    rays_cast = ray_frame.rays_cast;
+    lights_recomputed = ray_frame.lights_recomputed;
+    rays_recast = ray_frame.rays_recast;
+    bounce_stats = ray_frame.bounce_stats;
+    area_samples = ray_frame.area_samples;
+    area_change = ray_frame.area_change;
+    area_converged = ray_frame.area_converged;
+    if (ray_job.has_input && !ray_input_shown) {
+        ray_input_shown = true;
+        ray_shown_input_time = ray_job.input_time;
     }
     
-    // adding the sidebar interface
-    DrawSidebar(hdc, height);
+    // the light map can change anywhere, and so can a fan with a different ray count
+    RECT canvas = {0, 0, canvas_width, canvas_height};
+    bool same_fans = !rays_exact && !was_exact && previous.size() == light_rays.size();
+    // bounced rays go anywhere, there's no cheap box around the ones that changed
+    for (size_t k = 0; k < previous.size(); k++) same_fans = same_fans && previous[k].bounces.empty();
+    for (size_t k = 0; k < light_rays.size(); k++) same_fans = same_fans && light_rays[k].bounces.empty();
+    for (size_t k = 0; same_fans && k < light_rays.size(); k++) {
+        same_fans = previous[k].hits.size() == light_rays[k].hits.size();
+    }
+    if (!same_fans) {
+        dirty_rects.push_back(canvas);
+        return;
+    }
     
-    // my signature in the corner
-    SetBkMode(hdc, TRANSPARENT);
-    HFONT credit_font = CreateFontA(32, 0, 0, 0, FW_NORMAL, 0, 0, 0, 0, 0, 0, 0, 0, "Segoe UI");
-    SelectObject(hdc, credit_font);
+    // otherwise just the box around every ray whose end moved, before and after
+    RECT box = {0, 0, 0, 0};
+    bool any = false;
+    auto extend = [&](Point2D world) {
+        Point2D p = camera.to_screen(world);
+        if (!any) { box.left = box.right = (LONG)p.x; box.top = box.bottom = (LONG)p.y; any = true; }
+        box.left = std::min(box.left, (LONG)p.x); box.right = std::max(box.right, (LONG)p.x);
+        box.top = std::min(box.top, (LONG)p.y); box.bottom = std::max(box.bottom, (LONG)p.y);
+    };
+    for (size_t k = 0; k < light_rays.size(); k++) {
+        const LightRays& before = previous[k];
+        const LightRays& after = light_rays[k];
+        bool moved_origin = (int)before.origin.x != (int)after.origin.x || (int)before.origin.y != (int)after.origin.y;
+        for (size_t i = 0; i < after.hits.size(); i++) {
+            if (!moved_origin && (int)before.hits[i].end.x == (int)after.hits[i].end.x &&
+                                 (int)before.hits[i].end.y == (int)after.hits[i].end.y) continue;
+            extend(before.origin);
+            extend(before.hits[i].end);
+            extend(after.origin);
+            extend(after.hits[i].end);
+        }
+    }
+    if (!any) return;
+    box.left = std::max(box.left - 2, 0L);
+    box.top = std::max(box.top - 2, 0L);
+    box.right = std::min(box.right + 2, (LONG)canvas_width);
+    box.bottom = std::min(box.bottom + 2, (LONG)canvas_height);
+    if (box.left < box.right && box.top < box.bottom) dirty_rects.push_back(box);
+}
+
+void Render(HDC hdc, int height) {
+    PROFILE_SCOPE("render");
+    // only the dirty parts of the frame are drawn again, everything else is kept
+    draw_calls = 0;
+    SetRectRgn(gdi.dirty_region, 0, 0, 0, 0);
+    for (auto& r : dirty_rects) {
+        SetRectRgn(gdi.dirty_piece, r.left, r.top, r.right, r.bottom);
+        CombineRgn(gdi.dirty_region, gdi.dirty_region, gdi.dirty_piece, RGN_OR);
+    }
+    SelectClipRgn(hdc, gdi.dirty_region);
     
-    const char* credit_text = "Made by Batuhan Eroglu";
-    SIZE text_size;
-    GetTextExtentPoint32A(hdc, credit_text, strlen(credit_text), &text_size);
+    // the cached background, grid and sidebar cards under every dirty rect
+    {
+        PROFILE_SCOPE("static layer");
+        for (auto& r : dirty_rects) {
+            BitBlt(hdc, r.left, r.top, r.right - r.left, r.bottom - r.top, gdi.static_layer.dc, r.left, r.top, SRCCOPY);
+            draw_calls++;
+        }
+    }
     
-    // keeping it in the bottom-left corner
-    int text_x = 15;
-    int text_y = height - text_size.cy - 15;
+    // rays and shapes stay on the canvas side
+    IntersectClipRect(hdc, 0, 0, canvas_width, height);
     
-    // shadow for better readability
-    SetTextColor(hdc, RGB(0, 0, 0));
-    TextOutA(hdc, text_x + 2, text_y + 2, credit_text, strlen(credit_text));
+    // the lit canvas in exact mode, one blit the clip region cuts down to the dirty rects;
+    // at the size it was cast for, not the canvas's, which can have changed since
+    if (rays_exact && !lit_canvas.empty()) {
+        PROFILE_SCOPE("lit canvas");
+        BITMAPINFO info = {};
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = lit_width;
+        info.bmiHeader.biHeight = -lit_height;  // top-down rows like the raster
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+        SetDIBitsToDevice(hdc, 0, 0, lit_width, lit_height, 0, 0, 0, lit_height, lit_canvas.data(), &info,
+                          DIB_RGB_COLORS);
+        draw_calls++;
+    }
     
-    // the actual text
-    SetTextColor(hdc, RGB(255, 255, 255));
-    TextOutA(hdc, text_x, text_y, credit_text, strlen(credit_text));
+    // then the rays and shapes that cross a dirty rect
+    gdi.canvas.dc = hdc;
+    gdi.canvas.clip = &dirty_rects;
+    gdi.canvas.draw_calls = 0;
+    {
+        PROFILE_SCOPE("draw rays");
+        CameraBackend world(gdi.canvas, camera);
+        for (auto& rays : light_rays) {
+            draw_rays(world, rays.origin, rays.hits, rays.color);
+            draw_bounces(world, rays.bounces, rays.color);
+        }
+    }
+    {
+        PROFILE_SCOPE("draw shapes");
+        draw_scene_view(gdi.canvas, scene, camera, canvas_width, height, scene.index_of(selection));
+    }
+    draw_calls += gdi.canvas.draw_calls;
+    
+    // back to the whole dirty area for the sidebar numbers and the signature
+    SelectClipRgn(hdc, gdi.dirty_region);
+    
+    {
+        PROFILE_SCOPE("sidebar text");
+        if (touches_dirty(sidebar_stats_rect())) DrawSidebarStats(hdc);
+        if (show_profiler && touches_dirty(sidebar_info_rect(height))) DrawProfilerPanel(hdc, height);
+    }
+    
+    // the cached signature goes over everything: mask out, then paint in
+    const RECT& credit = gdi.credit_rect;
+    if (touches_dirty(credit)) {
+        int w = credit.right - credit.left, h = credit.bottom - credit.top;
+        BitBlt(hdc, credit.left, credit.top, w, h, gdi.credit_mask.dc, 0, 0, SRCAND);
+        BitBlt(hdc, credit.left, credit.top, w, h, gdi.credit_layer.dc, 0, 0, SRCPAINT);
+        draw_calls += 2;
+    }
     
-    DeleteObject(credit_font);
+    SelectClipRgn(hdc, NULL);
+    dirty_rects.clear();
 }
 
-LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+// one drag, resize, light move or pan step towards the mouse at x, y on the canvas
+void ApplyMouseMove(int mouse_x, int mouse_y) {
+    if (panning) {
+        camera.pan(mouse_x - pan_from.x, mouse_y - pan_from.y);
+        pan_from.x = mouse_x;
+        pan_from.y = mouse_y;
+        mark_camera_moved();
+        return;
+    }
+    
+    // everything else happens in the world
+    Point2D mouse = camera.to_world(Point2D(mouse_x, mouse_y));
+    double x = mouse.x, y = mouse.y;
+    Box view = camera.view(canvas_width, canvas_height);
+    int selected = scene.index_of(selection);
+    int light = scene.index_of(dragged_light);
+    if (resizing_shape && selected >= 0) {
+        Shape& shape = scene.shapes[selected];
+        double dx = x - shape.center.x;
+        double dy = y - shape.center.y;
+        
+        // figuring out the new size based on mouse position
+        double new_size = std::max(20.0, std::sqrt(dx * dx + dy * dy));
+        
+        // only if it doesn't overlap with anything
+        RECT before = shape_rect(shape);
+        if (scene.try_resize_shape(selected, new_size)) {
+            recorder.resize(selected, new_size);
+            mark_dirty(before);
+            mark_shape_dirty(selected);
+            mark_rays_dirty();
+        }
+    }
+    else if (dragging_shape && selected >= 0) {
+        Point2D new_pos(x - drag_offset.x, y - drag_offset.y);
+        
+        // keeping shapes inside the view
+        double margin = 50;
+        if (new_pos.x - margin < view.left) new_pos.x = view.left + margin;
+        if (new_pos.x + margin > view.right) new_pos.x = view.right - margin;
+        if (new_pos.y - margin < view.top) new_pos.y = view.top + margin;
+        if (new_pos.y + margin > view.bottom) new_pos.y = view.bottom - margin;
+        
+        // only if it doesn't bump into other shapes
+        RECT before = shape_rect(scene.shapes[selected]);
+        if (scene.try_move_shape(selected, new_pos)) {
+            recorder.move(selected, new_pos);
+            mark_dirty(before);
+            mark_shape_dirty(selected);
+            mark_rays_dirty();
+        }
+    }
+    else if (light >= 0) {
+        Point2D new_pos(x, y);
+        
+        double lr = scene.shapes[light].size1;
+        if (new_pos.x - lr < view.left) new_pos.x = view.left + lr;
+        if (new_pos.x + lr > view.right) new_pos.x = view.right - lr;
+        if (new_pos.y - lr < view.top) new_pos.y = view.top + lr;
+        if (new_pos.y + lr > view.bottom) new_pos.y = view.bottom - lr;
+        
+        // pushed out of any circle it would land in
+        mark_shape_dirty(light);
+        scene.move_light(light, new_pos);
+        recorder.move_light(light, new_pos);
+        mark_shape_dirty(light);
+        mark_rays_dirty();
+    }
+}
+
+// The newest mouse move since the last frame as a single step, however many
+// came in; its latency counts from the oldest of them.
+void FlushMouseMove() {
+    if (!mouse_move_pending) return;
+    mouse_move_pending = false;
+    event_time = pending_mouse_time;
+    ApplyMouseMove(pending_mouse_x, pending_mouse_y);
+}
+
+// past this many moving shapes one rect over the canvas beats a pair each
+const int MAX_MOVING_RECTS = 64;
+
+struct MovingShape {
+    int index;
+    Point2D center;
+    RECT rect;   // where it was drawn before the steps
+};
+std::vector<MovingShape> moving_shapes;
+
+// Catches the simulation up with the clock, then closes the frame for the
+// recorder. Only the shapes that moved are drawn again, where they were and
+// where they are, and the rays only when something did. Moving shapes
+// aren't input, so the latency stats leave them out.
+void Simulate() {
+    Clock::time_point now = Clock::now();
+    double seconds = std::chrono::duration<double>(now - last_simulated).count();
+    last_simulated = now;
+    
+    // steps don't add or erase shapes, so the indices hold across them
+    moving_shapes.clear();
+    if (simulation.running) {
+        for (int i = 0; i < (int)scene.shapes.size(); i++) {
+            const Shape& s = scene.shapes[i];
+            if (s.velocity.x != 0 || s.velocity.y != 0) moving_shapes.push_back({i, s.center, shape_rect(s)});
+        }
+    }
     
-    auto is_on_resize_handle = [](Point2D p, Shape& shape) -> bool {
-        // checking if mouse is on the resize handle
-        int hx = (int)(shape.center.x + shape.size1);
-        int hy = (int)shape.center.y;
-        return (p.x - hx)*(p.x - hx) + (p.y - hy)*(p.y - hy) <= 36;
+    int moved = 0;
+    int steps = simulation.advance(scene, seconds, &moved);
+    if (moved > 0) {
+        if ((int)moving_shapes.size() > MAX_MOVING_RECTS) {
+            mark_all_dirty();
+        } else {
+            for (const MovingShape& m : moving_shapes) {
+                const Shape& s = scene.shapes[m.index];
+                if (s.center.x == m.center.x && s.center.y == m.center.y) continue;
+                mark_dirty(m.rect);
+                mark_dirty(shape_rect(s));
+            }
+        }
+        rays_dirty = true;
+    }
+    // a frame where everything was boxed in still ran its steps, and replays have to run them too
+    recorder.end_frame(steps, scene, camera, simulation.bounds);
+}
+
+// when the message being handled was posted, GetMessageTime() is on the GetTickCount() clock
+Clock::time_point message_time() {
+    DWORD age = GetTickCount() - (DWORD)GetMessageTime();
+    return Clock::now() - std::chrono::milliseconds(age);
+}
+
+LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam) {
+
+    auto is_on_resize_handle = [](Point2D mouse, const Shape& shape) -> bool {
+        // checking if mouse is on the resize handle, in pixels since that's how big it's drawn at any zoom
+        Point2D h = camera.to_screen(resize_handle(shape));
+        return (mouse.x - h.x) * (mouse.x - h.x) + (mouse.y - h.y) * (mouse.y - h.y) <= HANDLE_RADIUS * HANDLE_RADIUS;
     };
     
+    // input is stamped with when it happened, and a click or key comes after the moves before it
+    bool input = (uMsg >= WM_MOUSEFIRST && uMsg <= WM_MOUSELAST) || uMsg == WM_CHAR;
+    if (input && uMsg != WM_MOUSEMOVE) FlushMouseMove();
+    if (input) event_time = message_time();
+    
     switch (uMsg) {
+        case WM_CREATE:
+            gdi.create();
+            return 0;
+        
         case WM_DESTROY:
+            ray_worker.wait();
+            gdi.destroy();
             PostQuitMessage(0);
             return 0;
-            
+        
         case WM_LBUTTONDOWN: {
             int x = GET_X_LPARAM(lParam);
             int y = GET_Y_LPARAM(lParam);
-            Point2D click(x, y);
             
             // ignoring clicks on the sidebar
             if (x >= canvas_width) return 0;
+            Point2D click = camera.to_world(Point2D(x, y));
+            int selected = scene.index_of(selection);
             
             // checking if we're clicking the resize handle
-            if (selected_shape_index >= 0) {
-                if (is_on_resize_handle(click, shapes[selected_shape_index])) {
+            if (selected >= 0) {
+                if (is_on_resize_handle(Point2D(x, y), scene.shapes[selected])) {
                     resizing_shape = true;
                     SetCapture(hwnd);
                     return 0;
                 }
             }
             
-            // checking if we clicked on the light
-            double dx = x - light_pos.x, dy = y - light_pos.y;
-            if (dx * dx + dy * dy < 900) {
-                dragging_light = true;
-                selected_shape_index = -1;
-                SetCapture(hwnd);
-                InvalidateRect(hwnd, NULL, FALSE);
-                return 0;
-            }
-            
-            // checking if we clicked on any shape
-            bool found = false;
-            for (int i = shapes.size() - 1; i >= 0; i--) {
-                if (!shapes[i].is_light && shapes[i].contains_point(click)) {
-                    selected_shape_index = i;
-                    dragging_shape = true;
-                    drag_offset.x = x - shapes[i].center.x;
-                    drag_offset.y = y - shapes[i].center.y;
+            // checking if we clicked on a light
+            for (int light : scene.lights()) {
+                if (scene.shapes[light].contains_point(click)) {
+                    dragged_light = scene.handle_of(light);
+                    mark_shape_dirty(selected);
+                    selection = ShapeHandle();
                     SetCapture(hwnd);
-                    InvalidateRect(hwnd, NULL, FALSE);
-                    found = true;
-                    break;
+                    return 0;
                 }
             }
             
-            if (!found) {
-                // creating a new circle if there's space
+            // checking if we clicked on any shape
+            int hit = shape_at(click, false);
+            if (hit >= 0) {
+                // only the old and new selection outlines change
+                mark_shape_dirty(selected);
+                selection = scene.handle_of(hit);
+                mark_shape_dirty(hit);
+                dragging_shape = true;
+                drag_offset.x = click.x - scene.shapes[hit].center.x;
+                drag_offset.y = click.y - scene.shapes[hit].center.y;
+                SetCapture(hwnd);
+            } else {
+                // creating a new shape of the picked type if there's space, all about as big as the old circle
                 double size = 50;
                 
-                if (!check_collision_with_shapes(click, size)) {
-                    shapes.push_back(Shape(SHAPE_CIRCLE, click, 50));
-                    selected_shape_index = shapes.size() - 1;
-                    InvalidateRect(hwnd, NULL, FALSE);
+                if (!scene.check_collision_with_shapes(click, size)) {
+                    Shape shape(SHAPE_CIRCLE, click, size);
+                    if (selected_shape == SHAPE_SEGMENT) shape = Shape(SHAPE_SEGMENT, click, size);
+                    else if (selected_shape == SHAPE_RECT) shape = Shape(SHAPE_RECT, click, 40, 30);
+                    else if (selected_shape == SHAPE_POLYGON) shape = make_regular_polygon(click, size, 6);
+                    mark_shape_dirty(selected);
+                    int added = scene.add_shape(shape);
+                    recorder.add(shape);
+                    selection = scene.handle_of(added);
+                    mark_shape_dirty(added);
+                    mark_rays_dirty();
                 }
             }
             return 0;
@@ -351,166 +1038,251 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             int x = GET_X_LPARAM(lParam);
             int y = GET_Y_LPARAM(lParam);
             
-            if (x < canvas_width) {
-                Point2D click(x, y);
-                for (int i = shapes.size() - 1; i >= 0; i--) {
-                    if (!shapes[i].is_light && shapes[i].contains_point(click)) {
-                        shapes.erase(shapes.begin() + i);
-                        if (selected_shape_index == i) selected_shape_index = -1;
-                        else if (selected_shape_index > i) selected_shape_index--;
-                        InvalidateRect(hwnd, NULL, FALSE);
-                        break;
-                    }
-                }
+            int i = x < canvas_width ? shape_at(camera.to_world(Point2D(x, y)), true) : -1;
+            if (i >= 0) {
+                // the selection and a dragged light find their shape again by handle, or nothing if it was this one
+                mark_shape_dirty(i);
+                scene.erase_shape(i);
+                recorder.erase(i);
+                mark_rays_dirty();
             }
             return 0;
         }
         
+        case WM_MBUTTONDOWN:
+            if (GET_X_LPARAM(lParam) >= canvas_width) return 0;
+            panning = true;
+            pan_from.x = GET_X_LPARAM(lParam);
+            pan_from.y = GET_Y_LPARAM(lParam);
+            SetCapture(hwnd);
+            return 0;
+        
+        case WM_MBUTTONUP:
+            panning = false;
+            ReleaseCapture();
+            return 0;
+        
+        case WM_MOUSEWHEEL: {
+            // a notch zooms by a quarter, around the point under the mouse; the position comes in screen coordinates
+            POINT at = {GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)};
+            ScreenToClient(hwnd, &at);
+            if (at.x < 0 || at.x >= canvas_width) return 0;
+            double notches = (double)GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA;
+            camera.zoom_at(Point2D(at.x, at.y), std::pow(1.25, notches));
+            mark_camera_moved();
+            return 0;
+        }
+        
         case WM_LBUTTONUP:
-            dragging_light = false;
+            dragged_light = ShapeHandle();
             dragging_shape = false;
             resizing_shape = false;
             ReleaseCapture();
             return 0;
-            
-        case WM_MOUSEMOVE: {
-            int x = GET_X_LPARAM(lParam);
-            int y = GET_Y_LPARAM(lParam);
-            
-            if (resizing_shape && selected_shape_index >= 0) {
-                Shape& shape = shapes[selected_shape_index];
-                double dx = x - shape.center.x;
-                double dy = y - shape.center.y;
-                
-                // figuring out the new size based on mouse position
-                double new_size = std::max(20.0, std::sqrt(dx * dx + dy * dy));
-                
-                // making sure we don't overlap with anything
-                bool can_resize = true;
-                for (int i = 0; i < shapes.size(); i++) {
-                    if (i == selected_shape_index) continue;
-                    
-                    double dx_center = shape.center.x - shapes[i].center.x;
-                    double dy_center = shape.center.y - shapes[i].center.y;
-                    double dist = std::sqrt(dx_center * dx_center + dy_center * dy_center);
-                    
-                    double other_size = shapes[i].is_light ? shapes[i].size1 : shapes[i].size1;
-                    double min_distance = new_size + other_size;
-                    
-                    if (dist < min_distance) {
-                        can_resize = false;
-                        break;
+        
+        case WM_MOUSEMOVE:
+            // only remembered, the frame loop applies the newest one once per frame
+            if (!resizing_shape && !dragging_shape && scene.index_of(dragged_light) < 0 && !panning) return 0;
+            if (!mouse_move_pending) pending_mouse_time = event_time;
+            mouse_move_pending = true;
+            pending_mouse_x = GET_X_LPARAM(lParam);
+            pending_mouse_y = GET_Y_LPARAM(lParam);
+            return 0;
+        
+        case WM_RAYS_DONE:
+            // only wakes the frame loop up, it picks the rays up from there
+            return 0;
+        
+        case WM_CHAR: {
+            // runtime ray settings
+            switch ((char)wParam) {
+                case 'v': case 'V':
+                    // whichever mode was off didn't see the edits since, so its caches start over
+                    ray_settings.exact = !ray_settings.exact;
+                    reset_ray_caches = true;
+                    break;
+                case 'o': case 'O':
+                    // soft shadows are drawn through the light map, so they bring exact mode along
+                    soft_shadows = !soft_shadows;
+                    if (soft_shadows) ray_settings.exact = true;
+                    reset_ray_caches = true;
+                    break;
+                case '{': area_settings.samples_per_frame = std::max(area_settings.samples_per_frame / 2, 1); break;
+                case '}': area_settings.samples_per_frame = std::min(area_settings.samples_per_frame * 2, 64); break;
+                case 'a': case 'A': ray_settings.adaptive = !ray_settings.adaptive; break;
+                case '+': case '=': ray_settings.ray_count = std::min(ray_settings.ray_count * 2, 65536); break;
+                case '-': ray_settings.ray_count = std::max(ray_settings.ray_count / 2, 8); break;
+                case ']': ray_settings.max_depth = std::min(ray_settings.max_depth + 1, 16); break;
+                case '[': ray_settings.max_depth = std::max(ray_settings.max_depth - 1, 0); break;
+                case '.': ray_settings.budget = std::min(ray_settings.budget * 2, 1 << 20); break;
+                case ',': ray_settings.budget = std::max(ray_settings.budget / 2, 16); break;
+                case 'b': case 'B': bounce_settings.max_depth = (bounce_settings.max_depth + 1) % 7; break;
+                case 'c': case 'C': camera = Camera(); break;
+                case 'm': case 'M': {
+                    // the selected shape goes to the next material preset, matte, mirror, glass
+                    int selected = scene.index_of(selection);
+                    if (selected < 0 || scene.shapes[selected].is_light) return 0;
+                    Shape& shape = scene.shapes[selected];
+                    int preset = 0;
+                    for (int i = 0; i < MATERIAL_PRESETS; i++) {
+                        Material m = material_preset(i);
+                        if (m.reflectance == shape.material.reflectance && m.ior == shape.material.ior &&
+                            m.absorption == shape.material.absorption) preset = i;
                     }
+                    shape.material = material_preset((preset + 1) % MATERIAL_PRESETS);
+                    scene.shape_changed(selected);
+                    recorder.set_material(selected, shape.material);
+                    break;
                 }
-                
-                if (can_resize) {
-                    shape.size1 = new_size;
+                case 'p': case 'P': {
+                    // the title card names the type, so the static layer gets drawn again
+                    selected_shape = (ShapeType)((selected_shape + 1) % (SHAPE_POLYGON + 1));
+                    RECT client;
+                    GetClientRect(hwnd, &client);
+                    HDC hdc = GetDC(hwnd);
+                    BuildStaticLayers(hdc, client.right, client.bottom);
+                    ReleaseDC(hwnd, hdc);
+                    break;
                 }
-                InvalidateRect(hwnd, NULL, FALSE);
-            }
-            else if (dragging_shape && selected_shape_index >= 0) {
-                Point2D new_pos(x - drag_offset.x, y - drag_offset.y);
-                
-                // keeping shapes inside the canvas
-                double margin = 50;
-                if (new_pos.x - margin < 0) new_pos.x = margin;
-                if (new_pos.x + margin > canvas_width) new_pos.x = canvas_width - margin;
-                if (new_pos.y - margin < 0) new_pos.y = margin;
-                if (new_pos.y + margin > canvas_height) new_pos.y = canvas_height - margin;
-                
-                // making sure we don't bump into other shapes
-                bool can_move = true;
-                for (int i = 0; i < shapes.size(); i++) {
-                    if (i == selected_shape_index) continue;
-                    
-                    double dx = new_pos.x - shapes[i].center.x;
-                    double dy = new_pos.y - shapes[i].center.y;
-                    double dist = std::sqrt(dx * dx + dy * dy);
-                    
-                    double size_current = shapes[selected_shape_index].type == SHAPE_CIRCLE ? 
-                                         shapes[selected_shape_index].size1 :
-                                         std::max(shapes[selected_shape_index].size1, shapes[selected_shape_index].size2) * 0.7;
-                    double size_other = shapes[i].is_light ? shapes[i].size1 :
-                                       (shapes[i].type == SHAPE_CIRCLE ? shapes[i].size1 :
-                                        std::max(shapes[i].size1, shapes[i].size2) * 0.7);
-                    
-                    if (dist < size_current + size_other) {
-                        can_move = false;
-                        break;
-                    }
+                case 'r': case 'R': {
+                    // circles look the same turned, the rest go round 15 degrees
+                    int selected = scene.index_of(selection);
+                    if (selected < 0 || scene.shapes[selected].is_light) return 0;
+                    scene.rotate_shape(selected, 15 * 3.14159265359 / 180);
+                    recorder.rotate(selected, 15 * 3.14159265359 / 180);
+                    break;
                 }
-                
-                if (can_move) {
-                    shapes[selected_shape_index].center = new_pos;
-                    InvalidateRect(hwnd, NULL, FALSE);
+                case 'l': case 'L': {
+                    // a new light under the mouse, in the next color along, if it fits there
+                    POINT cursor;
+                    GetCursorPos(&cursor);
+                    ScreenToClient(hwnd, &cursor);
+                    Point2D pos = camera.to_world(Point2D(cursor.x, cursor.y));
+                    Box view = camera.view(canvas_width, canvas_height);
+                    double lr = 30;
+                    if (pos.x - lr < view.left || pos.x + lr > view.right || pos.y - lr < view.top ||
+                        pos.y + lr > view.bottom || scene.overlaps_any_shape(pos, lr)) return 0;
+                    Shape light(SHAPE_CIRCLE, pos, lr, 0, true);
+                    light.color = light_palette((int)scene.lights().size());
+                    scene.add_shape(light);
+                    recorder.add(light);
+                    break;
                 }
-            }
-            else if (dragging_light) {
-                Point2D new_pos(x, y);
-                
-                double lr = 30;
-                for (auto& s : shapes) if (s.is_light) { lr = s.size1; break; }
-                if (new_pos.x - lr < 0) new_pos.x = lr;
-                if (new_pos.x + lr > canvas_width) new_pos.x = canvas_width - lr;
-                if (new_pos.y - lr < 0) new_pos.y = lr;
-                if (new_pos.y + lr > canvas_height) new_pos.y = canvas_height - lr;
-                
-                for (auto& s : shapes) {
-                    if (s.is_light) continue;
-                    double dx = new_pos.x - s.center.x, dy = new_pos.y - s.center.y;
-                    double dist = std::sqrt(dx * dx + dy * dy);
-                    double min_dist = lr + (s.type == SHAPE_CIRCLE ? s.size1 : std::max(s.size1, s.size2) * 0.7);
-                    if (dist < min_dist) {
-                        double angle = std::atan2(dy, dx);
-                        new_pos.x = s.center.x + std::cos(angle) * min_dist;
-                        new_pos.y = s.center.y + std::sin(angle) * min_dist;
+                case 'g': case 'G':
+                    // the shapes bounce off the edges of the view as it is now
+                    simulation.running = !simulation.running;
+                    simulation.bounds = camera.view(canvas_width, canvas_height);
+                    last_simulated = Clock::now();
+                    return 0;
+                case 'k': case 'K': {
+                    // every shape and light off in a random direction, at up to 200 world units a second
+                    static std::mt19937 rng(1);
+                    std::uniform_real_distribution<double> unit(0, 1);
+                    for (int i = 0; i < (int)scene.shapes.size(); i++) {
+                        double a = unit(rng) * 2 * 3.14159265359, v = 200 * unit(rng);
+                        scene.shapes[i].velocity = Point2D(std::cos(a) * v, std::sin(a) * v);
+                        recorder.set_velocity(i, scene.shapes[i].velocity);
                     }
+                    return 0;
                 }
-                
-                light_pos = new_pos;
-                for (auto& s : shapes) if (s.is_light) { s.center = light_pos; break; }
-                InvalidateRect(hwnd, NULL, FALSE);
+                case 'w': case 'W':
+                    if (recorder.recording()) recorder.stop();
+                    else if (!recorder.start("replay.rtlog", scene, camera, simulation.bounds)) {
+                        MessageBoxA(hwnd, "Could not write replay.rtlog", "Record replay", MB_OK | MB_ICONERROR);
+                    }
+                    return 0;
+#if RAYTRACE_PROFILER
+                case 'f': case 'F': show_profiler = !show_profiler; break;
+                case 't': case 'T':
+                    if (!frame_profiler().write_chrome_trace("trace.json")) {
+                        MessageBoxA(hwnd, "Could not write trace.json", "Frame trace", MB_OK | MB_ICONERROR);
+                    }
+                    return 0;
+#endif
+                case 's': case 'S':
+                    // saving doesn't change anything on screen
+                    if (!save_scene(scene_path.c_str(), scene, scene_format_for(scene_path.c_str()))) {
+                        MessageBoxA(hwnd, ("Could not write " + scene_path).c_str(), "Save scene", MB_OK | MB_ICONERROR);
+                    }
+                    return 0;
+                default: return 0;
             }
+            mark_rays_dirty();
+            mark_all_dirty();
             return 0;
         }
         
         case WM_SIZE: {
             canvas_width = LOWORD(lParam) - SIDEBAR_WIDTH;
             canvas_height = HIWORD(lParam);
-            InvalidateRect(hwnd, NULL, FALSE);
+            
+            // the only place the cached layers and the back buffer are rebuilt
+            int width = LOWORD(lParam), height = HIWORD(lParam);
+            if (width > 0 && height > 0) {
+                HDC hdc = GetDC(hwnd);
+                BuildStaticLayers(hdc, width, height);
+                gdi.back_buffer.create(hdc, width, height);
+                ReleaseDC(hwnd, hdc);
+            }
+            mark_rays_dirty();
+            mark_all_dirty();
             return 0;
         }
-            
+        
         case WM_PAINT: {
+            PROFILE_FRAME_BEGIN();
             PAINTSTRUCT ps;
             HDC hdc = BeginPaint(hwnd, &ps);
             
             RECT client_rect;
             GetClientRect(hwnd, &client_rect);
-            int width = client_rect.right;
             int height = client_rect.bottom;
             
-            // using double buffering to avoid flickering
-            HDC memDC = CreateCompatibleDC(hdc);
-            HBITMAP memBitmap = CreateCompatibleBitmap(hdc, width, height);
-            HBITMAP oldBitmap = (HBITMAP)SelectObject(memDC, memBitmap);
-            
-            Render(memDC, width, height);
-            
-            BitBlt(hdc, 0, 0, width, height, memDC, 0, 0, SRCCOPY);
-            
-            SelectObject(memDC, oldBitmap);
-            DeleteObject(memBitmap);
-            DeleteDC(memDC);
+            if (gdi.back_buffer.dc) {
+                // composing the dirty parts into the kept back buffer
+                if (!dirty_rects.empty()) {
+                    dirty_rects.push_back(sidebar_stats_rect());
+                    if (show_profiler) dirty_rects.push_back(sidebar_info_rect(height));
+                    int dirty_count = (int)dirty_rects.size();
+                    Render(gdi.back_buffer.dc, height);
+#ifndef NDEBUG
+                    char line[160];
+                    snprintf(line, sizeof(line), "frame: %d dirty rects, %d draw calls, %d gdi allocations, %.1f%% of rays recast, "
+                             "latency %.1f ms\n", dirty_count, draw_calls, gdi_allocations, rays_recast * 100,
+                             shape_latency.average());
+                    OutputDebugStringA(line);
+                    for (size_t d = 0; d < bounce_stats.rays.size(); d++) {
+                        snprintf(line, sizeof(line), "  bounce %d: %lld rays, %.2f Mrays/s\n", (int)d + 1, bounce_stats.rays[d],
+                                 bounce_stats.rays[d] / (bounce_stats.seconds[d] * 1e6));
+                        OutputDebugStringA(line);
+                    }
+#endif
+                    gdi_allocations = 0;
+                }
+                
+                // and showing whatever Windows asked for
+                PROFILE_SCOPE("present");
+                BitBlt(hdc, ps.rcPaint.left, ps.rcPaint.top, ps.rcPaint.right - ps.rcPaint.left,
+                       ps.rcPaint.bottom - ps.rcPaint.top, gdi.back_buffer.dc, ps.rcPaint.left, ps.rcPaint.top, SRCCOPY);
+                
+                // the input this frame shows has reached the screen once GDI has sent it all off
+                GdiFlush();
+                Clock::time_point shown = Clock::now();
+                if (shape_input_waiting) shape_latency.add(shown - shape_input_time);
+                if (ray_input_shown) ray_latency.add(shown - ray_shown_input_time);
+                shape_input_waiting = false;
+                ray_input_shown = false;
+            }
             
             EndPaint(hwnd, &ps);
+            PROFILE_FRAME_END();
             return 0;
         }
     }
     return DefWindowProc(hwnd, uMsg, wParam, lParam);
 }
 
-int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow) {
+int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR cmd_line, int nCmdShow) {
     const char CLASS_NAME[] = "Raytracing";
     
     WNDCLASSEXA wc = {};
@@ -534,17 +1306,76 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, LPSTR, int nCmdShow) {
     
     if (!hwnd) return 0;
     
-    // starting with a light and one circle
-    shapes.push_back(Shape(SHAPE_CIRCLE, light_pos, 30, 0, true));
-    shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(500, 200), 70));
+    // a scene file from the command line, otherwise starting with a light and one circle
+    std::string path = cmd_line ? cmd_line : "";
+    if (path.size() >= 2 && path.front() == '"' && path.back() == '"') path = path.substr(1, path.size() - 2);
+    std::string error;
+    if (!path.empty() && load_scene(path.c_str(), scene, error)) {
+        scene_path = path;
+    } else {
+        if (!path.empty()) MessageBoxA(hwnd, error.c_str(), "Open scene", MB_OK | MB_ICONERROR);
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(150, 400), 30, 0, true));
+        scene.shapes.push_back(Shape(SHAPE_CIRCLE, Point2D(500, 200), 70));
+        scene.rebuild();
+    }
     
     ShowWindow(hwnd, nCmdShow);
     
-    MSG msg;
-    while (GetMessage(&msg, NULL, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
-    }
+    // one frame per refresh of the monitor the window starts on
+    HDC screen = GetDC(hwnd);
+    int refresh = GetDeviceCaps(screen, VREFRESH);
+    ReleaseDC(hwnd, screen);
+    if (refresh > 1) frame_interval = std::chrono::microseconds(1000000 / refresh);
     
-    return 0;
+    // Messages are drained as they come, but mouse moves and edits only turn
+    // into a frame once per interval. The rays are cast on the worker while
+    // the editor keeps going and show up in the first frame after they're done.
+    Clock::time_point next_frame = Clock::now();
+    for (;;) {
+        MSG msg;
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                ray_worker.wait();
+                return (int)msg.wParam;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+        
+        if (rays_in_flight && !ray_worker.busy()) ApplyRays();
+        
+        Clock::time_point now = Clock::now();
+        if (now >= next_frame) {
+            FlushMouseMove();
+            Simulate();
+            // a still scene keeps adding soft shadow samples, one job per frame
+            if ((rays_dirty || !area_converged) && !rays_in_flight && gdi.back_buffer.dc) StartRays(hwnd);
+            if (!dirty_rects.empty()) {
+                RECT frame = dirty_rects[0];
+                for (auto& r : dirty_rects) UnionRect(&frame, &frame, &r);
+                RECT stats = sidebar_stats_rect();
+                UnionRect(&frame, &frame, &stats);
+                if (show_profiler) {
+                    RECT client;
+                    GetClientRect(hwnd, &client);
+                    RECT panel = sidebar_info_rect(client.bottom);
+                    UnionRect(&frame, &frame, &panel);
+                }
+                InvalidateRect(hwnd, &frame, FALSE);
+                UpdateWindow(hwnd);
+                next_frame = std::max(next_frame + frame_interval, now);
+                continue;
+            }
+        }
+        
+        // asleep until a message comes in, or the next frame is due with something still to show
+        DWORD timeout = INFINITE;
+        bool pending = mouse_move_pending || simulation.running || !dirty_rects.empty() ||
+                       ((rays_dirty || !area_converged) && !rays_in_flight);
+        if (pending) {
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next_frame - Clock::now()).count();
+            timeout = (DWORD)std::max<long long>(wait, 0);
+        }
+        MsgWaitForMultipleObjects(0, NULL, FALSE, timeout, QS_ALLINPUT);
+    }
 }